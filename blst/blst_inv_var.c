@@ -0,0 +1,289 @@
+/*
+ * Variable time inversion modulo the BLS12-381 prime, for the verify-only
+ * build of blst, see USE_BLST_VERIFY_VAR in blst/blst_verify_var.patch.
+ *
+ * blst inverts field elements by exponentiation to p - 2, around 450
+ * squarings and multiplications each, so that secret values can be inverted
+ * safely. bls12_381_sighash_all only ever inverts public data: coordinates of
+ * pubkeys, signatures and message hashes and the Fp12 Miller loop output. This
+ * uses the safegcd algorithm of Bernstein and Yang instead, in the same
+ * variant with batches of 62 variable time divsteps as
+ * deps/secp256k1_modinv_var.h, on a signed 7x62 bit representation.
+ *
+ * The element is inverted as it is, in Montgomery form, and one Montgomery
+ * multiplication by R^3 brings the result back: (aR)^-1 * R^3 / R = a^-1 * R.
+ */
+#include <stdint.h>
+
+#include "blst.h"
+
+#define CKB_BLST_INV_LIMBS 7
+
+typedef struct {
+  int64_t v[CKB_BLST_INV_LIMBS];
+} ckb_blst_signed62;
+
+typedef struct {
+  int64_t u, v, q, r;
+} ckb_blst_trans2x2;
+
+__extension__ typedef __int128 ckb_blst_int128;
+
+#define CKB_BLST_M62 (UINT64_MAX >> 2)
+
+static const ckb_blst_signed62 ckb_blst_p_62 = {
+    {0x39feffffffffaaabLL, 0x3aaffffac54ffffeLL, 0x330d2a0f6b0f6241LL,
+     0x1dd2e13ce144afd9LL, 0x1ba7b6434bacd764LL, 0x0447a8e5ff9a692cLL,
+     0x1a0LL}};
+
+// p^-1 mod 2^62
+static const uint64_t ckb_blst_p_inv62 = 0x360c000300030003ULL;
+
+// R^3 mod p with R = 2^384, in the limb order of blst_fp
+static const blst_fp ckb_blst_r3 = {
+    {0xed48ac6bd94ca1e0ULL, 0x315f831e03a7adf8ULL, 0x9a53352a615e29ddULL,
+     0x34c04e5e921e1761ULL, 0x2512d43565724728ULL, 0x0aa6346091755d4dULL}};
+
+// x must not be 0, RV64 has no count trailing zeros instruction without Zbb
+static int ckb_blst_ctz64_var(uint64_t x) {
+  static const uint8_t debruijn[64] = {
+      0,  1,  2,  53, 3,  7,  54, 27, 4,  38, 41, 8,  34, 55, 48, 28,
+      62, 5,  39, 46, 44, 42, 22, 9,  24, 35, 59, 56, 49, 18, 29, 11,
+      63, 52, 6,  26, 37, 40, 33, 47, 61, 45, 43, 21, 23, 58, 17, 10,
+      51, 25, 36, 32, 60, 20, 57, 16, 50, 31, 19, 15, 30, 14, 13, 12};
+  return debruijn[((x & -x) * 0x022FDD63CC95386DULL) >> 58];
+}
+
+/*
+ * Do 62 divsteps on the low 64 bits of f and g, starting from eta = -delta,
+ * and return the new eta, see ckb_modinv64_divsteps_62_var.
+ */
+static int64_t ckb_blst_divsteps_62_var(int64_t eta, uint64_t f0, uint64_t g0,
+                                        ckb_blst_trans2x2 *t) {
+  uint64_t u = 1, v = 0, q = 0, r = 1;
+  uint64_t f = f0, g = g0, m;
+  uint32_t w;
+  int i = 62, limit, zeros;
+
+  for (;;) {
+    // the sentinel bit stops the count at i
+    zeros = ckb_blst_ctz64_var(g | (UINT64_MAX << i));
+    g >>= zeros;
+    u <<= zeros;
+    v <<= zeros;
+    eta -= zeros;
+    i -= zeros;
+    if (i == 0) {
+      break;
+    }
+    // g is odd now, if eta is negative, swap f and g with g and -f
+    if (eta < 0) {
+      uint64_t tmp;
+      eta = -eta;
+      tmp = f;
+      f = g;
+      g = -tmp;
+      tmp = u;
+      u = q;
+      q = -tmp;
+      tmp = v;
+      v = r;
+      r = -tmp;
+      // cancel up to min(eta + 1, i, 6) bits of g
+      limit = ((int)eta + 1) > i ? i : ((int)eta + 1);
+      m = (UINT64_MAX >> (64 - limit)) & 63U;
+      w = (f * g * (f * f - 2)) & m;
+    } else {
+      // cancel up to min(eta + 1, i, 4) bits of g
+      limit = ((int)eta + 1) > i ? i : ((int)eta + 1);
+      m = (UINT64_MAX >> (64 - limit)) & 15U;
+      w = f + (((f + 1) & 4) << 1);
+      w = (-w * g) & m;
+    }
+    g += f * w;
+    q += u * w;
+    r += v * w;
+  }
+  t->u = (int64_t)u;
+  t->v = (int64_t)v;
+  t->q = (int64_t)q;
+  t->r = (int64_t)r;
+  return eta;
+}
+
+/*
+ * [d, e] = t * [d, e] / 2^62 mod p, a multiple of p is added first so the
+ * division is exact. d and e stay in range (-2 * p, p).
+ */
+static void ckb_blst_update_de_62(ckb_blst_signed62 *d, ckb_blst_signed62 *e,
+                                  const ckb_blst_trans2x2 *t) {
+  const int64_t u = t->u, v = t->v, q = t->q, r = t->r;
+  const int64_t *mod = ckb_blst_p_62.v;
+  int64_t md, me, sd, se, di, ei;
+  ckb_blst_int128 cd, ce;
+
+  // [md, me] start as [u, q] if d is negative, plus [v, r] if e is negative
+  sd = d->v[CKB_BLST_INV_LIMBS - 1] >> 63;
+  se = e->v[CKB_BLST_INV_LIMBS - 1] >> 63;
+  md = (u & sd) + (v & se);
+  me = (q & sd) + (r & se);
+  di = d->v[0];
+  ei = e->v[0];
+  cd = (ckb_blst_int128)u * di + (ckb_blst_int128)v * ei;
+  ce = (ckb_blst_int128)q * di + (ckb_blst_int128)r * ei;
+  // correct md, me so the low 62 bits of the sums become zero
+  md -= (ckb_blst_p_inv62 * (uint64_t)cd + md) & CKB_BLST_M62;
+  me -= (ckb_blst_p_inv62 * (uint64_t)ce + me) & CKB_BLST_M62;
+  cd += (ckb_blst_int128)mod[0] * md;
+  ce += (ckb_blst_int128)mod[0] * me;
+  cd >>= 62;
+  ce >>= 62;
+
+  for (int i = 1; i < CKB_BLST_INV_LIMBS; i++) {
+    di = d->v[i];
+    ei = e->v[i];
+    cd += (ckb_blst_int128)u * di + (ckb_blst_int128)v * ei +
+          (ckb_blst_int128)mod[i] * md;
+    ce += (ckb_blst_int128)q * di + (ckb_blst_int128)r * ei +
+          (ckb_blst_int128)mod[i] * me;
+    d->v[i - 1] = (int64_t)cd & CKB_BLST_M62;
+    cd >>= 62;
+    e->v[i - 1] = (int64_t)ce & CKB_BLST_M62;
+    ce >>= 62;
+  }
+  d->v[CKB_BLST_INV_LIMBS - 1] = (int64_t)cd;
+  e->v[CKB_BLST_INV_LIMBS - 1] = (int64_t)ce;
+}
+
+// [f, g] = t * [f, g] / 2^62 on the low len limbs, the division is exact
+static void ckb_blst_update_fg_62_var(int len, ckb_blst_signed62 *f,
+                                      ckb_blst_signed62 *g,
+                                      const ckb_blst_trans2x2 *t) {
+  const int64_t u = t->u, v = t->v, q = t->q, r = t->r;
+  int64_t fi, gi;
+  ckb_blst_int128 cf, cg;
+
+  fi = f->v[0];
+  gi = g->v[0];
+  cf = (ckb_blst_int128)u * fi + (ckb_blst_int128)v * gi;
+  cg = (ckb_blst_int128)q * fi + (ckb_blst_int128)r * gi;
+  cf >>= 62;
+  cg >>= 62;
+  for (int i = 1; i < len; i++) {
+    fi = f->v[i];
+    gi = g->v[i];
+    cf += (ckb_blst_int128)u * fi + (ckb_blst_int128)v * gi;
+    cg += (ckb_blst_int128)q * fi + (ckb_blst_int128)r * gi;
+    f->v[i - 1] = (int64_t)cf & CKB_BLST_M62;
+    cf >>= 62;
+    g->v[i - 1] = (int64_t)cg & CKB_BLST_M62;
+    cg >>= 62;
+  }
+  f->v[len - 1] = (int64_t)cf;
+  g->v[len - 1] = (int64_t)cg;
+}
+
+// carry the limbs of r, all but the top one end up in [0, 2^62)
+static void ckb_blst_carry_62(int64_t *r) {
+  for (int i = 0; i < CKB_BLST_INV_LIMBS - 1; i++) {
+    r[i + 1] += r[i] >> 62;
+    r[i] &= (int64_t)CKB_BLST_M62;
+  }
+}
+
+/*
+ * Bring r from range (-2 * p, p) to [0, p), negating it first when sign is
+ * negative.
+ */
+static void ckb_blst_normalize_62(ckb_blst_signed62 *r, int64_t sign) {
+  const int64_t *mod = ckb_blst_p_62.v;
+  int64_t cond_add, cond_negate;
+
+  cond_add = r->v[CKB_BLST_INV_LIMBS - 1] >> 63;
+  cond_negate = sign >> 63;
+  for (int i = 0; i < CKB_BLST_INV_LIMBS; i++) {
+    r->v[i] += mod[i] & cond_add;
+    r->v[i] = (r->v[i] ^ cond_negate) - cond_negate;
+  }
+  ckb_blst_carry_62(r->v);
+
+  cond_add = r->v[CKB_BLST_INV_LIMBS - 1] >> 63;
+  for (int i = 0; i < CKB_BLST_INV_LIMBS; i++) {
+    r->v[i] += mod[i] & cond_add;
+  }
+  ckb_blst_carry_62(r->v);
+}
+
+// x = x^-1 mod p for x in [0, p), 0 is mapped to 0
+static void ckb_blst_modinv_var(ckb_blst_signed62 *x) {
+  ckb_blst_signed62 d = {{0}};
+  ckb_blst_signed62 e = {{1}};
+  ckb_blst_signed62 f = ckb_blst_p_62;
+  ckb_blst_signed62 g = *x;
+  int len = CKB_BLST_INV_LIMBS;
+  int64_t eta = -1;
+  int64_t cond, fn, gn;
+
+  for (;;) {
+    ckb_blst_trans2x2 t;
+    eta = ckb_blst_divsteps_62_var(eta, f.v[0], g.v[0], &t);
+    ckb_blst_update_de_62(&d, &e, &t);
+    ckb_blst_update_fg_62_var(len, &f, &g, &t);
+    if (g.v[0] == 0) {
+      cond = 0;
+      for (int j = 1; j < len; j++) {
+        cond |= g.v[j];
+      }
+      if (cond == 0) {
+        break;
+      }
+    }
+    // drop the top limb once it is 0 or -1 in both f and g
+    fn = f.v[len - 1];
+    gn = g.v[len - 1];
+    cond = ((int64_t)len - 2) >> 63;
+    cond |= fn ^ (fn >> 63);
+    cond |= gn ^ (gn >> 63);
+    if (cond == 0) {
+      f.v[len - 2] |= (uint64_t)fn << 62;
+      g.v[len - 2] |= (uint64_t)gn << 62;
+      len--;
+    }
+  }
+  // f is +/-1 now, and d is +/- the inverse
+  ckb_blst_normalize_62(&d, f.v[len - 1]);
+  *x = d;
+}
+
+/*
+ * out = inp^-1 in Montgomery form, out may alias inp. The limbs are those of
+ * vec384, reciprocal_fp of blst calls this in the verify-only build.
+ */
+void ckb_blst_reciprocal_fp_var(uint64_t out[6], const uint64_t inp[6]) {
+  ckb_blst_signed62 s;
+  blst_fp r;
+
+  for (int i = 0; i < CKB_BLST_INV_LIMBS; i++) {
+    // bit 62 * i is in limb 62 * i / 64
+    int limb = 62 * i / 64, shift = 62 * i % 64;
+    uint64_t lo = inp[limb] >> shift;
+    if (shift > 2 && limb + 1 < 6) {
+      lo |= inp[limb + 1] << (64 - shift);
+    }
+    s.v[i] = (int64_t)(lo & CKB_BLST_M62);
+  }
+
+  ckb_blst_modinv_var(&s);
+
+  for (int i = 0; i < 6; i++) {
+    // bit 64 * i is in limb 64 * i / 62, at most 10 bits in, so two limbs
+    // always cover it
+    int limb = 64 * i / 62, shift = 64 * i % 62;
+    r.l[i] = (uint64_t)s.v[limb] >> shift |
+             (uint64_t)s.v[limb + 1] << (62 - shift);
+  }
+  blst_fp_mul(&r, &r, &ckb_blst_r3);
+  for (int i = 0; i < 6; i++) {
+    out[i] = r.l[i];
+  }
+}
@@ -0,0 +1,670 @@
+#!/usr/bin/env python3
+"""Translate blst's x86_64 perlasm output to RISC-V assembly for CKB-VM.
+
+blst/blst_mul_mont_384.riscv.S and blst/blst_mul_mont_384x.riscv.S are
+generated by this script from deps/blst/src/asm/mulq_mont_384-x86_64.pl, see
+the blst-translate target of the Makefile:
+
+    perl deps/blst/src/asm/mulq_mont_384-x86_64.pl elf > mulq_mont_384.s
+    python3 blst/x86_to_riscv.py --promote-stack-slots \
+        --entry mul_mont_384 mulq_mont_384.s
+
+The entry function and every function it calls, in order of first call, are
+translated instruction by instruction. Each x86 instruction is kept as a
+comment above its RISC-V sequence. Symbols get a blst_ prefix, so
+mul_mont_384 becomes blst_mul_mont_384 and __mulq_384 becomes
+__blst_mulq_384.
+
+The x86 machine state is mapped to RISC-V as follows:
+
+* the 16 general purpose registers to fixed RISC-V registers, see REGS
+* the carry flag to t2, other flags are not modelled
+* t6 and a7 are scratch registers for memory operands and borrows
+* %rsp to sp, with the return address pushed on the stack on function entry
+  and popped by ret, so stack offsets stay the same as in the x86 code
+
+A carry out of "adcq $0, %reg" is only computed when a later instruction
+reads it, blst uses it to fold a carry into the high half of a product, which
+does not overflow. Likewise the carry flag cleared by logical instructions is
+only materialized when it is read.
+
+With --promote-stack-slots, 8-byte stack slots that are only ever loaded and
+stored as a whole, and never addressed through a pointer, are kept in
+registers unused by the mapping: t3-t5 first, then s6-s11, which are saved
+and restored by the entry function. The x86 code spills arguments such as n0
+and the result pointer to the stack only because it runs out of registers.
+A slot written but never read is dropped.
+"""
+
+import argparse
+import re
+import sys
+
+REGS = {
+    'rax': 'a6',
+    'rbx': 's1',
+    'rcx': 'a3',
+    'rdx': 'a2',
+    'rsi': 'a1',
+    'rdi': 'a0',
+    'rbp': 'fp',
+    'rsp': 'sp',
+    'r8': 'a4',
+    'r9': 'a5',
+    'r10': 't0',
+    'r11': 't1',
+    'r12': 's2',
+    'r13': 's3',
+    'r14': 's4',
+    'r15': 's5',
+}
+CARRY = 't2'
+SCRATCH = 't6'
+SCRATCH2 = 'a7'
+CALLEE_SAVED_X86 = ('%rbx', '%rbp', '%rsp', '%r12', '%r13', '%r14', '%r15')
+CALLER_SAVED_FREE = ['t3', 't4', 't5']
+CALLEE_SAVED_FREE = ['s6', 's7', 's8', 's9', 's10', 's11']
+
+# directives kept as comments, all others are dropped
+SPECIAL_DIRECTIVES = ('.globl', '.byte')
+ENDBR64 = ['0xf3', '0x0f', '0x1e', '0xfa']
+REPZ_RET = ['0xf3', '0xc3']
+
+# which instructions read and write the carry flag
+FLAG_READERS = ('adcq', 'sbbq', 'cmovcq', 'cmovncq')
+FLAG_WRITERS = ('addq', 'subq', 'adcq', 'sbbq', 'negq', 'andq', 'orq', 'xorq',
+                'cmpq')
+
+
+class TranslateError(Exception):
+    pass
+
+
+def rename(symbol):
+    m = re.match(r'^(_*)(\w+)$', symbol)
+    if not m:
+        return symbol
+    return m.group(1) + 'blst_' + m.group(2)
+
+
+class Insn(object):
+
+    def __init__(self, mnemonic, operands, line_no):
+        self.mnemonic = mnemonic
+        self.operands = operands
+        self.line_no = line_no
+
+    def __repr__(self):
+        return '%s %s' % (self.mnemonic, ', '.join(self.operands))
+
+
+def split_operands(text):
+    ops = []
+    depth = 0
+    cur = ''
+    for c in text:
+        if c == '(':
+            depth += 1
+        elif c == ')':
+            depth -= 1
+        if c == ',' and depth == 0:
+            ops.append(cur.strip())
+            cur = ''
+        else:
+            cur += c
+    if cur.strip():
+        ops.append(cur.strip())
+    return ops
+
+
+def parse(text):
+    """Splits the x86 source into functions: name -> list of Insn.
+
+    Directives before a label, such as .globl, belong to the function of that
+    label.
+    """
+    functions = {}
+    order = []
+    pending = []
+    current = None
+    for line_no, line in enumerate(text.split('\n'), 1):
+        line = line.split('#')[0].strip()
+        if not line:
+            continue
+        m = re.match(r'^([\w.$]+):(.*)$', line)
+        if m:
+            name = m.group(1)
+            if name.startswith('.L'):
+                # branches are not supported, see translate_function
+                if current is not None:
+                    current.append(Insn(name + ':', [], line_no))
+                continue
+            current = functions.setdefault(name, [])
+            order.append(name)
+            current.extend(pending)
+            pending = []
+            current.append(Insn(name + ':', [], line_no))
+            line = m.group(2).strip()
+            if not line:
+                continue
+        parts = line.split(None, 1)
+        insn = Insn(parts[0], split_operands(parts[1]) if len(parts) > 1 else [],
+                    line_no)
+        if insn.mnemonic == '.size' and current is not None:
+            current = None
+            continue
+        if current is None:
+            pending.append(insn)
+        else:
+            current.append(insn)
+    return functions, order
+
+
+def call_targets(insns):
+    return [i.operands[0] for i in insns if i.mnemonic == 'call']
+
+
+def select(functions, entry):
+    """The entry function and its callees, in order of first call."""
+    selected = []
+
+    def visit(name):
+        if name in selected:
+            return
+        if name not in functions:
+            raise TranslateError('function %s not found' % name)
+        selected.append(name)
+        for target in call_targets(functions[name]):
+            visit(target)
+
+    visit(entry)
+    return selected
+
+
+def is_mem(op):
+    return '(' in op
+
+
+def parse_mem(op):
+    m = re.match(r'^([-+*\w]*)\(%(\w+)\)$', op)
+    if not m:
+        raise TranslateError('unsupported memory operand %s' % op)
+    offset = m.group(1)
+    if offset and not re.match(r'^[-+*0-9]+$', offset):
+        raise TranslateError('unsupported offset %s' % offset)
+    return (eval(offset) if offset else 0), m.group(2)
+
+
+def reg(op):
+    if not op.startswith('%') or op[1:] not in REGS:
+        raise TranslateError('unsupported register %s' % op)
+    return REGS[op[1:]]
+
+
+def imm(op):
+    if not op.startswith('$'):
+        raise TranslateError('expected an immediate, got %s' % op)
+    return int(eval(op[1:]))
+
+
+class StackAnalysis(object):
+    """Finds the stack slots that can live in registers.
+
+    Slots are identified by their address relative to the stack pointer at
+    entry of the entry function, so a slot written by a function and read by
+    its callee at a different %rsp offset is the same slot.
+    """
+
+    def __init__(self, functions, selected):
+        self.functions = functions
+        self.selected = selected
+        # per instruction id: slot address of its %rsp memory operand
+        self.slot_of = {}
+        self.reads = {}
+        self.writes = {}
+        self.rejected = set()
+        self.consistent = True
+        self.entry_depth = {selected[0]: 0}
+        for name in selected:
+            self.walk(name)
+
+    def reject_from(self, address):
+        # every slot at or above an escaped address, up to the return address
+        for a in range(address, 8, 8):
+            self.rejected.add(a)
+
+    def walk(self, name):
+        depth = self.entry_depth.get(name)
+        if depth is None:
+            self.consistent = False
+            return
+        derived = {}
+        for insn in self.functions[name]:
+            mn, ops = insn.mnemonic, insn.operands
+            if mn == 'pushq':
+                depth -= 8
+                self.rejected.add(depth)
+                continue
+            if mn == 'popq':
+                self.rejected.add(depth)
+                depth += 8
+                continue
+            if mn in ('subq', 'addq') and ops[-1] == '%rsp':
+                if not ops[0].startswith('$'):
+                    self.consistent = False
+                    return
+                depth += -imm(ops[0]) if mn == 'subq' else imm(ops[0])
+                continue
+            if mn == 'leaq':
+                offset, base = parse_mem(ops[0])
+                if base == 'rsp' and ops[1] == '%rsp':
+                    depth += offset
+                elif base == 'rsp':
+                    derived[ops[1]] = depth + offset
+                    self.reject_from(depth + offset)
+                elif '%' + base in derived and ops[1] == '%rsp':
+                    depth = derived['%' + base] + offset
+                elif ops[1] in derived:
+                    del derived[ops[1]]
+                continue
+            if mn == 'call':
+                target = ops[0]
+                call_depth = depth - 8
+                if self.entry_depth.setdefault(target, call_depth) != call_depth:
+                    self.consistent = False
+                continue
+            for k, op in enumerate(ops):
+                if not is_mem(op):
+                    continue
+                offset, base = parse_mem(op)
+                if base != 'rsp':
+                    if '%' + base in derived:
+                        self.reject_from(derived['%' + base] + offset)
+                    continue
+                address = depth + offset
+                self.slot_of[id(insn)] = address
+                is_dest = k == len(ops) - 1 and len(ops) > 1
+                if mn == 'movq' and is_dest and ops[0].startswith('%'):
+                    self.writes.setdefault(address, []).append(insn)
+                elif mn in ('movq', 'imulq', 'mulq', 'addq', 'adcq', 'subq',
+                            'sbbq', 'andq', 'orq', 'xorq') and not is_dest:
+                    self.reads.setdefault(address, []).append(insn)
+                else:
+                    self.rejected.add(address)
+            for op in ops[1:]:
+                if op in derived:
+                    del derived[op]
+
+    def allocate(self):
+        if not self.consistent:
+            return {}, []
+        # a slot read before any write holds an argument passed on the stack
+        candidates = [
+            a for a in self.writes if a < 0 and a not in self.rejected
+        ]
+        candidates.sort(key=lambda a: (-(len(self.reads.get(a, [])) +
+                                         len(self.writes.get(a, []))), a))
+        allocation = {}
+        saved = []
+        free = list(CALLER_SAVED_FREE)
+        callee_saved = list(CALLEE_SAVED_FREE)
+        for address in candidates:
+            uses = len(self.reads.get(address, [])) + len(
+                self.writes.get(address, []))
+            if address not in self.reads:
+                allocation[address] = None
+            elif free:
+                allocation[address] = free.pop(0)
+            # a callee saved register costs a store and a load itself
+            elif callee_saved and uses > 2:
+                allocation[address] = callee_saved.pop(0)
+                saved.append(allocation[address])
+        return allocation, saved
+
+
+class Translator(object):
+
+    def __init__(self, functions, selected, promote):
+        self.functions = functions
+        self.selected = selected
+        self.out = ['.text']
+        self.label_count = 0
+        self.allocation = {}
+        self.saved = []
+        self.slot_of = {}
+        if promote:
+            analysis = StackAnalysis(functions, selected)
+            self.allocation, self.saved = analysis.allocate()
+            self.slot_of = analysis.slot_of
+
+    def emit(self, line):
+        self.out.append(line)
+
+    def op3(self, mnemonic, *operands):
+        self.emit('%s    %s' % (mnemonic, ', '.join(operands)))
+
+    def comment(self, insn):
+        ops = [rename(o) if insn.mnemonic in ('call', '.globl') else o
+               for o in insn.operands]
+        self.emit('# %s    %s' % (insn.mnemonic, ', '.join(ops)))
+
+    def promoted(self, insn):
+        address = self.slot_of.get(id(insn))
+        if address is None or address not in self.allocation:
+            return False, None
+        return True, self.allocation[address]
+
+    def source(self, insn, op):
+        """The register holding a source operand, loading memory to t6."""
+        if is_mem(op):
+            promoted, register = self.promoted(insn)
+            if promoted:
+                self.op3('add', SCRATCH, register, 'zero')
+                return SCRATCH
+            offset, base = parse_mem(op)
+            self.op3('ld', SCRATCH, '%d(%s)' % (offset, REGS[base]))
+            return SCRATCH
+        if op.startswith('$'):
+            value = imm(op)
+            if value == 0:
+                return 'zero'
+            self.op3('li', SCRATCH, str(value))
+            return SCRATCH
+        return reg(op)
+
+    def carry_read_next(self, insns, index):
+        for insn in insns[index + 1:]:
+            if insn.mnemonic in FLAG_READERS:
+                return True
+            if insn.mnemonic in FLAG_WRITERS or insn.mnemonic in (
+                    'call', 'ret', '.byte') or insn.mnemonic.endswith(':'):
+                return False
+        return False
+
+    def translate_function(self, name):
+        insns = self.functions[name]
+        is_entry = name == self.selected[0]
+        i = 0
+        while i < len(insns):
+            insn = insns[i]
+            mn, ops = insn.mnemonic, insn.operands
+            if mn.startswith('.L'):
+                raise TranslateError('line %d: local label %s in %s, branches'
+                                     ' are not supported' %
+                                     (insn.line_no, mn, name))
+            if mn.endswith(':'):
+                label = rename(mn[:-1])
+                self.emit('# %s:    ' % label)
+                self.emit('.globl    %s' % label)
+                self.emit('.align    4')
+                self.emit('%s:' % label)
+                self.emit('addi sp, sp, -8')
+                self.emit('sd ra, 0(sp)')
+                if is_entry and self.saved:
+                    self.emit('addi    sp, sp, -%d' % (8 * len(self.saved)))
+                    for k, r in enumerate(self.saved):
+                        self.op3('sd', r, '%d(sp)' % (8 * k))
+            elif mn == 'pushq':
+                # the pushes of a prologue become one stack adjustment
+                self.comment(insn)
+                pushed = []
+                while i < len(insns) and (insns[i].mnemonic == 'pushq' or
+                                          insns[i].mnemonic.startswith('.cfi')):
+                    if insns[i].mnemonic == 'pushq':
+                        pushed.append(insns[i].operands[0])
+                    i += 1
+                for op in pushed:
+                    self.emit('# pushq %s' % op)
+                size = 8 * len(pushed)
+                self.op3('addi', 'sp', 'sp', '-%d' % size)
+                for k, op in enumerate(pushed):
+                    self.emit('sd %s, %d(sp)' % (reg(op), size - 8 - 8 * k))
+                if (i < len(insns) and insns[i].mnemonic == 'subq' and
+                        insns[i].operands[1] == '%rsp'):
+                    self.op3('addi', 'sp', 'sp',
+                             '-%d' % imm(insns[i].operands[0]))
+                    i += 1
+                continue
+            elif mn.startswith('.'):
+                self.directive(insn, is_entry)
+            else:
+                self.comment(insn)
+                self.instruction(insns, i, is_entry)
+            i += 1
+
+    def directive(self, insn, is_entry):
+        mn, ops = insn.mnemonic, insn.operands
+        if mn == '.byte' and ops == REPZ_RET:
+            self.comment(insn)
+            self.ret(is_entry)
+        elif mn in SPECIAL_DIRECTIVES:
+            self.comment(insn)
+            tokens = [mn] + [rename(o) if mn == '.globl' else o for o in ops]
+            self.emit('# special directive: %s' % tokens)
+            if mn == '.byte' and ops != ENDBR64:
+                raise TranslateError('line %d: unsupported .byte %s' %
+                                     (insn.line_no, ','.join(ops)))
+
+    def ret(self, is_entry):
+        if is_entry and self.saved:
+            for k, r in enumerate(self.saved):
+                self.op3('ld', r, '%d(sp)' % (8 * k))
+            self.emit('addi    sp, sp, %d' % (8 * len(self.saved)))
+        self.emit('ld ra, 0(sp)')
+        self.emit('addi sp, sp, 8')
+        self.emit('ret    ')
+
+    def dead_after(self, insns, index, op, seen=()):
+        """Whether the x86 register op is written before it is read again.
+
+        Calls are followed into the callee, and past the ret of a callee
+        every call site is checked. Only the callee saved registers are live
+        past the ret of the entry function.
+        """
+        live = self.scan(insns, index + 1, op)
+        if live is not None:
+            return not live
+        name = [n for n in self.selected if self.functions[n] is insns][0]
+        if name == self.selected[0]:
+            return op not in CALLEE_SAVED_X86
+        if name in seen:
+            return False
+        for caller in self.selected:
+            body = self.functions[caller]
+            for k, insn in enumerate(body):
+                if insn.mnemonic == 'call' and insn.operands[0] == name:
+                    if not self.dead_after(body, k, op, seen + (name,)):
+                        return False
+        return True
+
+    def scan(self, insns, start, op):
+        """True if op is read, False if written, None if neither until ret."""
+        for insn in insns[start:]:
+            mn, ops = insn.mnemonic, insn.operands
+            if mn == 'call':
+                live = self.scan(self.functions[ops[0]], 0, op)
+                if live is not None:
+                    return live
+                continue
+            if mn == 'ret' or (mn == '.byte' and ops == REPZ_RET):
+                return None
+            if mn == 'mulq':
+                if op in ops[0] or op == '%rax':
+                    return True
+                if op == '%rdx':
+                    return False
+                continue
+            if mn == 'sbbq' and ops == [op, op]:
+                return False
+            if mn == 'pushq':
+                if ops[0] == op:
+                    return True
+                continue
+            if any(op in o for o in ops[:-1]) or (ops and op in ops[-1] and
+                                                  (is_mem(ops[-1]) or
+                                                   mn not in ('movq', 'leaq'))):
+                return True
+            if ops and ops[-1] == op:
+                return False
+        return None
+
+    def new_label(self):
+        self.label_count += 1
+        return '.LABLE%d' % self.label_count
+
+    def instruction(self, insns, index, is_entry):
+        insn = insns[index]
+        mn, ops = insn.mnemonic, insn.operands
+        fail = TranslateError('line %d: unsupported instruction %r' %
+                              (insn.line_no, insn))
+        if mn == 'movq':
+            src, dst = ops
+            promoted, register = self.promoted(insn)
+            if promoted:
+                if is_mem(dst):
+                    if register is not None:
+                        self.op3('add', register, reg(src), 'zero')
+                else:
+                    self.op3('add', reg(dst), register, 'zero')
+            elif is_mem(dst):
+                offset, base = parse_mem(dst)
+                self.op3('sd', reg(src), '%d(%s)' % (offset, REGS[base]))
+            elif is_mem(src):
+                offset, base = parse_mem(src)
+                self.op3('ld', reg(dst), '%d(%s)' % (offset, REGS[base]))
+            elif src.startswith('$'):
+                self.op3('li', reg(dst), str(imm(src)))
+            else:
+                self.op3('add', reg(dst), reg(src), 'zero')
+        elif mn == 'leaq':
+            offset, base = parse_mem(ops[0])
+            self.op3('addi', reg(ops[1]), REGS[base], str(offset))
+        elif mn == 'mulq':
+            src = self.source(insn, ops[0])
+            if src == REGS['rdx']:
+                self.op3('add', SCRATCH, src, 'zero')
+                src = SCRATCH
+            self.op3('mulhu', REGS['rdx'], src, REGS['rax'])
+            self.op3('mul', REGS['rax'], src, REGS['rax'])
+        elif mn == 'imulq':
+            if len(ops) != 2:
+                raise fail
+            promoted, register = self.promoted(insn)
+            src = register if promoted else self.source(insn, ops[0])
+            self.op3('mul', reg(ops[1]), reg(ops[1]), src)
+        elif mn in ('subq', 'addq') and ops[1] == '%rsp':
+            value = imm(ops[0])
+            self.op3('addi', 'sp', 'sp', str(-value if mn == 'subq' else value))
+        elif mn == 'addq':
+            dst = reg(ops[1])
+            if is_mem(ops[0]):
+                src = self.source(insn, ops[0])
+                self.op3('add', dst, src, dst)
+                self.op3('sltu', CARRY, dst, src)
+            else:
+                src = self.source(insn, ops[0])
+                if src == dst:
+                    self.op3('srli', CARRY, dst, '63')
+                    self.op3('add', dst, dst, dst)
+                else:
+                    self.op3('add', dst, dst, src)
+                    self.op3('sltu', CARRY, dst, src)
+        elif mn == 'adcq':
+            dst = reg(ops[1])
+            if ops[0] == '$0':
+                self.op3('add', dst, CARRY, dst)
+                if self.carry_read_next(insns, index):
+                    self.op3('sltu', CARRY, dst, CARRY)
+                return
+            src = self.source(insn, ops[0])
+            if src == dst:
+                self.op3('srli', SCRATCH2, dst, '63')
+                self.op3('add', dst, dst, dst)
+                self.op3('add', dst, dst, CARRY)
+                self.op3('add', CARRY, SCRATCH2, 'zero')
+                return
+            # the carry of the second addition goes to the source register
+            # when the x86 code overwrites it next, as after every mulq
+            tmp = src if (not is_mem(ops[0]) and
+                          self.dead_after(insns, index, ops[0])) else SCRATCH
+            self.op3('add', dst, dst, CARRY)
+            self.op3('sltu', CARRY, dst, CARRY)
+            self.op3('add', dst, dst, src)
+            self.op3('sltu', tmp, dst, src)
+            self.op3('or', CARRY, CARRY, tmp)
+        elif mn == 'subq':
+            dst = reg(ops[1])
+            src = self.source(insn, ops[0])
+            self.op3('sltu', CARRY, dst, src)
+            self.op3('sub', dst, dst, src)
+        elif mn == 'sbbq':
+            dst = reg(ops[1])
+            if ops[0] == ops[1]:
+                self.op3('sub', dst, 'zero', CARRY)
+                return
+            if ops[0] == '$0':
+                self.op3('sltu', SCRATCH2, dst, CARRY)
+                self.op3('sub', dst, dst, CARRY)
+                self.op3('add', CARRY, SCRATCH2, 'zero')
+                return
+            src = self.source(insn, ops[0])
+            self.op3('sub', CARRY, dst, CARRY)
+            self.op3('sltu', SCRATCH2, dst, CARRY)
+            self.op3('sub', dst, CARRY, src)
+            self.op3('sltu', SCRATCH, CARRY, dst)
+            self.op3('or', CARRY, SCRATCH, SCRATCH2)
+        elif mn in ('andq', 'orq', 'xorq'):
+            dst = reg(ops[1])
+            src = self.source(insn, ops[0])
+            self.op3(mn[:-1], dst, dst, src)
+            if self.carry_read_next(insns, index):
+                self.op3('add', CARRY, 'zero', 'zero')
+        elif mn in ('cmovcq', 'cmovncq'):
+            label = self.new_label()
+            self.op3('beq' if mn == 'cmovcq' else 'bne', CARRY, 'zero', label)
+            self.op3('add', reg(ops[1]), self.source(insn, ops[0]), 'zero')
+            self.emit('%s:' % label)
+        elif mn == 'call':
+            self.op3('call', rename(ops[0]))
+        elif mn == 'popq':
+            self.op3('ld', reg(ops[0]), '0(sp)')
+            self.op3('addi', 'sp', 'sp', '8')
+        elif mn == 'ret':
+            self.ret(is_entry)
+        else:
+            raise fail
+
+    def translate(self):
+        for name in self.selected:
+            self.translate_function(name)
+        return '\n'.join(self.out) + '\n'
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('input', help='x86_64 assembly from blst perlasm')
+    parser.add_argument('--entry', required=True,
+                        help='function to translate, without blst_ prefix')
+    parser.add_argument('--promote-stack-slots', action='store_true',
+                        help='keep spilled stack slots in free registers')
+    parser.add_argument('-o', '--output', help='output file, default stdout')
+    args = parser.parse_args()
+    with open(args.input) as f:
+        functions, _ = parse(f.read())
+    try:
+        selected = select(functions, args.entry)
+        text = Translator(functions, selected,
+                          args.promote_stack_slots).translate()
+    except TranslateError as e:
+        sys.stderr.write('x86_to_riscv: %s\n' % e)
+        return 1
+    if args.output:
+        with open(args.output, 'w') as f:
+            f.write(text)
+    else:
+        sys.stdout.write(text)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -5,6 +5,7 @@
  */
 #include "ckb_dlfcn.h"
 #include "ckb_syscalls.h"
+#include "cycle_trace.h"
 #include "or.h"
 
 #define CODE_SIZE (256 * 1024)
@@ -18,6 +19,7 @@
 #define ERROR_ONE_FAILURE -106
 
 int main() {
+  CKB_TRACE_SCOPE("and");
   unsigned char script[SCRIPT_SIZE];
   uint64_t len = SCRIPT_SIZE;
   int ret = ckb_load_script(script, &len, 0);
@@ -47,7 +49,7 @@ int main() {
   }
   mol_seg_t witness_seg;
   witness_seg.ptr = witness;
-  witness_seg.size = len;
+  witness_seg.size = witness_len;
   if (MolReader_WitnessArgs_verify(&witness_seg, false) != MOL_OK) {
     return ERROR_ENCODING;
   }
@@ -63,6 +65,7 @@ int main() {
        MolReader_OrScripts_length(&or_witnesses_seg))) {
     return ERROR_ENCODING;
   }
+  CKB_TRACE("molecule");
   uint8_t code_buffer[CODE_SIZE] __attribute__((aligned(RISCV_PGSIZE)));
   size_t used_size = 0;
   for (size_t i = 0; i < MolReader_OrScripts_length(&or_scripts_seg); i++) {
@@ -95,7 +98,9 @@ int main() {
     if (verify == NULL) {
       return ERROR_DYNAMIC_LOADING;
     }
+    CKB_TRACE("dlopen");
     ret = verify(&script, &witness);
+    CKB_TRACE("verify");
     if (ret != CKB_SUCCESS) {
       return ERROR_ONE_FAILURE;
     }
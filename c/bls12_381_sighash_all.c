@@ -15,7 +15,10 @@ int ckb_exit(signed char);
 #include "ckb_consts.h"
 #include "ckb_syscalls.h"
 #include "rc_lock_mol2.h"
+#include "sighash_all_helper.h"
+#include "smt_proof_helper.h"
 #include "blst.h"
+#include "bls12_381_data_info.h"
 
 // clang-format on
 
@@ -43,16 +46,43 @@ int ckb_exit(signed char);
 
 #define CKB_IDENTITY_LEN 21
 #define RECID_INDEX 64
-#define ONE_BATCH_SIZE 32768
 #define BLST_PUBKEY_SIZE 48
 #define MAX_WITNESS_SIZE 32768
 #define BLST_SIGNAUTRE_SIZE (48 + 96)
+// IdentityFlagsBls12381 with serialized affine pubkey and signature, instead
+// of compressed ones
+#define BLST_AFFINE_PUBKEY_SIZE 96
+#define BLST_AFFINE_SIGNATURE_SIZE (96 + 192)
 #define BLAKE2B_BLOCK_SIZE 32
 #define BLAKE160_SIZE 20
+// IdentityFlagsBls12381Aggregate: up to MAX_BLS_SIGNERS pairs of pubkey and
+// signature
+#define MAX_BLS_SIGNERS 16
+#define BLST_AGGREGATE_SIGNATURE_MAX_SIZE \
+  (BLST_SIGNAUTRE_SIZE * MAX_BLS_SIGNERS)
+// IdentityFlagsBls12381Multisig: up to MAX_BLS_MULTISIG_KEYS pubkeys, the
+// largest witness, 1638 bytes, still fits BLST_AGGREGATE_SIGNATURE_MAX_SIZE
+#define MAX_BLS_MULTISIG_KEYS 32
+#define BLST_AGGREGATE_SIG_SIZE 96
+// IdentityFlagsBls12381MinSig: G2 pubkey and G1 signature
+#define BLST_MIN_SIG_PUBKEY_SIZE 96
+#define BLST_MIN_SIG_SIGNATURE_SIZE (96 + 48)
 
 const static uint8_t g_dst_label[] =
     "BLS_SIG_BLS12381G2_XMD:SHA-256_SSWU_RO_NUL_";
 const static size_t g_dst_label_len = 43;
+// message augmentation, every signer signs its pubkey followed by the message
+const static uint8_t g_dst_label_aug[] =
+    "BLS_SIG_BLS12381G2_XMD:SHA-256_SSWU_RO_AUG_";
+const static size_t g_dst_label_aug_len = 43;
+// proof of possession, the pubkeys of a multisig are registered with one
+const static uint8_t g_dst_label_pop[] =
+    "BLS_SIG_BLS12381G2_XMD:SHA-256_SSWU_RO_POP_";
+const static size_t g_dst_label_pop_len = 43;
+// min-sig, signatures are hashed to G1
+const static uint8_t g_dst_label_g1[] =
+    "BLS_SIG_BLS12381G1_XMD:SHA-256_SSWU_RO_NUL_";
+const static size_t g_dst_label_g1_len = 43;
 
 enum CkbIdentityErrorCode {
   ERROR_IDENTITY_ARGUMENTS_LEN = -1,
@@ -68,6 +98,8 @@ enum CkbIdentityErrorCode {
   ERROR_IDENTITY_LOCK_SCRIPT_HASH_NOT_FOUND = 70,
   ERROR_INVALID_MOL_FORMAT,
   ERROR_BLST_VERIFY_FAILED,
+  ERROR_BLST_INVALID_THRESHOLD,
+  ERROR_BLST_THRESHOLD_NOT_REACHED,
 };
 
 typedef struct CkbIdentityType {
@@ -80,21 +112,26 @@ enum IdentityFlagsType {
   IdentityFlagsPubkeyHash = 0,
   IdentityFlagsOwnerLock = 1,
   IdentityFlagsBls12381 = 15,
+  // several signers, each over its own augmented message, see
+  // blst_aggregate_verify
+  IdentityFlagsBls12381Aggregate = 16,
+  // M of N signers of the same message, see blst_multisig_verify
+  IdentityFlagsBls12381Multisig = 17,
+  // 96 bytes G2 pubkey and 48 bytes G1 signature, see blst_min_sig_verify
+  IdentityFlagsBls12381MinSig = 18,
 };
 
-static BLST_ERROR blst_verify(const uint8_t *sig, const uint8_t *pk,
+static BLST_ERROR blst_verify(const blst_p2_affine *sig_p2_affine,
+                              const blst_p1_affine *pk_p1_affine,
                               const uint8_t *msg, size_t msg_len) {
   BLST_ERROR err;
-  blst_p1_affine pk_p1_affine;
-  blst_p1_uncompress(&pk_p1_affine, pk);
-  blst_p2_affine sig_p2_affine;
-  blst_p2_uncompress(&sig_p2_affine, sig);
 
 #if 1
   // using one-shot
+  // both points are checked to be in their subgroups
   printf("using one-shot\n");
   err =
-      blst_core_verify_pk_in_g1(&pk_p1_affine, &sig_p2_affine, true, msg,
+      blst_core_verify_pk_in_g1(pk_p1_affine, sig_p2_affine, true, msg,
                                 msg_len, g_dst_label, g_dst_label_len, NULL, 0);
   CHECK(err);
 #else
@@ -105,12 +142,12 @@ static BLST_ERROR blst_verify(const uint8_t *sig, const uint8_t *pk,
   printf("using pairing interface\n");
   uint8_t ctx_buff[blst_pairing_sizeof()];
 
-  bool in_g1 = blst_p1_affine_in_g1(&pk_p1_affine);
+  bool in_g1 = blst_p1_affine_in_g1(pk_p1_affine);
   CHECK2(in_g1, -1);
 
   blst_pairing *ctx = (blst_pairing *)ctx_buff;
   blst_pairing_init(ctx, true, g_dst_label, g_dst_label_len);
-  err = blst_pairing_aggregate_pk_in_g1(ctx, &pk_p1_affine, &sig_p2_affine, msg,
+  err = blst_pairing_aggregate_pk_in_g1(ctx, pk_p1_affine, sig_p2_affine, msg,
                                         msg_len, NULL, 0);
   CHECK(err);
   blst_pairing_commit(ctx);
@@ -123,167 +160,413 @@ exit:
   return err;
 }
 
-static int extract_witness_lock(uint8_t *witness, uint64_t len,
-                                mol_seg_t *lock_bytes_seg) {
-  if (len < 20) {
-    return ERROR_IDENTITY_ENCODING;
-  }
-  uint32_t lock_length = *((uint32_t *)(&witness[16]));
-  if (len < 20 + lock_length) {
-    return ERROR_IDENTITY_ENCODING;
-  } else {
-    lock_bytes_seg->ptr = &witness[20];
-    lock_bytes_seg->size = lock_length;
+// Verifies count pairs of 48 bytes pubkey and 96 bytes signature, where every
+// signature is over the message augmented by its pubkey. The messages are
+// distinct this way, so the pairs can be accumulated in one pairing context
+// with a single final exponentiation, instead of one per signature.
+static BLST_ERROR blst_aggregate_verify(const uint8_t *pairs, size_t count,
+                                        const uint8_t *msg, size_t msg_len) {
+  BLST_ERROR err = BLST_SUCCESS;
+  uint8_t ctx_buff[blst_pairing_sizeof()];
+  blst_pairing *ctx = (blst_pairing *)ctx_buff;
+  blst_pairing_init(ctx, true, g_dst_label_aug, g_dst_label_aug_len);
+
+  for (size_t i = 0; i < count; i++) {
+    const uint8_t *pk = pairs + i * BLST_SIGNAUTRE_SIZE;
+    const uint8_t *sig = pk + BLST_PUBKEY_SIZE;
+    blst_p1_affine pk_p1_affine;
+    blst_p2_affine sig_p2_affine;
+    err = blst_p1_uncompress(&pk_p1_affine, pk);
+    CHECK(err);
+    err = blst_p2_uncompress(&sig_p2_affine, sig);
+    CHECK(err);
+    // pubkey must be checked
+    // signature will be checked internally later.
+    CHECK2(blst_p1_affine_in_g1(&pk_p1_affine), BLST_POINT_NOT_IN_GROUP);
+    err = blst_pairing_aggregate_pk_in_g1(ctx, &pk_p1_affine, &sig_p2_affine,
+                                          msg, msg_len, pk, BLST_PUBKEY_SIZE);
+    CHECK(err);
   }
-  return CKB_SUCCESS;
+  blst_pairing_commit(ctx);
+  CHECK2(blst_pairing_finalverify(ctx, NULL), BLST_VERIFY_FAIL);
+
+exit:
+  return err;
 }
 
-int load_and_hash_witness(blake2b_state *ctx, size_t start, size_t index,
-                          size_t source, bool hash_length) {
-  uint8_t temp[ONE_BATCH_SIZE];
-  uint64_t len = ONE_BATCH_SIZE;
-  int ret = ckb_load_witness(temp, &len, start, index, source);
-  if (ret != CKB_SUCCESS) {
-    return ret;
+// Verifies one aggregated signature of the same message by the pubkeys
+// selected in bitmap. The pubkeys are added up first, so there is one pairing
+// check whatever the number of signers. Every selected pubkey is checked to be
+// in G1 and not the identity, the sum is in G1 then. Rogue key attacks are not
+// detected here, see verify_bls12_381_multisig_sighash_all.
+static BLST_ERROR blst_multisig_verify(const uint8_t *pubkeys, size_t count,
+                                       const uint8_t *bitmap,
+                                       const uint8_t *sig, const uint8_t *msg,
+                                       size_t msg_len) {
+  BLST_ERROR err = BLST_SUCCESS;
+  blst_p1 pk_sum;
+  bool empty = true;
+  for (size_t i = 0; i < count; i++) {
+    if ((bitmap[i / 8] & (1 << (i % 8))) == 0) {
+      continue;
+    }
+    blst_p1_affine pk_p1_affine;
+    err = blst_p1_uncompress(&pk_p1_affine, pubkeys + i * BLST_PUBKEY_SIZE);
+    CHECK(err);
+    CHECK2(!blst_p1_affine_is_inf(&pk_p1_affine), BLST_PK_IS_INFINITY);
+    CHECK2(blst_p1_affine_in_g1(&pk_p1_affine), BLST_POINT_NOT_IN_GROUP);
+    if (empty) {
+      blst_p1_from_affine(&pk_sum, &pk_p1_affine);
+      empty = false;
+    } else {
+      blst_p1_add_or_double_affine(&pk_sum, &pk_sum, &pk_p1_affine);
+    }
   }
-  if (hash_length) {
-    blake2b_update(ctx, (char *)&len, sizeof(uint64_t));
+  CHECK2(!empty, BLST_PK_IS_INFINITY);
+
+  blst_p1_affine pk_sum_affine;
+  blst_p1_to_affine(&pk_sum_affine, &pk_sum);
+  blst_p2_affine sig_p2_affine;
+  err = blst_p2_uncompress(&sig_p2_affine, sig);
+  CHECK(err);
+  err = blst_core_verify_pk_in_g1(&pk_sum_affine, &sig_p2_affine, true, msg,
+                                  msg_len, g_dst_label_pop,
+                                  g_dst_label_pop_len, NULL, 0);
+  CHECK(err);
+
+exit:
+  return err;
+}
+
+// Miller loop lines of the G2 generator, from the cell dep dumped by
+// deps/dump_bls12_381_data.c
+static blst_fp6 g_g2_generator_lines[CKB_BLS12_381_DATA_LINES];
+static bool g_g2_generator_lines_loaded = false;
+
+// Looks for the cell dep holding the lines by its data hash, returns
+// CKB_INDEX_OUT_OF_BOUND when the transaction has none.
+int load_g2_generator_lines(void) {
+  if (g_g2_generator_lines_loaded) {
+    return CKB_SUCCESS;
   }
-  uint64_t offset = (len > ONE_BATCH_SIZE) ? ONE_BATCH_SIZE : len;
-  blake2b_update(ctx, temp, offset);
-  while (offset < len) {
-    uint64_t current_len = ONE_BATCH_SIZE;
-    ret = ckb_load_witness(temp, &current_len, start + offset, index, source);
-    if (ret != CKB_SUCCESS) {
+  size_t index = 0;
+  while (true) {
+    uint8_t hash[32];
+    uint64_t len = 32;
+    int ret = ckb_load_cell_by_field(hash, &len, 0, index, CKB_SOURCE_CELL_DEP,
+                                     CKB_CELL_FIELD_DATA_HASH);
+    if (ret == CKB_INDEX_OUT_OF_BOUND) {
       return ret;
     }
-    uint64_t current_read =
-        (current_len > ONE_BATCH_SIZE) ? ONE_BATCH_SIZE : current_len;
-    blake2b_update(ctx, temp, current_read);
-    offset += current_read;
+    if (ret == CKB_SUCCESS && memcmp(hash, ckb_bls12_381_data_hash, 32) == 0) {
+      break;
+    }
+    index++;
   }
+  uint64_t len = CKB_BLS12_381_DATA_SIZE;
+  int ret = ckb_load_cell_data(g_g2_generator_lines, &len, 0, index,
+                               CKB_SOURCE_CELL_DEP);
+  if (ret != CKB_SUCCESS || len != CKB_BLS12_381_DATA_SIZE) {
+    return ERROR_IDENTITY_SYSCALL;
+  }
+  g_g2_generator_lines_loaded = true;
   return CKB_SUCCESS;
 }
 
-int verify_bls12_381_blake160_sighash_all(uint8_t *pubkey_hash,
-                                          uint8_t *signature_bytes) {
+// Miller loop of the G2 generator and p. The line functions of a pairing only
+// depend on its G2 point, so with the lines from the cell dep just their
+// evaluations at p are left, the doublings and additions of the generator are
+// skipped. Without the cell dep the lines are computed as usual.
+void miller_loop_g2_generator(blst_fp12 *ret, const blst_p1_affine *p) {
+  if (load_g2_generator_lines() == CKB_SUCCESS) {
+    blst_miller_loop_lines(ret, g_g2_generator_lines, p);
+  } else {
+    blst_miller_loop(ret, blst_p2_affine_generator(), p);
+  }
+}
+
+// Min-sig verification, e(sig, G2) == e(H(msg), pk) with H hashing to G1.
+// Hashing to G1 and decompressing a G1 signature avoid the Fp2 arithmetic of
+// their G2 counterparts, and the generator side of the check uses the
+// precomputed lines, see miller_loop_g2_generator.
+static BLST_ERROR blst_min_sig_verify(const uint8_t *sig, const uint8_t *pk,
+                                      const uint8_t *msg, size_t msg_len) {
+  BLST_ERROR err = BLST_SUCCESS;
+  blst_p2_affine pk_p2_affine;
+  err = blst_p2_uncompress(&pk_p2_affine, pk);
+  CHECK(err);
+  CHECK2(!blst_p2_affine_is_inf(&pk_p2_affine), BLST_PK_IS_INFINITY);
+  CHECK2(blst_p2_affine_in_g2(&pk_p2_affine), BLST_POINT_NOT_IN_GROUP);
+  blst_p1_affine sig_p1_affine;
+  err = blst_p1_uncompress(&sig_p1_affine, sig);
+  CHECK(err);
+  CHECK2(blst_p1_affine_in_g1(&sig_p1_affine), BLST_POINT_NOT_IN_GROUP);
+
+  blst_p1 hash;
+  blst_hash_to_g1(&hash, msg, msg_len, g_dst_label_g1, g_dst_label_g1_len,
+                  NULL, 0);
+  blst_p1_affine hash_affine;
+  blst_p1_to_affine(&hash_affine, &hash);
+
+  blst_fp12 gt_sig, gt_hash;
+  miller_loop_g2_generator(&gt_sig, &sig_p1_affine);
+  blst_miller_loop(&gt_hash, &pk_p2_affine, &hash_affine);
+  CHECK2(blst_fp12_finalverify(&gt_sig, &gt_hash), BLST_VERIFY_FAIL);
+
+exit:
+  return err;
+}
+
+// sighash all message of the group, the lock of the first witness must have
+// at least min_lock_len bytes
+static int calculate_sighash_all_message(size_t min_lock_len,
+                                         uint8_t *message) {
   int ret;
-  uint64_t len = 0;
   unsigned char temp[MAX_WITNESS_SIZE];
-  uint64_t read_len = MAX_WITNESS_SIZE;
-  uint64_t witness_len = MAX_WITNESS_SIZE;
+  CkbSighashAllCtx sighash_ctx;
+  ckb_sighash_all_init(&sighash_ctx, temp, MAX_WITNESS_SIZE);
 
   /* Load witness of first input */
-  ret = ckb_load_witness(temp, &read_len, 0, 0, CKB_SOURCE_GROUP_INPUT);
+  CkbSighashAllFirstWitness first_witness;
+  ret = ckb_sighash_all_load_first_witness(&sighash_ctx, &first_witness);
+  if (ret == CKB_SIGHASH_ALL_ERROR_ENCODING) {
+    return ERROR_IDENTITY_ENCODING;
+  }
   if (ret != CKB_SUCCESS) {
     return ERROR_IDENTITY_SYSCALL;
   }
-  witness_len = read_len;
-  if (read_len > MAX_WITNESS_SIZE) {
-    read_len = MAX_WITNESS_SIZE;
+  if (first_witness.lock_len < min_lock_len) {
+    return ERROR_IDENTITY_ARGUMENTS_LEN;
   }
 
-  /* load signature */
-  mol_seg_t lock_bytes_seg;
-  ret = extract_witness_lock(temp, read_len, &lock_bytes_seg);
-  if (ret != 0) {
-    return ERROR_IDENTITY_ENCODING;
-  }
-  if (lock_bytes_seg.size < BLST_SIGNAUTRE_SIZE) {
-    return ERROR_IDENTITY_ARGUMENTS_LEN;
+  /* Prepare sign message, lock field is digested as zeros */
+  ret = ckb_sighash_all_calculate(&sighash_ctx, &first_witness, message);
+  if (ret != CKB_SUCCESS) {
+    return ERROR_IDENTITY_SYSCALL;
   }
-  /* Load tx hash */
-  unsigned char tx_hash[BLAKE2B_BLOCK_SIZE];
-  len = BLAKE2B_BLOCK_SIZE;
-  ret = ckb_load_tx_hash(tx_hash, &len, 0);
+  return CKB_SUCCESS;
+}
+
+// signature_bytes is the compressed pubkey and signature, or with
+// signature_len BLST_AFFINE_SIGNATURE_SIZE the serialized affine ones. The
+// latter skip the square roots of decompression, the points are only checked
+// to be on the curve here and in their subgroups by blst_verify.
+int verify_bls12_381_blake160_sighash_all(uint8_t *pubkey_hash,
+                                          uint8_t *signature_bytes,
+                                          size_t signature_len) {
+  unsigned char message[BLAKE2B_BLOCK_SIZE];
+  int ret = calculate_sighash_all_message(signature_len, message);
   if (ret != CKB_SUCCESS) {
     return ret;
   }
-  if (len != BLAKE2B_BLOCK_SIZE) {
-    return ERROR_IDENTITY_SYSCALL;
+
+  // the pubkey hash is over the compressed pubkey in both encodings
+  uint8_t pubkey[BLST_PUBKEY_SIZE];
+  blst_p1_affine pk_p1_affine;
+  blst_p2_affine sig_p2_affine;
+  if (signature_len == BLST_AFFINE_SIGNATURE_SIZE) {
+    const uint8_t *sig = signature_bytes + BLST_AFFINE_PUBKEY_SIZE;
+    // blst_p1_deserialize would take compressed points as well
+    if ((signature_bytes[0] & 0x80) != 0 || (sig[0] & 0x80) != 0) {
+      return ERROR_INVALID_MOL_FORMAT;
+    }
+    if (blst_p1_deserialize(&pk_p1_affine, signature_bytes) != BLST_SUCCESS ||
+        blst_p2_deserialize(&sig_p2_affine, sig) != BLST_SUCCESS) {
+      return ERROR_BLST_VERIFY_FAILED;
+    }
+    blst_p1_affine_compress(pubkey, &pk_p1_affine);
+  } else {
+    memcpy(pubkey, signature_bytes, BLST_PUBKEY_SIZE);
+    blst_p1_uncompress(&pk_p1_affine, pubkey);
+    blst_p2_uncompress(&sig_p2_affine, signature_bytes + BLST_PUBKEY_SIZE);
   }
 
-  /* Prepare sign message */
+  BLST_ERROR err =
+      blst_verify(&sig_p2_affine, &pk_p1_affine, message, BLAKE2B_BLOCK_SIZE);
+  CKB_TRACE("blst_verify");
+  if (err != 0) {
+    return ERROR_BLST_VERIFY_FAILED;
+  }
+
+  unsigned char temp2[BLAKE2B_BLOCK_SIZE];
+  blake2b_state blake2b_ctx2;
+  blake2b_init(&blake2b_ctx2, BLAKE2B_BLOCK_SIZE);
+  blake2b_update(&blake2b_ctx2, pubkey, BLST_PUBKEY_SIZE);
+  blake2b_final(&blake2b_ctx2, temp2, BLAKE2B_BLOCK_SIZE);
+  CKB_TRACE("pubkey_hash");
+
+  if (memcmp(pubkey_hash, temp2, BLAKE160_SIZE) != 0) {
+    return ERROR_IDENTITY_PUBKEY_BLAKE160_HASH;
+  }
+
+  return 0;
+}
+
+// signature_bytes holds count pairs of pubkey and signature, pubkey_hash is the
+// blake160 of all pubkeys in this order
+int verify_bls12_381_aggregate_sighash_all(uint8_t *pubkey_hash,
+                                           uint8_t *signature_bytes,
+                                           size_t count) {
   unsigned char message[BLAKE2B_BLOCK_SIZE];
+  int ret =
+      calculate_sighash_all_message(count * BLST_SIGNAUTRE_SIZE, message);
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+
+  BLST_ERROR err = blst_aggregate_verify(signature_bytes, count, message,
+                                         BLAKE2B_BLOCK_SIZE);
+  CKB_TRACE("blst_aggregate_verify");
+  if (err != 0) {
+    return ERROR_BLST_VERIFY_FAILED;
+  }
+
+  unsigned char temp[BLAKE2B_BLOCK_SIZE];
   blake2b_state blake2b_ctx;
   blake2b_init(&blake2b_ctx, BLAKE2B_BLOCK_SIZE);
-  blake2b_update(&blake2b_ctx, tx_hash, BLAKE2B_BLOCK_SIZE);
-
-  /* Clear lock field to zero, then digest the first witness
-   * lock_bytes_seg.ptr actually points to the memory in temp buffer
-   * */
-  memset((void *)lock_bytes_seg.ptr, 0, lock_bytes_seg.size);
-  blake2b_update(&blake2b_ctx, (char *)&witness_len, sizeof(uint64_t));
-  blake2b_update(&blake2b_ctx, temp, read_len);
-
-  // remaining of first witness
-  if (read_len < witness_len) {
-    ret = load_and_hash_witness(&blake2b_ctx, read_len, 0,
-                                CKB_SOURCE_GROUP_INPUT, false);
-    if (ret != CKB_SUCCESS) {
-      return ERROR_IDENTITY_SYSCALL;
-    }
+  for (size_t i = 0; i < count; i++) {
+    blake2b_update(&blake2b_ctx, signature_bytes + i * BLST_SIGNAUTRE_SIZE,
+                   BLST_PUBKEY_SIZE);
   }
+  blake2b_final(&blake2b_ctx, temp, BLAKE2B_BLOCK_SIZE);
+  CKB_TRACE("pubkey_hash");
 
-  // Digest same group witnesses
-  size_t i = 1;
-  while (1) {
-    ret =
-        load_and_hash_witness(&blake2b_ctx, 0, i, CKB_SOURCE_GROUP_INPUT, true);
-    if (ret == CKB_INDEX_OUT_OF_BOUND) {
-      break;
-    }
-    if (ret != CKB_SUCCESS) {
-      return ERROR_IDENTITY_SYSCALL;
-    }
-    i += 1;
+  if (memcmp(pubkey_hash, temp, BLAKE160_SIZE) != 0) {
+    return ERROR_IDENTITY_PUBKEY_BLAKE160_HASH;
   }
 
-  // Digest witnesses that not covered by inputs
-  i = (size_t)ckb_calculate_inputs_len();
-  while (1) {
-    ret = load_and_hash_witness(&blake2b_ctx, 0, i, CKB_SOURCE_INPUT, true);
-    if (ret == CKB_INDEX_OUT_OF_BOUND) {
-      break;
-    }
-    if (ret != CKB_SUCCESS) {
-      return ERROR_IDENTITY_SYSCALL;
-    }
-    i += 1;
+  return 0;
+}
+
+// signature_bytes is the multisig script followed by the signer bitmap and
+// the aggregated signature:
+// * 1 byte threshold M
+// * 1 byte pubkeys count N
+// * N 48 bytes pubkeys
+// * (N + 7) / 8 bytes bitmap, bit i of byte i / 8 set when pubkey i signed
+// * 96 bytes aggregated signature
+// pubkey_hash is the blake160 of the multisig script. The script only verifies
+// the aggregated signature, a pubkey chosen as the negated sum of the others
+// would sign for all of them. So args must only commit to pubkeys whose proof
+// of possession, a signature of the pubkey under g_dst_label_pop, has been
+// verified before the lock is created.
+int verify_bls12_381_multisig_sighash_all(uint8_t *pubkey_hash,
+                                          uint8_t *signature_bytes,
+                                          size_t signature_len) {
+  if (signature_len < 2) {
+    return ERROR_INVALID_MOL_FORMAT;
   }
+  uint8_t threshold = signature_bytes[0];
+  uint8_t pubkeys_cnt = signature_bytes[1];
+  if (pubkeys_cnt == 0 || pubkeys_cnt > MAX_BLS_MULTISIG_KEYS ||
+      threshold == 0 || threshold > pubkeys_cnt) {
+    return ERROR_BLST_INVALID_THRESHOLD;
+  }
+  size_t script_len = 2 + (size_t)pubkeys_cnt * BLST_PUBKEY_SIZE;
+  size_t bitmap_len = (pubkeys_cnt + 7) / 8;
+  if (signature_len != script_len + bitmap_len + BLST_AGGREGATE_SIG_SIZE) {
+    return ERROR_INVALID_MOL_FORMAT;
+  }
+  const uint8_t *bitmap = signature_bytes + script_len;
+  // no bits past the last pubkey, so the witness can't be malleated
+  if (pubkeys_cnt % 8 != 0 &&
+      (bitmap[bitmap_len - 1] >> (pubkeys_cnt % 8)) != 0) {
+    return ERROR_INVALID_MOL_FORMAT;
+  }
+  size_t signers_cnt = 0;
+  for (size_t i = 0; i < bitmap_len; i++) {
+    signers_cnt += __builtin_popcount(bitmap[i]);
+  }
+  if (signers_cnt < threshold) {
+    return ERROR_BLST_THRESHOLD_NOT_REACHED;
+  }
+
+  // the committee is checked before the pairing, it comes from the witness
+  unsigned char temp[BLAKE2B_BLOCK_SIZE];
+  blake2b_state blake2b_ctx;
+  blake2b_init(&blake2b_ctx, BLAKE2B_BLOCK_SIZE);
+  blake2b_update(&blake2b_ctx, signature_bytes, script_len);
+  blake2b_final(&blake2b_ctx, temp, BLAKE2B_BLOCK_SIZE);
+  CKB_TRACE("pubkey_hash");
+  if (memcmp(pubkey_hash, temp, BLAKE160_SIZE) != 0) {
+    return ERROR_IDENTITY_PUBKEY_BLAKE160_HASH;
+  }
+
+  unsigned char message[BLAKE2B_BLOCK_SIZE];
+  int ret = calculate_sighash_all_message(signature_len, message);
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+
+  BLST_ERROR err = blst_multisig_verify(
+      signature_bytes + 2, pubkeys_cnt, bitmap, bitmap + bitmap_len, message,
+      BLAKE2B_BLOCK_SIZE);
+  CKB_TRACE("blst_multisig_verify");
+  if (err != 0) {
+    return ERROR_BLST_VERIFY_FAILED;
+  }
+  return 0;
+}
 
-  blake2b_final(&blake2b_ctx, message, BLAKE2B_BLOCK_SIZE);
+// signature_bytes is the 96 bytes compressed G2 pubkey and the 48 bytes
+// compressed G1 signature, pubkey_hash the blake160 of the pubkey
+int verify_bls12_381_min_sig_sighash_all(uint8_t *pubkey_hash,
+                                         uint8_t *signature_bytes) {
+  unsigned char message[BLAKE2B_BLOCK_SIZE];
+  int ret = calculate_sighash_all_message(BLST_MIN_SIG_SIGNATURE_SIZE, message);
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
 
   const uint8_t *pubkey = signature_bytes;
-  const uint8_t *sig = pubkey + BLST_PUBKEY_SIZE;
+  const uint8_t *sig = pubkey + BLST_MIN_SIG_PUBKEY_SIZE;
 
-  BLST_ERROR err = blst_verify(sig, pubkey, message, BLAKE2B_BLOCK_SIZE);
+  BLST_ERROR err =
+      blst_min_sig_verify(sig, pubkey, message, BLAKE2B_BLOCK_SIZE);
+  CKB_TRACE("blst_min_sig_verify");
   if (err != 0) {
     return ERROR_BLST_VERIFY_FAILED;
   }
 
-  unsigned char temp2[BLAKE2B_BLOCK_SIZE];
-  blake2b_state blake2b_ctx2;
-  blake2b_init(&blake2b_ctx2, BLAKE2B_BLOCK_SIZE);
-  blake2b_update(&blake2b_ctx2, pubkey, BLST_PUBKEY_SIZE);
-  blake2b_final(&blake2b_ctx2, temp2, BLAKE2B_BLOCK_SIZE);
+  unsigned char temp[BLAKE2B_BLOCK_SIZE];
+  blake2b_state blake2b_ctx;
+  blake2b_init(&blake2b_ctx, BLAKE2B_BLOCK_SIZE);
+  blake2b_update(&blake2b_ctx, pubkey, BLST_MIN_SIG_PUBKEY_SIZE);
+  blake2b_final(&blake2b_ctx, temp, BLAKE2B_BLOCK_SIZE);
+  CKB_TRACE("pubkey_hash");
 
-  if (memcmp(pubkey_hash, temp2, BLAKE160_SIZE) != 0) {
+  if (memcmp(pubkey_hash, temp, BLAKE160_SIZE) != 0) {
     return ERROR_IDENTITY_PUBKEY_BLAKE160_HASH;
   }
 
   return 0;
 }
 
-int ckb_verify_bls12_381_identity(CkbIdentityType *id, uint8_t *signature) {
+int ckb_verify_bls12_381_identity(CkbIdentityType *id, uint8_t *signature,
+                                  size_t signature_len) {
   if (id->flags == IdentityFlagsBls12381) {
-    return verify_bls12_381_blake160_sighash_all(id->blake160, signature);
+    return verify_bls12_381_blake160_sighash_all(id->blake160, signature,
+                                                 signature_len);
+  } else if (id->flags == IdentityFlagsBls12381Aggregate) {
+    if (signature_len % BLST_SIGNAUTRE_SIZE != 0) {
+      return ERROR_INVALID_MOL_FORMAT;
+    }
+    return verify_bls12_381_aggregate_sighash_all(
+        id->blake160, signature, signature_len / BLST_SIGNAUTRE_SIZE);
+  } else if (id->flags == IdentityFlagsBls12381Multisig) {
+    return verify_bls12_381_multisig_sighash_all(id->blake160, signature,
+                                                 signature_len);
+  } else if (id->flags == IdentityFlagsBls12381MinSig) {
+    return verify_bls12_381_min_sig_sighash_all(id->blake160, signature);
   } else {
     return CKB_INVALID_DATA;
   }
 }
 
 enum RcLockErrorCode {
+  // same codes as the rce checks of rc lock
+  ERROR_ON_BLACK_LIST = 57,
+  ERROR_NOT_ON_WHITE_LIST = 59,
   // rc lock error code is starting from 80
   ERROR_UNKNOWN_FLAGS = 80,
   ERROR_PROOF_LENGTH_MISMATCHED,
@@ -291,11 +574,88 @@ enum RcLockErrorCode {
   ERROR_NO_WHITE_LIST,
 };
 
+// Unlocks with an rc identity in the witness check it against the rules
+// following the owner identity in args, the owner identity itself is only
+// used by unlocks without one. The rules are either:
+// * RC_ROOT_SIZE bytes rc_root, the root of a single white list
+// * RC_ARGS_RULES followed by 1 to MAX_RC_RULES rules, each one a flags byte
+//   and a root
+// The roots are of sparse merkle trees keyed by identities, see
+// verify_rc_identity
+#define RC_ROOT_SIZE 32
+#define RC_ARGS_RULES 0x1
+#define MAX_RC_RULES 8
+#define RC_RULE_SIZE (1 + RC_ROOT_SIZE)
+// set for a white list, clear for a black list
+#define RC_RULE_WHITE_LIST 0x2
+// mask of a SmtProofEntry, the proof shows the identity on the list (value 1)
+// or off it (value 0)
+#define SMT_MASK_ON 0x1
+#define SMT_MASK_OFF 0x2
+
+typedef struct RcRuleType {
+  uint8_t flags;
+  uint8_t smt_root[RC_ROOT_SIZE];
+} RcRuleType;
+
 typedef struct ArgsType {
   CkbIdentityType id;
-  uint8_t rc_root[32];
+  RcRuleType rules[MAX_RC_RULES];
+  uint32_t rules_len;
 } ArgsType;
 
+// The rc identity must be on every white list and off every black list of
+// args, with one proof entry per rule, in the order of the rules. The proofs
+// are verified in one pass, streamed from the witness, and the leaf hash of
+// the identity is shared by all of them.
+int verify_rc_identity(const CkbIdentityType *identity,
+                       RcIdentityType *rc_identity, const ArgsType *args) {
+  int err = 0;
+  CHECK2(args->rules_len > 0, ERROR_NO_RCRULE);
+  bool has_white_list = false;
+  for (uint32_t i = 0; i < args->rules_len; i++) {
+    has_white_list |= (args->rules[i].flags & RC_RULE_WHITE_LIST) != 0;
+  }
+  CHECK2(has_white_list, ERROR_NO_WHITE_LIST);
+
+  SmtProofEntryVecType proofs = rc_identity->t->proofs(rc_identity);
+  CHECK2(proofs.t->len(&proofs) == args->rules_len,
+         ERROR_PROOF_LENGTH_MISMATCHED);
+
+  uint8_t key[CKB_SMT_KEY_BYTES] = {0};
+  key[0] = identity->flags;
+  memcpy(key + 1, identity->blake160, BLAKE160_SIZE);
+  uint8_t value[CKB_SMT_VALUE_BYTES] = {0};
+  CkbSmtPair off;
+  ckb_smt_pair_init(&off, key, value);
+  value[0] = 1;
+  CkbSmtPair on;
+  ckb_smt_pair_init(&on, key, value);
+  CKB_TRACE("rc_identity_leaf");
+
+  for (uint32_t i = 0; i < args->rules_len; i++) {
+    const RcRuleType *rule = &args->rules[i];
+    bool existing = false;
+    SmtProofEntryType entry = proofs.t->get(&proofs, i, &existing);
+    CHECK2(existing, ERROR_INVALID_MOL_FORMAT);
+    uint8_t mask = entry.t->mask(&entry);
+    mol2_cursor_t proof = entry.t->proof(&entry);
+    if (rule->flags & RC_RULE_WHITE_LIST) {
+      CHECK2(mask == SMT_MASK_ON, ERROR_NOT_ON_WHITE_LIST);
+      CHECK2(ckb_smt_verify(rule->smt_root, &on, 1, &proof) == 0,
+             ERROR_NOT_ON_WHITE_LIST);
+    } else {
+      CHECK2(mask == SMT_MASK_OFF, ERROR_ON_BLACK_LIST);
+      CHECK2(ckb_smt_verify(rule->smt_root, &off, 1, &proof) == 0,
+             ERROR_ON_BLACK_LIST);
+    }
+  }
+  CKB_TRACE("rc_identity_proofs");
+
+exit:
+  return err;
+}
+
 // make compiler happy
 int make_cursor_from_witness(WitnessArgsType *witness, bool *_input) {
   return -1;
@@ -320,7 +680,10 @@ int parse_args(ArgsType *args, bool has_rc_identity) {
   CHECK2(args_bytes_seg.size >= 1, ERROR_IDENTITY_ENCODING);
   uint8_t flags = args_bytes_seg.ptr[0];
   CHECK2(flags == IdentityFlagsPubkeyHash || flags == IdentityFlagsOwnerLock ||
-             flags == IdentityFlagsBls12381,
+             flags == IdentityFlagsBls12381 ||
+             flags == IdentityFlagsBls12381Aggregate ||
+             flags == IdentityFlagsBls12381Multisig ||
+             flags == IdentityFlagsBls12381MinSig,
          ERROR_UNKNOWN_FLAGS);
   args->id.flags = flags;
 
@@ -328,10 +691,28 @@ int parse_args(ArgsType *args, bool has_rc_identity) {
   memcpy(args->id.blake160, args_bytes_seg.ptr + 1, BLAKE160_SIZE);
 
   if (has_rc_identity) {
-    CHECK2(args_bytes_seg.size >= (1 + BLAKE160_SIZE + BLAKE2B_BLOCK_SIZE),
-           ERROR_INVALID_MOL_FORMAT);
-    memcpy(args->rc_root, args_bytes_seg.ptr + 1 + BLAKE160_SIZE,
-           sizeof(args->rc_root));
+    const uint8_t *rc_args = args_bytes_seg.ptr + 1 + BLAKE160_SIZE;
+    uint32_t rc_args_size = args_bytes_seg.size - (1 + BLAKE160_SIZE);
+    if (rc_args_size == RC_ROOT_SIZE) {
+      args->rules[0].flags = RC_RULE_WHITE_LIST;
+      memcpy(args->rules[0].smt_root, rc_args, RC_ROOT_SIZE);
+      args->rules_len = 1;
+    } else {
+      CHECK2(rc_args_size > 0 && rc_args[0] == RC_ARGS_RULES,
+             ERROR_INVALID_MOL_FORMAT);
+      uint32_t rules_size = rc_args_size - 1;
+      CHECK2(rules_size % RC_RULE_SIZE == 0, ERROR_INVALID_MOL_FORMAT);
+      args->rules_len = rules_size / RC_RULE_SIZE;
+      CHECK2(args->rules_len > 0, ERROR_NO_RCRULE);
+      CHECK2(args->rules_len <= MAX_RC_RULES, ERROR_INVALID_MOL_FORMAT);
+      const uint8_t *rule = rc_args + 1;
+      for (uint32_t i = 0; i < args->rules_len; i++) {
+        CHECK2((rule[0] & ~RC_RULE_WHITE_LIST) == 0, ERROR_INVALID_MOL_FORMAT);
+        args->rules[i].flags = rule[0];
+        memcpy(args->rules[i].smt_root, rule + 1, RC_ROOT_SIZE);
+        rule += RC_RULE_SIZE;
+      }
+    }
   }
 
 exit:
@@ -394,6 +775,7 @@ int simulator_main() {
 #else
 int main() {
 #endif
+  CKB_TRACE_SCOPE("bls12_381_sighash_all");
   int err = 0;
   // if has_rc_identity is true, it's one of the following:
   // - Unlock via administrator’s lock script hash
@@ -439,31 +821,66 @@ int main() {
   } else {
     witness_lock_existing = false;
   }
+  CKB_TRACE("witness_lock");
 
   ArgsType args = {0};
   err = parse_args(&args, has_rc_identity);
   CHECK(err);
+  CKB_TRACE("args");
   // When rc_identity is missing, the identity included in lock script args will
-  // then be used in further validation.
+  // then be used in further validation. Otherwise the rc identity replaces it
+  // once it passes the rules of args.
   if (!has_rc_identity) {
     identity = args.id;
+  } else {
+    err = verify_rc_identity(&identity, &rc_identity, &args);
+    CHECK(err);
   }
 
-  uint8_t signature_bytes[BLST_SIGNAUTRE_SIZE] = {0};
+  uint8_t signature_bytes[BLST_AGGREGATE_SIGNATURE_MAX_SIZE] = {0};
+  uint32_t signature_len = 0;
   if (identity.flags == IdentityFlagsBls12381) {
     CHECK2(witness_lock_existing, ERROR_INVALID_MOL_FORMAT);
 
     BytesOptType signature_opt = witness_lock.t->signature(&witness_lock);
     mol2_cursor_t signature_cursor = signature_opt.t->unwrap(&signature_opt);
 
-    uint32_t read_len =
-        mol2_read_at(&signature_cursor, signature_bytes, BLST_SIGNAUTRE_SIZE);
-    CHECK2(read_len == BLST_SIGNAUTRE_SIZE, ERROR_INVALID_MOL_FORMAT);
+    // any other length is taken as compressed points, as it always was
+    uint32_t expected_len = signature_cursor.size == BLST_AFFINE_SIGNATURE_SIZE
+                                ? BLST_AFFINE_SIGNATURE_SIZE
+                                : BLST_SIGNAUTRE_SIZE;
+    signature_len =
+        mol2_read_at(&signature_cursor, signature_bytes, expected_len);
+    CHECK2(signature_len == expected_len, ERROR_INVALID_MOL_FORMAT);
+  } else if (identity.flags == IdentityFlagsBls12381MinSig) {
+    CHECK2(witness_lock_existing, ERROR_INVALID_MOL_FORMAT);
+
+    BytesOptType signature_opt = witness_lock.t->signature(&witness_lock);
+    mol2_cursor_t signature_cursor = signature_opt.t->unwrap(&signature_opt);
+
+    signature_len = mol2_read_at(&signature_cursor, signature_bytes,
+                                 BLST_MIN_SIG_SIGNATURE_SIZE);
+    CHECK2(signature_len == BLST_MIN_SIG_SIGNATURE_SIZE,
+           ERROR_INVALID_MOL_FORMAT);
+  } else if (identity.flags == IdentityFlagsBls12381Aggregate ||
+             identity.flags == IdentityFlagsBls12381Multisig) {
+    CHECK2(witness_lock_existing, ERROR_INVALID_MOL_FORMAT);
+
+    BytesOptType signature_opt = witness_lock.t->signature(&witness_lock);
+    mol2_cursor_t signature_cursor = signature_opt.t->unwrap(&signature_opt);
+    CHECK2(signature_cursor.size > 0 &&
+               signature_cursor.size <= BLST_AGGREGATE_SIGNATURE_MAX_SIZE,
+           ERROR_INVALID_MOL_FORMAT);
+
+    signature_len = mol2_read_at(&signature_cursor, signature_bytes,
+                                 signature_cursor.size);
+    CHECK2(signature_len == signature_cursor.size, ERROR_INVALID_MOL_FORMAT);
   } else {
     return ERROR_IDENTITY_ENCODING;
   }
 
-  err = ckb_verify_bls12_381_identity(&identity, signature_bytes);
+  err = ckb_verify_bls12_381_identity(&identity, signature_bytes,
+                                      signature_len);
   CHECK(err);
 
 exit:
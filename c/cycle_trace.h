@@ -0,0 +1,180 @@
+#ifndef CKB_MISCELLANEOUS_SCRIPTS_CYCLE_TRACE_H_
+#define CKB_MISCELLANEOUS_SCRIPTS_CYCLE_TRACE_H_
+
+// Phase level cycle instrumentation, enabled with -DCKB_CYCLE_TRACE. When it
+// is not defined, every macro below compiles to nothing.
+//
+// CKB_TRACE_SCOPE(label) starts a trace at the top of an entry function (main
+// or an exported library function), and CKB_TRACE(name) marks the end of a
+// named phase. When the entry function returns, through any return path, one
+// line is emitted via ckb_debug:
+//
+// trace htlc: total=1843201 dlopen=10423 molecule=1011 load_witness=2301 ...
+//
+// where each number is the cost of that phase since the previous mark.
+// CKB_TRACE_VALUE(name, value) adds a plain number to the same line instead,
+// such as a count of bytes or syscalls, without ending the current phase.
+// Scopes nest: only the outermost scope of a module resets and emits, so a
+// dual script running standalone emits one trace, while the same export
+// dlopened from another script emits its own.
+//
+// On chain the VM's current cycles syscall is used, it is only available in
+// CKB-VM version 1 (ckb2021) and later. In simulator, phases are measured in
+// nanoseconds of monotonic clock instead.
+//
+// Like sighash_all_helper.h, the including script should include syscalls of
+// the flavour it is built with before including this file.
+#ifdef CKB_CYCLE_TRACE
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(CKB_SIMULATOR) || defined(CKB_USE_SIM)
+#include <time.h>
+#endif
+
+#ifndef SYS_ckb_current_cycles
+#define SYS_ckb_current_cycles 2042
+#endif
+
+#ifndef CKB_TRACE_MAX_PHASES
+#define CKB_TRACE_MAX_PHASES 32
+#endif
+#define CKB_TRACE_LINE_SIZE 1024
+
+typedef struct CkbTracePhase {
+  const char *name;
+  uint64_t cycles;
+} CkbTracePhase;
+
+typedef struct CkbTrace {
+  const char *label;
+  int depth;
+  size_t count;
+  // phases past CKB_TRACE_MAX_PHASES are counted but not recorded
+  size_t dropped;
+  uint64_t start;
+  uint64_t last;
+  CkbTracePhase phases[CKB_TRACE_MAX_PHASES];
+} CkbTrace;
+
+static CkbTrace g_ckb_trace;
+
+static uint64_t ckb_trace_now() {
+#if defined(CKB_SIMULATOR) || defined(CKB_USE_SIM)
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+#else
+  return (uint64_t)syscall(SYS_ckb_current_cycles, 0, 0, 0, 0, 0, 0);
+#endif
+}
+
+static void ckb_trace_phase(const char *name) {
+  uint64_t now = ckb_trace_now();
+  if (g_ckb_trace.depth == 0) {
+    return;
+  }
+  if (g_ckb_trace.count < CKB_TRACE_MAX_PHASES) {
+    CkbTracePhase *phase = &g_ckb_trace.phases[g_ckb_trace.count++];
+    phase->name = name;
+    phase->cycles = now - g_ckb_trace.last;
+  } else {
+    g_ckb_trace.dropped += 1;
+  }
+  g_ckb_trace.last = now;
+}
+
+static void ckb_trace_value(const char *name, uint64_t value) {
+  if (g_ckb_trace.depth == 0) {
+    return;
+  }
+  if (g_ckb_trace.count < CKB_TRACE_MAX_PHASES) {
+    CkbTracePhase *phase = &g_ckb_trace.phases[g_ckb_trace.count++];
+    phase->name = name;
+    phase->cycles = value;
+  } else {
+    g_ckb_trace.dropped += 1;
+  }
+}
+
+static const char *ckb_trace_begin(const char *label) {
+  if (g_ckb_trace.depth++ == 0) {
+    g_ckb_trace.label = label;
+    g_ckb_trace.count = 0;
+    g_ckb_trace.dropped = 0;
+    g_ckb_trace.start = ckb_trace_now();
+    g_ckb_trace.last = g_ckb_trace.start;
+  }
+  return label;
+}
+
+static size_t _ckb_trace_append(char *buf, size_t offset, const char *s) {
+  while (*s != '\0' && offset + 1 < CKB_TRACE_LINE_SIZE) {
+    buf[offset++] = *s++;
+  }
+  return offset;
+}
+
+static size_t _ckb_trace_append_u64(char *buf, size_t offset, uint64_t v) {
+  char digits[20];
+  int n = 0;
+  do {
+    digits[n++] = '0' + (char)(v % 10);
+    v /= 10;
+  } while (v != 0);
+  while (n > 0 && offset + 1 < CKB_TRACE_LINE_SIZE) {
+    buf[offset++] = digits[--n];
+  }
+  return offset;
+}
+
+static void ckb_trace_emit() {
+  char line[CKB_TRACE_LINE_SIZE];
+  size_t offset = _ckb_trace_append(line, 0, "trace ");
+  offset = _ckb_trace_append(line, offset, g_ckb_trace.label);
+  offset = _ckb_trace_append(line, offset, ": total=");
+  offset = _ckb_trace_append_u64(line, offset,
+                                 ckb_trace_now() - g_ckb_trace.start);
+  for (size_t i = 0; i < g_ckb_trace.count; i++) {
+    offset = _ckb_trace_append(line, offset, " ");
+    offset = _ckb_trace_append(line, offset, g_ckb_trace.phases[i].name);
+    offset = _ckb_trace_append(line, offset, "=");
+    offset = _ckb_trace_append_u64(line, offset, g_ckb_trace.phases[i].cycles);
+  }
+  if (g_ckb_trace.dropped > 0) {
+    offset = _ckb_trace_append(line, offset, " dropped=");
+    offset = _ckb_trace_append_u64(line, offset, g_ckb_trace.dropped);
+  }
+  line[offset] = '\0';
+  ckb_debug(line);
+}
+
+static void ckb_trace_end(const char **label) {
+  (void)label;
+  if (--g_ckb_trace.depth == 0) {
+    ckb_trace_emit();
+  }
+}
+
+#define CKB_TRACE_SCOPE(label)                                           \
+  const char *_ckb_trace_scope __attribute__((cleanup(ckb_trace_end))) = \
+      ckb_trace_begin(label)
+#define CKB_TRACE(name) ckb_trace_phase(name)
+#define CKB_TRACE_VALUE(name, value) ckb_trace_value(name, value)
+
+#else
+
+#define CKB_TRACE_SCOPE(label) \
+  do {                         \
+  } while (0)
+#define CKB_TRACE(name) \
+  do {                  \
+  } while (0)
+#define CKB_TRACE_VALUE(name, value) \
+  do {                               \
+  } while (0)
+
+#endif  // CKB_CYCLE_TRACE
+
+#endif  // CKB_MISCELLANEOUS_SCRIPTS_CYCLE_TRACE_H_
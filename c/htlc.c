@@ -1,12 +1,14 @@
 /*
  * A simple HTLC script designed to be compatible with liquality.io
  */
+#include "blake2b.h"
 #include "blockchain.h"
 #include "ckb_dlfcn.h"
 #include "ckb_syscalls.h"
 #include "ckb_utils.h"
 #include "secp256k1_blake2b_sighash_all_lib.h"
 #include "sha256.h"
+#include "sighash_all_helper.h"
 
 #define ERROR_ARGUMENTS_LEN -1
 #define ERROR_ENCODING -2
@@ -33,25 +35,6 @@
 
 #define SCRIPT_ARG_SIZE (BLAKE160_SIZE * 2 + SHA256_BLOCK_SIZE + 8)
 
-/* Extract lock from WitnessArgs */
-int extract_witness_lock(uint8_t *witness, uint64_t len,
-                         mol_seg_t *lock_bytes_seg) {
-  mol_seg_t witness_seg;
-  witness_seg.ptr = witness;
-  witness_seg.size = len;
-
-  if (MolReader_WitnessArgs_verify(&witness_seg, false) != MOL_OK) {
-    return ERROR_ENCODING;
-  }
-  mol_seg_t lock_seg = MolReader_WitnessArgs_get_lock(&witness_seg);
-
-  if (MolReader_BytesOpt_is_none(&lock_seg)) {
-    return ERROR_ENCODING;
-  }
-  *lock_bytes_seg = MolReader_Bytes_raw_bytes(&lock_seg);
-  return CKB_SUCCESS;
-}
-
 /*
  * Arguments:
  * two 20-byte pubkey blake160 hashes, one 32-byte secret hash, as well as
@@ -63,6 +46,7 @@ int extract_witness_lock(uint8_t *witness, uint64_t len,
  * * Optional data use to generate secret hash
  */
 int main() {
+  CKB_TRACE_SCOPE("htlc");
   uint8_t secp_code_buffer[100 * 1024] __attribute__((aligned(RISCV_PGSIZE)));
   uint8_t *aligned_code_start = secp_code_buffer;
   size_t aligned_size = ROUNDDOWN(100 * 1024, RISCV_PGSIZE);
@@ -75,12 +59,13 @@ int main() {
   if (ret != CKB_SUCCESS) {
     return ret;
   }
-  int (*verify_func)(const uint8_t *, const uint8_t *, const uint8_t *, size_t);
+  int (*verify_func)(const uint8_t *, const uint8_t *);
   *(void **)(&verify_func) =
-      ckb_dlsym(handle, "validate_secp256k1_blake2b_sighash_all");
+      ckb_dlsym(handle, "validate_secp256k1_blake2b_sighash_all_v2");
   if (verify_func == NULL) {
     return ERROR_DYNAMIC_LOADING;
   }
+  CKB_TRACE("dlopen");
 
   /* Load args */
   unsigned char script[SCRIPT_SIZE];
@@ -99,6 +84,7 @@ int main() {
   if (MolReader_Script_verify(&script_seg, false) != MOL_OK) {
     return ERROR_ENCODING;
   }
+  CKB_TRACE("molecule");
 
   mol_seg_t args_seg = MolReader_Script_get_args(&script_seg);
   mol_seg_t args_bytes_seg = MolReader_Bytes_raw_bytes(&args_seg);
@@ -106,34 +92,24 @@ int main() {
     return ERROR_ARGUMENTS_LEN;
   }
 
-  /* Load witness of first input */
+  /* Load witness of first input, lock bytes are read in place */
   unsigned char witness[MAX_WITNESS_SIZE];
-  uint64_t witness_len = MAX_WITNESS_SIZE;
-  ret = ckb_load_witness(witness, &witness_len, 0, 0, CKB_SOURCE_GROUP_INPUT);
+  CkbSighashAllCtx sighash_ctx;
+  ckb_sighash_all_init(&sighash_ctx, witness, MAX_WITNESS_SIZE);
+  CkbSighashAllFirstWitness first_witness;
+  ret = ckb_sighash_all_load_first_witness(&sighash_ctx, &first_witness);
+  if (ret == CKB_SIGHASH_ALL_ERROR_ENCODING) {
+    return ERROR_ENCODING;
+  }
   if (ret != CKB_SUCCESS) {
     return ERROR_SYSCALL;
   }
 
-  if (witness_len > MAX_WITNESS_SIZE) {
-    return ERROR_WITNESS_SIZE;
-  }
-
-  /* load signature */
-  mol_seg_t lock_bytes_seg;
-  ret = extract_witness_lock(witness, witness_len, &lock_bytes_seg);
-  if (ret != 0) {
-    return ERROR_ENCODING;
-  }
-
-  uint64_t lock_bytes_len = lock_bytes_seg.size;
-  if (lock_bytes_len < SIGNATURE_SIZE || lock_bytes_len > MAX_WITNESS_SIZE) {
+  uint64_t lock_bytes_len = first_witness.lock_len;
+  if (lock_bytes_len < SIGNATURE_SIZE) {
     return ERROR_ARGUMENTS_LEN;
   }
-  unsigned char lock_bytes[MAX_WITNESS_SIZE];
-  memcpy(lock_bytes, lock_bytes_seg.ptr, lock_bytes_len);
-
-  /* Clear lock field to zero for the first witness */
-  memset((void *)lock_bytes_seg.ptr, 0, lock_bytes_len);
+  const uint8_t *lock_bytes = first_witness.lock;
 
   if (lock_bytes_len > SIGNATURE_SIZE) {
     unsigned char secret_hash[SHA256_BLOCK_SIZE];
@@ -146,8 +122,9 @@ int main() {
                SHA256_BLOCK_SIZE) != 0) {
       return ERROR_SECRET_HASH;
     }
-    ret = verify_func(&args_bytes_seg.ptr[BLAKE160_SIZE], lock_bytes, witness,
-                      witness_len);
+    CKB_TRACE("secret_hash");
+    ret = verify_func(&args_bytes_seg.ptr[BLAKE160_SIZE], lock_bytes);
+    CKB_TRACE("signature");
     if (ret != CKB_SUCCESS) {
       return ret;
     }
@@ -171,7 +148,9 @@ int main() {
     if (comparable != 1 || cmp > 0) {
       return ERROR_INCORRECT_SINCE;
     }
-    ret = verify_func(args_bytes_seg.ptr, lock_bytes, witness, witness_len);
+    CKB_TRACE("since");
+    ret = verify_func(args_bytes_seg.ptr, lock_bytes);
+    CKB_TRACE("signature");
     if (ret != CKB_SUCCESS) {
       return ret;
     }
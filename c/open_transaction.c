@@ -8,6 +8,7 @@
 #include "ckb_syscalls.h"
 #include "ckb_utils.h"
 #include "secp256k1_helper.h"
+#include "sighash_all_helper.h"
 
 #define BLAKE2B_BLOCK_SIZE 32
 #define BLAKE160_SIZE 20
@@ -17,7 +18,6 @@
 /* 32 KB */
 #define WITNESS_SIZE 32768
 #define SCRIPT_SIZE 32768
-#define ONE_BATCH_SIZE 16384
 #define INPUT_SIZE 4096
 
 #define ERROR_ARGUMENTS_LEN -1
@@ -64,64 +64,22 @@
 #define MASK_OUTPOINT_SINCE 0x4
 #define MASK_OUTPOINT_ALL 0xFF
 
-// Extract lock from WitnessArgs
-int extract_witness_lock(uint8_t *witness, uint64_t len,
-                         mol_seg_t *lock_bytes_seg) {
-  mol_seg_t witness_seg;
-  witness_seg.ptr = witness;
-  witness_seg.size = len;
-
-  if (MolReader_WitnessArgs_verify(&witness_seg, false) != MOL_OK) {
-    return ERROR_ENCODING;
-  }
-  mol_seg_t lock_seg = MolReader_WitnessArgs_get_lock(&witness_seg);
-
-  if (MolReader_BytesOpt_is_none(&lock_seg)) {
-    return ERROR_ENCODING;
-  }
-  *lock_bytes_seg = MolReader_Bytes_raw_bytes(&lock_seg);
-  return CKB_SUCCESS;
+int hash_cell_data(CkbSighashAllCtx *ctx, size_t index_code, size_t source) {
+  return ckb_sighash_all_load_and_hash(ctx, ckb_load_cell_data, 0, index_code,
+                                       source, false);
 }
 
-typedef int (*load_function)(void *, uint64_t *, size_t, size_t, size_t);
-
-int load_and_hash(blake2b_state *ctx, size_t index_code, size_t source,
-                  load_function f) {
-  uint8_t temp[ONE_BATCH_SIZE];
-  uint64_t len = ONE_BATCH_SIZE;
-  int ret = f(temp, &len, 0, index_code, source);
-  if (ret != CKB_SUCCESS) {
-    return ret;
-  }
-  uint64_t offset = (len > ONE_BATCH_SIZE) ? ONE_BATCH_SIZE : len;
-  blake2b_update(ctx, temp, offset);
-  while (offset < len) {
-    uint64_t current_len = ONE_BATCH_SIZE;
-    ret = f(temp, &current_len, offset, index_code, source);
-    if (ret != CKB_SUCCESS) {
-      return ret;
-    }
-    uint64_t current_read =
-        (current_len > ONE_BATCH_SIZE) ? ONE_BATCH_SIZE : current_len;
-    blake2b_update(ctx, temp, current_read);
-    offset += current_read;
-  }
-  return CKB_SUCCESS;
-}
-
-int hash_cell_data(blake2b_state *ctx, size_t index_code, size_t source) {
-  return load_and_hash(ctx, index_code, source, ckb_load_cell_data);
+int hash_cell(CkbSighashAllCtx *ctx, size_t index_code, size_t source) {
+  return ckb_sighash_all_load_and_hash(ctx, ckb_load_cell, 0, index_code,
+                                       source, false);
 }
 
-int hash_cell(blake2b_state *ctx, size_t index_code, size_t source) {
-  return load_and_hash(ctx, index_code, source, ckb_load_cell);
+int hash_input(CkbSighashAllCtx *ctx, size_t index_code, size_t source) {
+  return ckb_sighash_all_load_and_hash(ctx, ckb_load_input, 0, index_code,
+                                       source, false);
 }
 
-int hash_input(blake2b_state *ctx, size_t index_code, size_t source) {
-  return load_and_hash(ctx, index_code, source, ckb_load_input);
-}
-
-int hash_script_fields(blake2b_state *ctx, size_t index_code, size_t source,
+int hash_script_fields(CkbSighashAllCtx *ctx, size_t index_code, size_t source,
                        size_t field, uint8_t lock_masks) {
   unsigned char script[SCRIPT_SIZE];
   uint64_t len = SCRIPT_SIZE;
@@ -139,53 +97,49 @@ int hash_script_fields(blake2b_state *ctx, size_t index_code, size_t source,
 
   if ((lock_masks & MASK_CELL_LOCK_CODE_HASH) != 0) {
     mol_seg_t item_seg = MolReader_Script_get_code_hash(&script_seg);
-    blake2b_update(ctx, item_seg.ptr, item_seg.size);
+    ckb_sighash_all_update(ctx, item_seg.ptr, item_seg.size);
   }
   if ((lock_masks & MASK_CELL_LOCK_ARGS) != 0) {
     mol_seg_t item_seg = MolReader_Script_get_args(&script_seg);
-    blake2b_update(ctx, item_seg.ptr, item_seg.size);
+    ckb_sighash_all_update(ctx, item_seg.ptr, item_seg.size);
   }
   if ((lock_masks & MASK_CELL_LOCK_HASH_TYPE) != 0) {
     mol_seg_t item_seg = MolReader_Script_get_hash_type(&script_seg);
-    blake2b_update(ctx, item_seg.ptr, item_seg.size);
+    ckb_sighash_all_update(ctx, item_seg.ptr, item_seg.size);
   }
 
   return CKB_SUCCESS;
 }
 
 int main() {
-  unsigned char witness[WITNESS_SIZE];
+  CKB_TRACE_SCOPE("open_transaction");
+  // The head of first witness stays pinned in temp until the message is
+  // finalized, the rest of temp is used for streaming.
+  uint8_t temp[WITNESS_SIZE];
+  CkbSighashAllCtx sighash_ctx;
+  ckb_sighash_all_init(&sighash_ctx, temp, WITNESS_SIZE);
+
   // Load witness of first input
-  uint64_t witness_len = WITNESS_SIZE;
-  int ret =
-      ckb_load_witness(witness, &witness_len, 0, 0, CKB_SOURCE_GROUP_INPUT);
+  CkbSighashAllFirstWitness first_witness;
+  int ret = ckb_sighash_all_load_first_witness(&sighash_ctx, &first_witness);
+  if (ret == CKB_SIGHASH_ALL_ERROR_ENCODING) {
+    return ERROR_ENCODING;
+  }
   if (ret != CKB_SUCCESS) {
     return ERROR_SYSCALL;
   }
-  if (witness_len > WITNESS_SIZE) {
-    return ERROR_WITNESS_SIZE;
-  }
-
-  // Parse and process sighash coverage array
-  mol_seg_t lock_bytes_seg;
-  ret = extract_witness_lock(witness, witness_len, &lock_bytes_seg);
-  if (ret != 0) {
-    return ERROR_ENCODING;
-  }
 
   // Open transaction witness should at least have a signature, and a sighash
   // coverage array that contains at least one item.
-  if (lock_bytes_seg.size <= SIGNATURE_SIZE) {
+  if (first_witness.lock_len <= SIGNATURE_SIZE) {
     return ERROR_ARGUMENTS_LEN;
   }
 
   // For security reasons, we will need to hash all inputs from the current
   // script group.
-  blake2b_state blake2b_ctx;
-  blake2b_init(&blake2b_ctx, BLAKE2B_BLOCK_SIZE);
   size_t i = 0;
   while (1) {
-    ret = hash_input(&blake2b_ctx, i, CKB_SOURCE_GROUP_INPUT);
+    ret = hash_input(&sighash_ctx, i, CKB_SOURCE_GROUP_INPUT);
     if (ret == CKB_INDEX_OUT_OF_BOUND) {
       break;
     }
@@ -194,16 +148,17 @@ int main() {
     }
     i += 1;
   }
+  CKB_TRACE("inputs");
 
   // Process sighash coverage array
-  uint8_t *sighash_array = (uint8_t *)lock_bytes_seg.ptr;
+  const uint8_t *sighash_array = first_witness.lock;
   i = 0;
   int has_more = 1;
   while (has_more) {
-    if (i + 3 > lock_bytes_seg.size) {
+    if (i + 3 > first_witness.lock_len) {
       return ERROR_INVALID_LABEL;
     }
-    uint8_t *tx_component = &sighash_array[(i++) * 3];
+    const uint8_t *tx_component = &sighash_array[(i++) * 3];
     uint8_t label = tx_component[0] >> 4;
     uint16_t index_code =
         (((uint16_t)(tx_component[0] & 0xF)) << 8) | tx_component[1];
@@ -211,16 +166,10 @@ int main() {
 
     switch (label) {
       case LABEL_SIGHASH_ALL: {
-        unsigned char tx_hash[BLAKE2B_BLOCK_SIZE];
-        uint64_t len = BLAKE2B_BLOCK_SIZE;
-        ret = ckb_load_tx_hash(tx_hash, &len, 0);
+        ret = ckb_sighash_all_hash_tx_hash(&sighash_ctx);
         if (ret != CKB_SUCCESS) {
-          return ret;
-        }
-        if (len != BLAKE2B_BLOCK_SIZE) {
           return ERROR_SYSCALL;
         }
-        blake2b_update(&blake2b_ctx, tx_hash, BLAKE2B_BLOCK_SIZE);
       } break;
       case LABEL_OUTPUT:
       case LABEL_INPUT_CELL:
@@ -228,11 +177,11 @@ int main() {
         size_t source =
             (label == LABEL_OUTPUT) ? CKB_SOURCE_OUTPUT : CKB_SOURCE_INPUT;
         if (mask == MASK_CELL_ALL) {
-          ret = hash_cell(&blake2b_ctx, index_code, source);
+          ret = hash_cell(&sighash_ctx, index_code, source);
           if (ret != CKB_SUCCESS) {
             return ret;
           }
-          ret = hash_cell_data(&blake2b_ctx, index_code, source);
+          ret = hash_cell_data(&sighash_ctx, index_code, source);
           if (ret != CKB_SUCCESS) {
             return ret;
           }
@@ -246,7 +195,7 @@ int main() {
             if (ret != CKB_SUCCESS) {
               return ret;
             }
-            blake2b_update(&blake2b_ctx, (uint8_t *)(&capacity), 8);
+            ckb_sighash_all_update(&sighash_ctx, (uint8_t *)(&capacity), 8);
           }
           if ((mask & MASK_CELL_ANY_TYPE) != 0) {
             uint8_t lock_masks = 0;
@@ -259,21 +208,21 @@ int main() {
             if ((mask & MASK_CELL_TYPE_HASH_TYPE) != 0) {
               lock_masks |= MASK_CELL_LOCK_HASH_TYPE;
             }
-            ret = hash_script_fields(&blake2b_ctx, index_code, source,
+            ret = hash_script_fields(&sighash_ctx, index_code, source,
                                      CKB_CELL_FIELD_TYPE, lock_masks);
             if (ret != CKB_SUCCESS) {
               return ret;
             }
           }
           if ((mask & MASK_CELL_ANY_LOCK) != 0) {
-            ret = hash_script_fields(&blake2b_ctx, index_code, source,
+            ret = hash_script_fields(&sighash_ctx, index_code, source,
                                      CKB_CELL_FIELD_LOCK, mask);
             if (ret != CKB_SUCCESS) {
               return ret;
             }
           }
           if ((mask & MASK_CELL_DATA) != 0) {
-            ret = hash_cell_data(&blake2b_ctx, index_code, source);
+            ret = hash_cell_data(&sighash_ctx, index_code, source);
             if (ret != CKB_SUCCESS) {
               return ret;
             }
@@ -287,12 +236,12 @@ int main() {
           if (ret != CKB_SUCCESS) {
             return ret;
           }
-          blake2b_update(&blake2b_ctx, since, 8);
+          ckb_sighash_all_update(&sighash_ctx, since, 8);
         }
       } break;
       case LABEL_INPUT_OUTPOINT: {
         if (mask == MASK_OUTPOINT_ALL) {
-          ret = hash_input(&blake2b_ctx, index_code, CKB_SOURCE_INPUT);
+          ret = hash_input(&sighash_ctx, index_code, CKB_SOURCE_INPUT);
           if (ret != CKB_SUCCESS) {
             return ret;
           }
@@ -306,7 +255,7 @@ int main() {
             if (ret != CKB_SUCCESS) {
               return ret;
             }
-            blake2b_update(&blake2b_ctx, since, 8);
+            ckb_sighash_all_update(&sighash_ctx, since, 8);
           }
 
           uint8_t input_buf[INPUT_SIZE];
@@ -327,11 +276,13 @@ int main() {
           if ((mask & MASK_OUTPOINT_TX_HASH) != 0) {
             mol_seg_t tx_hash_seg =
                 MolReader_OutPoint_get_tx_hash(&outpoint_seg);
-            blake2b_update(&blake2b_ctx, tx_hash_seg.ptr, tx_hash_seg.size);
+            ckb_sighash_all_update(&sighash_ctx, tx_hash_seg.ptr,
+                                   tx_hash_seg.size);
           }
           if ((mask & MASK_OUTPOINT_INDEX) != 0) {
             mol_seg_t index_seg = MolReader_OutPoint_get_tx_hash(&index_seg);
-            blake2b_update(&blake2b_ctx, index_seg.ptr, index_seg.size);
+            ckb_sighash_all_update(&sighash_ctx, index_seg.ptr,
+                                   index_seg.size);
           }
         }
       } break;
@@ -343,66 +294,38 @@ int main() {
     }
   }
 
+  CKB_TRACE("coverage");
+
   size_t sighash_array_length = i * 3;
-  if (lock_bytes_seg.size != sighash_array_length + SIGNATURE_SIZE) {
+  if (first_witness.lock_len != sighash_array_length + SIGNATURE_SIZE) {
     return ERROR_ARGUMENTS_LEN;
   }
-  uint8_t signature_bytes[SIGNATURE_SIZE];
-  memcpy(signature_bytes, &lock_bytes_seg.ptr[sighash_array_length],
-         SIGNATURE_SIZE);
-  // Clear lock field to zero, then digest the first witness
-  memset((void *)(&lock_bytes_seg.ptr[sighash_array_length]), 0,
-         SIGNATURE_SIZE);
-  blake2b_update(&blake2b_ctx, (char *)&witness_len, sizeof(uint64_t));
-  blake2b_update(&blake2b_ctx, witness, witness_len);
-
-  uint8_t temp[WITNESS_SIZE];
-  // Digest same group witnesses
-  i = 1;
-  while (1) {
-    uint64_t len = WITNESS_SIZE;
-    ret = ckb_load_witness(temp, &len, 0, i, CKB_SOURCE_GROUP_INPUT);
-    if (ret == CKB_INDEX_OUT_OF_BOUND) {
-      break;
-    }
-    if (ret != CKB_SUCCESS) {
-      return ERROR_SYSCALL;
-    }
-    if (len > WITNESS_SIZE) {
-      return ERROR_WITNESS_SIZE;
-    }
-    blake2b_update(&blake2b_ctx, (char *)&len, sizeof(uint64_t));
-    blake2b_update(&blake2b_ctx, temp, len);
-    i += 1;
+  const uint8_t *signature_bytes = &first_witness.lock[sighash_array_length];
+  // Only the signature part of lock field is digested as zeros
+  first_witness.zero_offset = first_witness.lock_offset + sighash_array_length;
+  first_witness.zero_len = SIGNATURE_SIZE;
+  ret = ckb_sighash_all_hash_first_witness(&sighash_ctx, &first_witness);
+  if (ret != CKB_SUCCESS) {
+    return ERROR_SYSCALL;
   }
-  // Digest witnesses that not covered by inputs
-  i = ckb_calculate_inputs_len();
-  while (1) {
-    uint64_t len = WITNESS_SIZE;
-    ret = ckb_load_witness(temp, &len, 0, i, CKB_SOURCE_INPUT);
-    if (ret == CKB_INDEX_OUT_OF_BOUND) {
-      break;
-    }
-    if (ret != CKB_SUCCESS) {
-      return ERROR_SYSCALL;
-    }
-    if (len > WITNESS_SIZE) {
-      return ERROR_WITNESS_SIZE;
-    }
-    blake2b_update(&blake2b_ctx, (char *)&len, sizeof(uint64_t));
-    blake2b_update(&blake2b_ctx, temp, len);
-    i += 1;
+
+  // Digest same group witnesses, then witnesses that not covered by inputs
+  ret = ckb_sighash_all_hash_remaining_witnesses(&sighash_ctx);
+  if (ret != CKB_SUCCESS) {
+    return ERROR_SYSCALL;
   }
   unsigned char message[BLAKE2B_BLOCK_SIZE];
-  blake2b_final(&blake2b_ctx, message, BLAKE2B_BLOCK_SIZE);
+  ckb_sighash_all_final(&sighash_ctx, message);
+  CKB_TRACE("message");
 
   // Load signature
   secp256k1_context context;
-  uint8_t secp_data[CKB_SECP256K1_DATA_SIZE];
-  ret = ckb_secp256k1_custom_load_data(secp_data);
+  uint8_t secp_data[CKB_SECP256K1_DATA_BUFFER_SIZE];
+  ret = ckb_secp256k1_custom_load_data_variant(secp_data);
   if (ret != 0) {
     return ret;
   }
+  CKB_TRACE("secp_data");
   ret = ckb_secp256k1_custom_verify_only_initialize(&context, secp_data);
   if (ret != 0) {
     return ret;
@@ -417,9 +340,11 @@ int main() {
 
   // Recover pubkey
   secp256k1_pubkey pubkey;
-  if (secp256k1_ecdsa_recover(&context, &pubkey, &signature, message) != 1) {
+  if (ckb_secp256k1_ecdsa_recover(&context, &pubkey, &signature, message) !=
+      1) {
     return ERROR_SECP_RECOVER_PUBKEY;
   }
+  CKB_TRACE("recover");
 
   // Check pubkey hash
   size_t pubkey_size = PUBKEY_SIZE;
@@ -428,9 +353,11 @@ int main() {
     return ERROR_SECP_SERIALIZE_PUBKEY;
   }
 
+  blake2b_state blake2b_ctx;
   blake2b_init(&blake2b_ctx, BLAKE2B_BLOCK_SIZE);
   blake2b_update(&blake2b_ctx, temp, pubkey_size);
   blake2b_final(&blake2b_ctx, temp, BLAKE2B_BLOCK_SIZE);
+  CKB_TRACE("pubkey_hash");
 
   // Load args
   unsigned char script[SCRIPT_SIZE];
@@ -449,6 +376,7 @@ int main() {
   if (MolReader_Script_verify(&script_seg, false) != MOL_OK) {
     return ERROR_ENCODING;
   }
+  CKB_TRACE("molecule");
 
   mol_seg_t args_seg = MolReader_Script_get_args(&script_seg);
   mol_seg_t args_bytes_seg = MolReader_Bytes_raw_bytes(&args_seg);
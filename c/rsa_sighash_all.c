@@ -24,6 +24,7 @@
 #else
 #include "ckb_syscalls.h"
 #endif
+#include "sighash_all_helper.h"
 #if defined(CKB_USE_SIM)
 #include <stdio.h>
 #define mbedtls_printf printf
@@ -34,10 +35,8 @@
 #define BLAKE2B_BLOCK_SIZE 32
 #define BLAKE160_SIZE 20
 /* 32 KB */
-#define MAX_WITNESS_SIZE 32768
 #define SCRIPT_SIZE 32768
 #define TEMP_SIZE 32768
-#define ONE_BATCH_SIZE 32768
 
 #define CKB_SUCCESS 0
 #define ERROR_ARGUMENTS_LEN (-1)
@@ -346,49 +345,6 @@ __attribute__((visibility("default"))) int validate_signature(
  * It mimic the behavior of validate_secp256k1_blake2b_sighash_all.
  */
 
-int load_and_hash_witness(blake2b_state *ctx, size_t index, size_t source) {
-  uint8_t temp[ONE_BATCH_SIZE];
-  uint64_t len = ONE_BATCH_SIZE;
-  int ret = ckb_load_witness(temp, &len, 0, index, source);
-  if (ret != CKB_SUCCESS) {
-    return ret;
-  }
-  blake2b_update(ctx, (char *)&len, sizeof(uint64_t));
-  uint64_t offset = (len > ONE_BATCH_SIZE) ? ONE_BATCH_SIZE : len;
-  blake2b_update(ctx, temp, offset);
-  while (offset < len) {
-    uint64_t current_len = ONE_BATCH_SIZE;
-    ret = ckb_load_witness(temp, &current_len, offset, index, source);
-    if (ret != CKB_SUCCESS) {
-      return ret;
-    }
-    uint64_t current_read =
-        (current_len > ONE_BATCH_SIZE) ? ONE_BATCH_SIZE : current_len;
-    blake2b_update(ctx, temp, current_read);
-    offset += current_read;
-  }
-  return CKB_SUCCESS;
-}
-
-// Extract lock from WitnessArgs
-int extract_witness_lock(uint8_t *witness, uint64_t len,
-                         mol_seg_t *lock_bytes_seg) {
-  mol_seg_t witness_seg;
-  witness_seg.ptr = witness;
-  witness_seg.size = len;
-
-  if (MolReader_WitnessArgs_verify(&witness_seg, false) != MOL_OK) {
-    return ERROR_ENCODING;
-  }
-  mol_seg_t lock_seg = MolReader_WitnessArgs_get_lock(&witness_seg);
-
-  if (MolReader_BytesOpt_is_none(&lock_seg)) {
-    return ERROR_ENCODING;
-  }
-  *lock_bytes_seg = MolReader_Bytes_raw_bytes(&lock_seg);
-  return CKB_SUCCESS;
-}
-
 int load_public_key_hash(unsigned char *public_key) {
   int ret;
   uint64_t len = 0;
@@ -457,97 +413,49 @@ cleanup:
 // using this script via as a library.
 __attribute__((visibility("default"))) int validate_rsa_sighash_all(
     uint8_t *output_public_key_hash) {
+  CKB_TRACE_SCOPE("rsa_sighash_all");
   int ret = ERROR_RSA_ONLY_INIT;
-  unsigned char first_witness[TEMP_SIZE];
-  uint64_t len = 0;
-
-  // Load witness of first input
-  uint64_t witness_len = MAX_WITNESS_SIZE;
-  ret = ckb_load_witness(first_witness, &witness_len, 0, 0,
-                         CKB_SOURCE_GROUP_INPUT);
+  unsigned char temp[TEMP_SIZE];
+  CkbSighashAllCtx sighash_ctx;
+  ckb_sighash_all_init(&sighash_ctx, temp, TEMP_SIZE);
+
+  // Load witness of first input, RSA info is read in place from lock
+  CkbSighashAllFirstWitness first_witness;
+  ret = ckb_sighash_all_load_first_witness(&sighash_ctx, &first_witness);
+  if (ret == CKB_SIGHASH_ALL_ERROR_ENCODING) {
+    return ERROR_ENCODING;
+  }
   if (ret != CKB_SUCCESS) {
     return ERROR_SYSCALL;
   }
 
-  if (witness_len > MAX_WITNESS_SIZE) {
-    return ERROR_WITNESS_SIZE;
-  }
-
-  // load signature
-  mol_seg_t lock_bytes_seg;
-  ret = extract_witness_lock(first_witness, witness_len, &lock_bytes_seg);
-  if (ret != 0) {
-    return ERROR_ENCODING;
-  }
-
-  uint32_t key_size = ((RsaInfo *)lock_bytes_seg.ptr)->key_size;
-  uint32_t info_len = calculate_rsa_info_length(key_size);
-  if (lock_bytes_seg.size != info_len) {
-    return ERROR_ARGUMENTS_LEN;
-  }
   // RSA signature size is different than secp256k1
   // secp256k1 use 65 bytes as signature but RSA actually has dynamic size
   // depending on key size.
-  unsigned char rsa_info[info_len];
-  memcpy(rsa_info, lock_bytes_seg.ptr, lock_bytes_seg.size);
-
-  // Load tx hash
-  unsigned char tx_hash[BLAKE2B_BLOCK_SIZE];
-  len = BLAKE2B_BLOCK_SIZE;
-  ret = ckb_load_tx_hash(tx_hash, &len, 0);
-  if (ret != CKB_SUCCESS) {
-    return ret;
-  }
-  if (len != BLAKE2B_BLOCK_SIZE) {
-    return ERROR_SYSCALL;
+  const uint8_t *rsa_info = first_witness.lock;
+  uint32_t key_size = ((RsaInfo *)rsa_info)->key_size;
+  uint32_t info_len = calculate_rsa_info_length(key_size);
+  if (first_witness.lock_len != info_len) {
+    return ERROR_ARGUMENTS_LEN;
   }
 
   // Prepare sign message
   // message = hash(tx_hash + first_witness_len + first_witness +
   // other_witness(with length))
+  // Lock field is digested as zeros. Note, the molecule header (4 byte with
+  // content SIGNATURE_SIZE) is kept. That means, SIGNATURE_SIZE should be
+  // always the same value.
   unsigned char message[BLAKE2B_BLOCK_SIZE];
-  blake2b_state blake2b_ctx;
-  blake2b_init(&blake2b_ctx, BLAKE2B_BLOCK_SIZE);
-  blake2b_update(&blake2b_ctx, tx_hash, BLAKE2B_BLOCK_SIZE);
-
-  // Clear lock field to zero. Note, the molecule header (4 byte with content
-  // SIGNATURE_SIZE) is not cleared. That means, SIGNATURE_SIZE should be always
-  // the same value.
-  memset((void *)lock_bytes_seg.ptr, 0, lock_bytes_seg.size);
-  // digest the first witness
-  blake2b_update(&blake2b_ctx, (char *)&witness_len, sizeof(witness_len));
-  blake2b_update(&blake2b_ctx, first_witness, witness_len);
-
-  // Digest same group witnesses
-  size_t i = 1;
-  while (1) {
-    ret = load_and_hash_witness(&blake2b_ctx, i, CKB_SOURCE_GROUP_INPUT);
-    if (ret == CKB_INDEX_OUT_OF_BOUND) {
-      break;
-    }
-    if (ret != CKB_SUCCESS) {
-      return ERROR_SYSCALL;
-    }
-    i += 1;
-  }
-  // Digest witnesses that not covered by inputs
-  i = ckb_calculate_inputs_len();
-  while (1) {
-    ret = load_and_hash_witness(&blake2b_ctx, i, CKB_SOURCE_INPUT);
-    if (ret == CKB_INDEX_OUT_OF_BOUND) {
-      break;
-    }
-    if (ret != CKB_SUCCESS) {
-      return ERROR_SYSCALL;
-    }
-    i += 1;
+  ret = ckb_sighash_all_calculate(&sighash_ctx, &first_witness, message);
+  if (ret != CKB_SUCCESS) {
+    return ERROR_SYSCALL;
   }
-  blake2b_final(&blake2b_ctx, message, BLAKE2B_BLOCK_SIZE);
 
   size_t pub_key_hash_size = BLAKE160_SIZE;
   int result = validate_signature(NULL, (const uint8_t *)rsa_info, info_len,
                                   (const uint8_t *)message, BLAKE2B_BLOCK_SIZE,
                                   output_public_key_hash, &pub_key_hash_size);
+  CKB_TRACE("signature");
   if (result == 0) {
     mbedtls_printf("validate signature passed\n");
   } else {
@@ -0,0 +1,258 @@
+/*
+ * An M of N multisig lock script built on the secp256k1-blake160-sighash-all
+ * dual library.
+ *
+ * The sighash-all message is computed once for all signatures, and the
+ * secp256k1 table is loaded once, into a buffer of this script, via
+ * load_shared_prefilled_data of the dual library. Each ECDSA signature then
+ * costs one validate_signature call, Schnorr signatures are checked together
+ * by one validate_signatures call. Compared to nesting or/and scripts,
+ * witnesses are not rehashed and the secp256k1 code is not loaded once per
+ * signer.
+ *
+ * Arguments:
+ * * 1 byte threshold M
+ * * 1 byte pubkey count N, 1 <= M <= N
+ * * N 20-byte blake160 pubkey hashes, sorted in ascending order
+ *
+ * Witness:
+ * WitnessArgs with up to N signatures in lock field, ordered by the pubkey
+ * hashes they belong to. The whole lock field is digested as zeros in the
+ * message. Signatures are either:
+ * * 65-byte recoverable ECDSA signatures, checked in order until M of them
+ *   match a distinct pubkey hash, a signature matching no remaining pubkey
+ *   hash is skipped.
+ * * 97-byte BIP340 Schnorr signatures in the layout of the dual library,
+ *   see SCHNORR_SIGNATURE_SIZE in secp256k1_blake2b_sighash_all_dual.c:
+ *   algorithm id 0x80, 32-byte x-only pubkey and 64-byte signature. The
+ *   pubkey hash is blake160 of 0x02 | x-only pubkey. All signatures are
+ *   checked by one batch verification, then M of them must match distinct
+ *   pubkey hashes.
+ *   A lock field is read as Schnorr signatures when its length is a multiple
+ *   of 97 and every item starts with the algorithm id.
+ */
+#include "blake2b.h"
+#include "blockchain.h"
+#include "ckb_dlfcn.h"
+#include "ckb_syscalls.h"
+#include "ckb_utils.h"
+#include "secp256k1_blake2b_sighash_all_dual.h"
+#include "sighash_all_helper.h"
+
+#define ERROR_ARGUMENTS_LEN -1
+#define ERROR_ENCODING -2
+#define ERROR_SYSCALL -3
+#define ERROR_SCRIPT_TOO_LONG -21
+#define ERROR_WITNESS_SIZE -22
+#define ERROR_INVALID_THRESHOLD -51
+#define ERROR_UNSORTED_PUBKEY_HASHES -52
+#define ERROR_THRESHOLD_NOT_REACHED -53
+#define ERROR_DYNAMIC_LOADING -103
+
+#define BLAKE2B_BLOCK_SIZE 32
+#define BLAKE160_SIZE 20
+#define PUBKEY_SIZE 33
+#define SIGNATURE_SIZE 65
+#define SCHNORR_ALGORITHM_ID 0x80
+#define SCHNORR_SIGNATURE_SIZE 97
+#define MESSAGE_SIZE 32
+#define MULTISIG_HEADER_SIZE 2
+#define SCRIPT_SIZE 32768
+#define TEMP_SIZE 32768
+
+#define DUAL_CODE_SIZE (256 * 1024)
+static uint8_t dual_code_buffer[DUAL_CODE_SIZE]
+    __attribute__((aligned(RISCV_PGSIZE)));
+
+/*
+ * Owned by this script and filled by the dual library: a 16 byte header
+ * followed by the secp256k1 table, 1 MB for the full window. The dual
+ * library rejects a buffer too small for the table found in cell deps.
+ */
+#define PREFILLED_DATA_SIZE (1024 * 1024 + 16)
+static uint8_t prefilled_data[PREFILLED_DATA_SIZE];
+
+typedef int (*load_shared_prefilled_data_t)(void *data, size_t *len);
+typedef int (*validate_signature_t)(void *prefilled_data,
+                                    const uint8_t *signature_buffer,
+                                    size_t signature_size,
+                                    const uint8_t *message_buffer,
+                                    size_t message_size, uint8_t *output,
+                                    size_t *output_len);
+typedef int (*validate_signatures_t)(void *prefilled_data,
+                                     const uint8_t *signatures,
+                                     size_t signature_size,
+                                     const uint8_t *messages,
+                                     size_t message_size, size_t count,
+                                     uint8_t *output, size_t *output_len);
+
+// Returns 1 when blake160 of pubkey is found in pubkey_hashes from
+// *next_pubkey on. Each pubkey hash is matched at most once, as both
+// signatures and pubkey hashes are sorted.
+static size_t match_pubkey(const uint8_t *pubkey_hashes, size_t pubkeys_cnt,
+                           const uint8_t *pubkey, size_t pubkey_size,
+                           size_t *next_pubkey) {
+  uint8_t hash[BLAKE2B_BLOCK_SIZE];
+  blake2b_state blake2b_ctx;
+  blake2b_init(&blake2b_ctx, BLAKE2B_BLOCK_SIZE);
+  blake2b_update(&blake2b_ctx, pubkey, pubkey_size);
+  blake2b_final(&blake2b_ctx, hash, BLAKE2B_BLOCK_SIZE);
+
+  for (size_t j = *next_pubkey; j < pubkeys_cnt; j++) {
+    if (memcmp(&pubkey_hashes[j * BLAKE160_SIZE], hash, BLAKE160_SIZE) == 0) {
+      *next_pubkey = j + 1;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int is_schnorr_lock(const uint8_t *lock, size_t lock_len) {
+  if (lock_len == 0 || lock_len % SCHNORR_SIGNATURE_SIZE != 0) {
+    return 0;
+  }
+  for (size_t i = 0; i < lock_len; i += SCHNORR_SIGNATURE_SIZE) {
+    if (lock[i] != SCHNORR_ALGORITHM_ID) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int main() {
+  CKB_TRACE_SCOPE("secp256k1_blake2b_multisig");
+  unsigned char script[SCRIPT_SIZE];
+  uint64_t len = SCRIPT_SIZE;
+  int ret = ckb_load_script(script, &len, 0);
+  if (ret != CKB_SUCCESS) {
+    return ERROR_SYSCALL;
+  }
+  if (len > SCRIPT_SIZE) {
+    return ERROR_SCRIPT_TOO_LONG;
+  }
+  mol_seg_t script_seg;
+  script_seg.ptr = (uint8_t *)script;
+  script_seg.size = len;
+  if (MolReader_Script_verify(&script_seg, false) != MOL_OK) {
+    return ERROR_ENCODING;
+  }
+  mol_seg_t args_seg = MolReader_Script_get_args(&script_seg);
+  mol_seg_t args_bytes_seg = MolReader_Bytes_raw_bytes(&args_seg);
+  if (args_bytes_seg.size < MULTISIG_HEADER_SIZE) {
+    return ERROR_ARGUMENTS_LEN;
+  }
+  uint8_t threshold = args_bytes_seg.ptr[0];
+  uint8_t pubkeys_cnt = args_bytes_seg.ptr[1];
+  if (threshold == 0 || threshold > pubkeys_cnt) {
+    return ERROR_INVALID_THRESHOLD;
+  }
+  if (args_bytes_seg.size !=
+      MULTISIG_HEADER_SIZE + (size_t)pubkeys_cnt * BLAKE160_SIZE) {
+    return ERROR_ARGUMENTS_LEN;
+  }
+  const uint8_t *pubkey_hashes = &args_bytes_seg.ptr[MULTISIG_HEADER_SIZE];
+  for (size_t i = 1; i < pubkeys_cnt; i++) {
+    if (memcmp(&pubkey_hashes[(i - 1) * BLAKE160_SIZE],
+               &pubkey_hashes[i * BLAKE160_SIZE], BLAKE160_SIZE) >= 0) {
+      return ERROR_UNSORTED_PUBKEY_HASHES;
+    }
+  }
+  CKB_TRACE("molecule");
+
+  // Signatures are read in place from lock of the first witness
+  unsigned char temp[TEMP_SIZE];
+  CkbSighashAllCtx sighash_ctx;
+  ckb_sighash_all_init(&sighash_ctx, temp, TEMP_SIZE);
+  CkbSighashAllFirstWitness first_witness;
+  ret = ckb_sighash_all_load_first_witness(&sighash_ctx, &first_witness);
+  if (ret == CKB_SIGHASH_ALL_ERROR_ENCODING) {
+    return ERROR_ENCODING;
+  }
+  if (ret != CKB_SUCCESS) {
+    return ERROR_SYSCALL;
+  }
+  const uint8_t *signatures = first_witness.lock;
+  size_t signature_size = SIGNATURE_SIZE;
+  if (is_schnorr_lock(signatures, first_witness.lock_len)) {
+    signature_size = SCHNORR_SIGNATURE_SIZE;
+  }
+  size_t signatures_cnt = first_witness.lock_len / signature_size;
+  if (first_witness.lock_len % signature_size != 0 ||
+      signatures_cnt < threshold || signatures_cnt > pubkeys_cnt) {
+    return ERROR_WITNESS_SIZE;
+  }
+
+  unsigned char message[MESSAGE_SIZE];
+  ret = ckb_sighash_all_calculate(&sighash_ctx, &first_witness, message);
+  if (ret != CKB_SUCCESS) {
+    return ERROR_SYSCALL;
+  }
+
+  void *handle = NULL;
+  uint64_t consumed_size = 0;
+  ret = ckb_dlopen(secp256k1_blake2b_sighash_all_dual_data_hash,
+                   dual_code_buffer, DUAL_CODE_SIZE, &handle, &consumed_size);
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  load_shared_prefilled_data_t load_shared_prefilled_data;
+  *(void **)(&load_shared_prefilled_data) =
+      ckb_dlsym(handle, "load_shared_prefilled_data");
+  validate_signature_t validate_signature;
+  *(void **)(&validate_signature) = ckb_dlsym(handle, "validate_signature");
+  validate_signatures_t validate_signatures;
+  *(void **)(&validate_signatures) = ckb_dlsym(handle, "validate_signatures");
+  if (load_shared_prefilled_data == NULL || validate_signature == NULL ||
+      validate_signatures == NULL) {
+    return ERROR_DYNAMIC_LOADING;
+  }
+  CKB_TRACE("dlopen");
+
+  size_t prefilled_len = PREFILLED_DATA_SIZE;
+  ret = load_shared_prefilled_data(prefilled_data, &prefilled_len);
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  CKB_TRACE("secp_data");
+
+  size_t valid = 0;
+  size_t next_pubkey = 0;
+  if (signature_size == SCHNORR_SIGNATURE_SIZE) {
+    uint8_t messages[MESSAGE_SIZE * 255];
+    uint8_t pubkeys[PUBKEY_SIZE * 255];
+    for (size_t i = 0; i < signatures_cnt; i++) {
+      memcpy(&messages[i * MESSAGE_SIZE], message, MESSAGE_SIZE);
+    }
+    size_t pubkeys_size = sizeof(pubkeys);
+    ret = validate_signatures(prefilled_data, signatures, signature_size,
+                              messages, MESSAGE_SIZE, signatures_cnt, pubkeys,
+                              &pubkeys_size);
+    if (ret != CKB_SUCCESS) {
+      return ret;
+    }
+    for (size_t i = 0; i < signatures_cnt; i++) {
+      valid += match_pubkey(pubkey_hashes, pubkeys_cnt,
+                            &pubkeys[i * PUBKEY_SIZE], PUBKEY_SIZE,
+                            &next_pubkey);
+    }
+  } else {
+    for (size_t i = 0; i < signatures_cnt && valid < threshold; i++) {
+      uint8_t pubkey[PUBKEY_SIZE];
+      size_t pubkey_size = PUBKEY_SIZE;
+      ret = validate_signature(prefilled_data, &signatures[i * signature_size],
+                               signature_size, message, MESSAGE_SIZE, pubkey,
+                               &pubkey_size);
+      if (ret != CKB_SUCCESS) {
+        continue;
+      }
+      valid += match_pubkey(pubkey_hashes, pubkeys_cnt, pubkey, pubkey_size,
+                            &next_pubkey);
+    }
+  }
+  CKB_TRACE("signatures");
+
+  if (valid < threshold) {
+    return ERROR_THRESHOLD_NOT_REACHED;
+  }
+  return CKB_SUCCESS;
+}
@@ -23,17 +23,34 @@
 #include "ckb_dlfcn.h"
 #include "ckb_utils.h"
 #include "secp256k1_helper.h"
+#include "secp256k1_schnorr_helper.h"
+#include "sighash_all_helper.h"
 
 #define BLAKE2B_BLOCK_SIZE 32
 #define BLAKE160_SIZE 20
 #define PUBKEY_SIZE 33
 #define RECID_INDEX 64
 #define SIGNATURE_SIZE 65
-/* 32 KB */
-#define MAX_WITNESS_SIZE 32768
+// Signature layouts of this library, other scripts building on it should
+// refer here:
+// * SIGNATURE_SIZE, 65 bytes: recoverable ECDSA signature, r | s | recid.
+//   Accepted by validate_signature(s) and as lock of the standalone script.
+// * PUBKEY_SIGNATURE_SIZE, 97 bytes: 33 byte compressed pubkey, starting with
+//   0x02 or 0x03, then a 64 byte ECDSA signature r | s. Only accepted as lock
+//   of the standalone script.
+// * SCHNORR_SIGNATURE_SIZE, 97 bytes: SCHNORR_ALGORITHM_ID, 32 byte x-only
+//   pubkey, then a 64 byte BIP340 signature R.x | s. Only accepted by
+//   validate_signature(s).
+// Both 97 byte layouts are told apart by their first byte:
+// SCHNORR_ALGORITHM_ID has its high bit set, so it is never a SEC1 pubkey
+// prefix.
+#define PUBKEY_SIGNATURE_SIZE (PUBKEY_SIZE + 64)
+#define SCHNORR_ALGORITHM_ID 0x80
+#define SCHNORR_SIGNATURE_SIZE \
+  (1 + CKB_SCHNORR_PUBKEY_SIZE + CKB_SCHNORR_SIGNATURE_SIZE)
+
 #define SCRIPT_SIZE 32768
 #define TEMP_SIZE 32768
-#define ONE_BATCH_SIZE 32768
 
 #define ERROR_ARGUMENTS_LEN -1
 #define ERROR_ENCODING -2
@@ -51,68 +68,129 @@
 #define ERROR_INVALID_MESSAGE_SIZE -43
 #define ERROR_INVALID_OUTPUT_SIZE -44
 
-int load_and_hash_witness(blake2b_state *ctx, size_t index, size_t source) {
-  uint8_t temp[ONE_BATCH_SIZE];
-  uint64_t len = ONE_BATCH_SIZE;
-  int ret = ckb_load_witness(temp, &len, 0, index, source);
+__attribute__((visibility("default"))) int load_prefilled_data(void *data,
+                                                               size_t *len) {
+  if ((*len) < CKB_SECP256K1_DATA_SIZE) {
+    *len = CKB_SECP256K1_DATA_SIZE;
+    return ERROR_INVALID_PREFILLED_DATA_SIZE;
+  }
+  int ret = ckb_secp256k1_custom_load_data(data);
   if (ret != CKB_SUCCESS) {
     return ret;
   }
-  blake2b_update(ctx, (char *)&len, sizeof(uint64_t));
-  uint64_t offset = (len > ONE_BATCH_SIZE) ? ONE_BATCH_SIZE : len;
-  blake2b_update(ctx, temp, offset);
-  while (offset < len) {
-    uint64_t current_len = ONE_BATCH_SIZE;
-    ret = ckb_load_witness(temp, &current_len, offset, index, source);
+  *len = CKB_SECP256K1_DATA_SIZE;
+  return CKB_SUCCESS;
+}
+
+// Same as load_prefilled_data, except that any window variant of the table
+// found in cell deps is accepted. The data starts with a small header
+// carrying the window, so the buffer should be CKB_SECP256K1_DATA_BUFFER_SIZE
+// big, and is accepted by validate_signature as prefilled data just like the
+// one filled by load_prefilled_data.
+__attribute__((visibility("default"))) int load_prefilled_data_variant(
+    void *data, size_t *len) {
+  if ((*len) < CKB_SECP256K1_DATA_BUFFER_SIZE) {
+    *len = CKB_SECP256K1_DATA_BUFFER_SIZE;
+    return ERROR_INVALID_PREFILLED_DATA_SIZE;
+  }
+  int ret = ckb_secp256k1_custom_load_data_variant(data);
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  *len = CKB_SECP256K1_DATA_BUFFER_SIZE;
+  return CKB_SUCCESS;
+}
+
+// Buffer last filled by load_shared_prefilled_data, and the context
+// initialized over it. Only the pointer and the context live in this library,
+// the table itself stays in the caller's buffer.
+static void *shared_prefilled_data = NULL;
+static secp256k1_context shared_context;
+
+// Same as load_prefilled_data_variant, except that the context over the
+// table is also initialized here and kept for data, so validate_signature(s)
+// calls passing data as prefilled data skip initializing their own. Calling
+// it again with the same data returns without loading the table again, so
+// several consumers of one dlopened copy of this library can share a single
+// load. The caller owns data and must leave it untouched while it is in use.
+__attribute__((visibility("default"))) int load_shared_prefilled_data(
+    void *data, size_t *len) {
+  if ((*len) < CKB_SECP256K1_DATA_BUFFER_SIZE) {
+    *len = CKB_SECP256K1_DATA_BUFFER_SIZE;
+    return ERROR_INVALID_PREFILLED_DATA_SIZE;
+  }
+  if (data != shared_prefilled_data) {
+    shared_prefilled_data = NULL;
+    int ret = ckb_secp256k1_custom_load_data_variant(data);
     if (ret != CKB_SUCCESS) {
       return ret;
     }
-    uint64_t current_read =
-        (current_len > ONE_BATCH_SIZE) ? ONE_BATCH_SIZE : current_len;
-    blake2b_update(ctx, temp, current_read);
-    offset += current_read;
+    ret = ckb_secp256k1_custom_verify_only_initialize(&shared_context, data);
+    if (ret != 0) {
+      return ret;
+    }
+    shared_prefilled_data = data;
   }
+  *len = CKB_SECP256K1_DATA_BUFFER_SIZE;
   return CKB_SUCCESS;
 }
 
-// Extract lock from WitnessArgs
-int extract_witness_lock(uint8_t *witness, uint64_t len,
-                         mol_seg_t *lock_bytes_seg) {
-  mol_seg_t witness_seg;
-  witness_seg.ptr = witness;
-  witness_seg.size = len;
+// Picks the shared context when prefilled data is the buffer last filled by
+// load_shared_prefilled_data, otherwise initializes local_context over it.
+static int prefilled_context(void *prefilled_data,
+                             secp256k1_context *local_context,
+                             secp256k1_context **context) {
+  if (prefilled_data != NULL && prefilled_data == shared_prefilled_data) {
+    *context = &shared_context;
+    return CKB_SUCCESS;
+  }
+  *context = local_context;
+  return ckb_secp256k1_custom_verify_only_initialize(local_context,
+                                                     prefilled_data);
+}
 
-  if (MolReader_WitnessArgs_verify(&witness_seg, false) != MOL_OK) {
-    return ERROR_ENCODING;
+static int recover_pubkey(secp256k1_context *context,
+                          const uint8_t *signature_buffer,
+                          const uint8_t *message_buffer, uint8_t *output) {
+  secp256k1_ecdsa_recoverable_signature signature;
+  if (secp256k1_ecdsa_recoverable_signature_parse_compact(
+          context, &signature, signature_buffer,
+          signature_buffer[RECID_INDEX]) == 0) {
+    return ERROR_SECP_PARSE_SIGNATURE;
   }
-  mol_seg_t lock_seg = MolReader_WitnessArgs_get_lock(&witness_seg);
 
-  if (MolReader_BytesOpt_is_none(&lock_seg)) {
-    return ERROR_ENCODING;
+  secp256k1_pubkey pubkey;
+  if (ckb_secp256k1_ecdsa_recover(context, &pubkey, &signature,
+                                  message_buffer) != 1) {
+    return ERROR_SECP_RECOVER_PUBKEY;
   }
-  *lock_bytes_seg = MolReader_Bytes_raw_bytes(&lock_seg);
-  return CKB_SUCCESS;
-}
 
-__attribute__((visibility("default"))) int load_prefilled_data(void *data,
-                                                               size_t *len) {
-  if ((*len) < CKB_SECP256K1_DATA_SIZE) {
-    *len = CKB_SECP256K1_DATA_SIZE;
-    return ERROR_INVALID_PREFILLED_DATA_SIZE;
-  }
-  int ret = ckb_secp256k1_custom_load_data(data);
-  if (ret != CKB_SUCCESS) {
-    return ret;
+  size_t pubkey_size = PUBKEY_SIZE;
+  if (secp256k1_ec_pubkey_serialize(context, output, &pubkey_size, &pubkey,
+                                    SECP256K1_EC_COMPRESSED) != 1) {
+    return ERROR_SECP_SERIALIZE_PUBKEY;
   }
-  *len = CKB_SECP256K1_DATA_SIZE;
   return CKB_SUCCESS;
 }
 
+// Output of a Schnorr signature is the compressed form of its x-only pubkey,
+// which always has an even y, so callers can hash it as an ECDSA one.
+static void schnorr_output_pubkey(const uint8_t *signature_buffer,
+                                  uint8_t *output) {
+  output[0] = 0x02;
+  memcpy(&output[1], &signature_buffer[1], CKB_SCHNORR_PUBKEY_SIZE);
+}
+
+// A signature_size of SIGNATURE_SIZE selects recoverable ECDSA, and
+// SCHNORR_SIGNATURE_SIZE selects BIP340 Schnorr, see SCHNORR_ALGORITHM_ID.
+// Either way the 33 byte compressed pubkey is written to output.
 __attribute__((visibility("default"))) int validate_signature(
     void *prefilled_data, const uint8_t *signature_buffer,
     size_t signature_size, const uint8_t *message_buffer, size_t message_size,
     uint8_t *output, size_t *output_len) {
-  if (signature_size != SIGNATURE_SIZE) {
+  if (signature_size != SIGNATURE_SIZE &&
+      (signature_size != SCHNORR_SIGNATURE_SIZE ||
+       signature_buffer[0] != SCHNORR_ALGORITHM_ID)) {
     return ERROR_INVALID_SIGNATURE_SIZE;
   }
   if (message_size != 32) {
@@ -121,159 +199,215 @@ __attribute__((visibility("default"))) int validate_signature(
   if (*output_len < PUBKEY_SIZE) {
     return ERROR_INVALID_OUTPUT_SIZE;
   }
-  secp256k1_context context;
-  int ret =
-      ckb_secp256k1_custom_verify_only_initialize(&context, prefilled_data);
+  secp256k1_context local_context;
+  secp256k1_context *context;
+  int ret = prefilled_context(prefilled_data, &local_context, &context);
   if (ret != 0) {
     return ret;
   }
-
-  secp256k1_ecdsa_recoverable_signature signature;
-  if (secp256k1_ecdsa_recoverable_signature_parse_compact(
-          &context, &signature, signature_buffer,
-          signature_buffer[RECID_INDEX]) == 0) {
-    return ERROR_SECP_PARSE_SIGNATURE;
+  if (signature_size == SCHNORR_SIGNATURE_SIZE) {
+    if (ckb_secp256k1_schnorr_verify(
+            context, &signature_buffer[1],
+            &signature_buffer[1 + CKB_SCHNORR_PUBKEY_SIZE],
+            message_buffer) != 1) {
+      return ERROR_SECP_VERIFICATION;
+    }
+    schnorr_output_pubkey(signature_buffer, output);
+  } else {
+    ret = recover_pubkey(context, signature_buffer, message_buffer, output);
+    if (ret != CKB_SUCCESS) {
+      return ret;
+    }
   }
+  *output_len = PUBKEY_SIZE;
+  return CKB_SUCCESS;
+}
 
-  secp256k1_pubkey pubkey;
-  if (secp256k1_ecdsa_recover(&context, &pubkey, &signature, message_buffer) !=
-      1) {
-    return ERROR_SECP_RECOVER_PUBKEY;
+// Batch version of validate_signature: verifies count signatures with one
+// context setup and one call through the dynamic linking boundary.
+// signatures holds count signatures of signature_size bytes each, messages
+// holds count messages of message_size bytes each. The compressed public key
+// of the i-th pair is written at output[i * 33], and *output_len is set to
+// count * 33.
+//
+// ECDSA signatures are recovered one by one, verification stops at the first
+// failing pair. Schnorr signatures are all checked by one batch verification,
+// every signature must then use SCHNORR_ALGORITHM_ID.
+__attribute__((visibility("default"))) int validate_signatures(
+    void *prefilled_data, const uint8_t *signatures, size_t signature_size,
+    const uint8_t *messages, size_t message_size, size_t count,
+    uint8_t *output, size_t *output_len) {
+  if (signature_size != SIGNATURE_SIZE &&
+      signature_size != SCHNORR_SIGNATURE_SIZE) {
+    return ERROR_INVALID_SIGNATURE_SIZE;
   }
-
-  if (secp256k1_ec_pubkey_serialize(&context, output, output_len, &pubkey,
-                                    SECP256K1_EC_COMPRESSED) != 1) {
-    return ERROR_SECP_SERIALIZE_PUBKEY;
+  if (message_size != 32) {
+    return ERROR_INVALID_MESSAGE_SIZE;
+  }
+  if (*output_len < count * PUBKEY_SIZE) {
+    return ERROR_INVALID_OUTPUT_SIZE;
+  }
+  secp256k1_context local_context;
+  secp256k1_context *context;
+  int ret = prefilled_context(prefilled_data, &local_context, &context);
+  if (ret != 0) {
+    return ret;
+  }
+  if (signature_size == SCHNORR_SIGNATURE_SIZE) {
+    for (size_t i = 0; i < count; i++) {
+      if (signatures[i * signature_size] != SCHNORR_ALGORITHM_ID) {
+        return ERROR_INVALID_SIGNATURE_SIZE;
+      }
+    }
+    if (ckb_secp256k1_schnorr_verify_batch(context, &signatures[1],
+                                           signature_size, messages,
+                                           message_size, count) != 1) {
+      return ERROR_SECP_VERIFICATION;
+    }
+    for (size_t i = 0; i < count; i++) {
+      schnorr_output_pubkey(&signatures[i * signature_size],
+                            &output[i * PUBKEY_SIZE]);
+    }
+  } else {
+    for (size_t i = 0; i < count; i++) {
+      ret = recover_pubkey(context, &signatures[i * signature_size],
+                           &messages[i * message_size],
+                           &output[i * PUBKEY_SIZE]);
+      if (ret != CKB_SUCCESS) {
+        return ret;
+      }
+    }
   }
+  *output_len = count * PUBKEY_SIZE;
   return CKB_SUCCESS;
 }
 
-// Given a blake160 format public key hash, this method performs signature
-// verifications on input cells using current lock script hash. It then asserts
-// that the derive public key hash from the signature matches the given public
-// key hash.
+// Shared by validate_secp256k1_blake2b_sighash_all and validate_simple.
 //
-// Note that this method is exposed for dynamic linking usage, so the
-// "current lock script" mentioned above, does not have to be this current
-// script code. It could be a different script code using this script via as a
-// library.
-__attribute__((visibility("default"))) int
-validate_secp256k1_blake2b_sighash_all(uint8_t *output_public_key_hash) {
+// The lock field of the first witness holds either a 65 byte recoverable
+// signature, or a 33 byte compressed pubkey followed by a 64 byte compact
+// signature. The latter skips pubkey recovery: the pubkey hash is known before
+// any curve math, so a lock not matching expected_hash, when given, is
+// rejected before the message is even computed. Then a plain ECDSA
+// verification is done against the carried pubkey.
+static int validate_sighash_all(const uint8_t *expected_hash,
+                                uint8_t *output_public_key_hash) {
   unsigned char temp[TEMP_SIZE];
-  unsigned char lock_bytes[SIGNATURE_SIZE];
-  uint64_t len = 0;
+  CkbSighashAllCtx sighash_ctx;
+  ckb_sighash_all_init(&sighash_ctx, temp, TEMP_SIZE);
 
-  // Load witness of first input
-  uint64_t witness_len = MAX_WITNESS_SIZE;
-  int ret = ckb_load_witness(temp, &witness_len, 0, 0, CKB_SOURCE_GROUP_INPUT);
+  // Load witness of first input, the signature is read in place from lock
+  CkbSighashAllFirstWitness first_witness;
+  int ret = ckb_sighash_all_load_first_witness(&sighash_ctx, &first_witness);
+  if (ret == CKB_SIGHASH_ALL_ERROR_ENCODING) {
+    return ERROR_ENCODING;
+  }
   if (ret != CKB_SUCCESS) {
     return ERROR_SYSCALL;
   }
-
-  if (witness_len > MAX_WITNESS_SIZE) {
-    return ERROR_WITNESS_SIZE;
-  }
-
-  // load signature
-  mol_seg_t lock_bytes_seg;
-  ret = extract_witness_lock(temp, witness_len, &lock_bytes_seg);
-  if (ret != 0) {
-    return ERROR_ENCODING;
-  }
-
-  if (lock_bytes_seg.size != SIGNATURE_SIZE) {
+  int with_pubkey = first_witness.lock_len == PUBKEY_SIGNATURE_SIZE;
+  if (!with_pubkey && first_witness.lock_len != SIGNATURE_SIZE) {
     return ERROR_ARGUMENTS_LEN;
   }
-  memcpy(lock_bytes, lock_bytes_seg.ptr, lock_bytes_seg.size);
+  const uint8_t *lock_bytes = first_witness.lock;
 
-  // Load tx hash
-  unsigned char tx_hash[BLAKE2B_BLOCK_SIZE];
-  len = BLAKE2B_BLOCK_SIZE;
-  ret = ckb_load_tx_hash(tx_hash, &len, 0);
-  if (ret != CKB_SUCCESS) {
-    return ret;
-  }
-  if (len != BLAKE2B_BLOCK_SIZE) {
-    return ERROR_SYSCALL;
+  unsigned char pubkey_hash[BLAKE2B_BLOCK_SIZE];
+  blake2b_state blake2b_ctx;
+  if (with_pubkey) {
+    blake2b_init(&blake2b_ctx, BLAKE2B_BLOCK_SIZE);
+    blake2b_update(&blake2b_ctx, lock_bytes, PUBKEY_SIZE);
+    blake2b_final(&blake2b_ctx, pubkey_hash, BLAKE2B_BLOCK_SIZE);
+    if (expected_hash != NULL &&
+        memcmp(expected_hash, pubkey_hash, BLAKE160_SIZE) != 0) {
+      return ERROR_PUBKEY_BLAKE160_HASH;
+    }
+    CKB_TRACE("pubkey_hash");
   }
 
-  // Prepare sign message
+  // Prepare sign message, lock field is digested as zeros
   unsigned char message[BLAKE2B_BLOCK_SIZE];
-  blake2b_state blake2b_ctx;
-  blake2b_init(&blake2b_ctx, BLAKE2B_BLOCK_SIZE);
-  blake2b_update(&blake2b_ctx, tx_hash, BLAKE2B_BLOCK_SIZE);
-
-  // Clear lock field to zero, then digest the first witness
-  memset((void *)lock_bytes_seg.ptr, 0, lock_bytes_seg.size);
-  blake2b_update(&blake2b_ctx, (char *)&witness_len, sizeof(uint64_t));
-  blake2b_update(&blake2b_ctx, temp, witness_len);
-
-  // Digest same group witnesses
-  size_t i = 1;
-  while (1) {
-    ret = load_and_hash_witness(&blake2b_ctx, i, CKB_SOURCE_GROUP_INPUT);
-    if (ret == CKB_INDEX_OUT_OF_BOUND) {
-      break;
-    }
-    if (ret != CKB_SUCCESS) {
-      return ERROR_SYSCALL;
-    }
-    i += 1;
-  }
-  // Digest witnesses that not covered by inputs
-  i = ckb_calculate_inputs_len();
-  while (1) {
-    ret = load_and_hash_witness(&blake2b_ctx, i, CKB_SOURCE_INPUT);
-    if (ret == CKB_INDEX_OUT_OF_BOUND) {
-      break;
-    }
-    if (ret != CKB_SUCCESS) {
-      return ERROR_SYSCALL;
-    }
-    i += 1;
+  ret = ckb_sighash_all_calculate(&sighash_ctx, &first_witness, message);
+  if (ret != CKB_SUCCESS) {
+    return ERROR_SYSCALL;
   }
-  blake2b_final(&blake2b_ctx, message, BLAKE2B_BLOCK_SIZE);
 
   // Load signature
   secp256k1_context context;
-  uint8_t secp_data[CKB_SECP256K1_DATA_SIZE];
-  ret = ckb_secp256k1_custom_load_data(secp_data);
+  uint8_t secp_data[CKB_SECP256K1_DATA_BUFFER_SIZE];
+  ret = ckb_secp256k1_custom_load_data_variant(secp_data);
   if (ret != 0) {
     return ret;
   }
+  CKB_TRACE("secp_data");
   ret = ckb_secp256k1_custom_verify_only_initialize(&context, secp_data);
   if (ret != 0) {
     return ret;
   }
 
-  secp256k1_ecdsa_recoverable_signature signature;
-  if (secp256k1_ecdsa_recoverable_signature_parse_compact(
-          &context, &signature, lock_bytes, lock_bytes[RECID_INDEX]) == 0) {
-    return ERROR_SECP_PARSE_SIGNATURE;
-  }
+  if (with_pubkey) {
+    secp256k1_pubkey pubkey;
+    if (secp256k1_ec_pubkey_parse(&context, &pubkey, lock_bytes, PUBKEY_SIZE) ==
+        0) {
+      return ERROR_SECP_PARSE_PUBKEY;
+    }
+    secp256k1_ecdsa_signature signature;
+    if (secp256k1_ecdsa_signature_parse_compact(
+            &context, &signature, &lock_bytes[PUBKEY_SIZE]) == 0) {
+      return ERROR_SECP_PARSE_SIGNATURE;
+    }
+    if (ckb_secp256k1_ecdsa_verify(&context, &signature, message, &pubkey) !=
+        1) {
+      return ERROR_SECP_VERIFICATION;
+    }
+    CKB_TRACE("verify");
+  } else {
+    secp256k1_ecdsa_recoverable_signature signature;
+    if (secp256k1_ecdsa_recoverable_signature_parse_compact(
+            &context, &signature, lock_bytes, lock_bytes[RECID_INDEX]) == 0) {
+      return ERROR_SECP_PARSE_SIGNATURE;
+    }
 
-  // Recover pubkey
-  secp256k1_pubkey pubkey;
-  if (secp256k1_ecdsa_recover(&context, &pubkey, &signature, message) != 1) {
-    return ERROR_SECP_RECOVER_PUBKEY;
-  }
+    // Recover pubkey
+    secp256k1_pubkey pubkey;
+    if (ckb_secp256k1_ecdsa_recover(&context, &pubkey, &signature, message) !=
+        1) {
+      return ERROR_SECP_RECOVER_PUBKEY;
+    }
+    CKB_TRACE("recover");
 
-  // Check pubkey hash
-  size_t pubkey_size = PUBKEY_SIZE;
-  if (secp256k1_ec_pubkey_serialize(&context, temp, &pubkey_size, &pubkey,
-                                    SECP256K1_EC_COMPRESSED) != 1) {
-    return ERROR_SECP_SERIALIZE_PUBKEY;
-  }
+    // Check pubkey hash
+    size_t pubkey_size = PUBKEY_SIZE;
+    if (secp256k1_ec_pubkey_serialize(&context, temp, &pubkey_size, &pubkey,
+                                      SECP256K1_EC_COMPRESSED) != 1) {
+      return ERROR_SECP_SERIALIZE_PUBKEY;
+    }
 
-  blake2b_init(&blake2b_ctx, BLAKE2B_BLOCK_SIZE);
-  blake2b_update(&blake2b_ctx, temp, pubkey_size);
-  blake2b_final(&blake2b_ctx, temp, BLAKE2B_BLOCK_SIZE);
+    blake2b_init(&blake2b_ctx, BLAKE2B_BLOCK_SIZE);
+    blake2b_update(&blake2b_ctx, temp, pubkey_size);
+    blake2b_final(&blake2b_ctx, pubkey_hash, BLAKE2B_BLOCK_SIZE);
+    CKB_TRACE("pubkey_hash");
+  }
 
-  memcpy(output_public_key_hash, temp, BLAKE160_SIZE);
+  memcpy(output_public_key_hash, pubkey_hash, BLAKE160_SIZE);
 
   return CKB_SUCCESS;
 }
 
+// Given a blake160 format public key hash, this method performs signature
+// verifications on input cells using current lock script hash. It then asserts
+// that the derive public key hash from the signature matches the given public
+// key hash.
+//
+// Note that this method is exposed for dynamic linking usage, so the
+// "current lock script" mentioned above, does not have to be this current
+// script code. It could be a different script code using this script via as a
+// library.
+__attribute__((visibility("default"))) int
+validate_secp256k1_blake2b_sighash_all(uint8_t *output_public_key_hash) {
+  CKB_TRACE_SCOPE("validate_secp256k1_blake2b_sighash_all");
+  return validate_sighash_all(NULL, output_public_key_hash);
+}
+
 // This replicates the same validation logic as the system
 // secp256k1-blake160-sighash-all script. It loads public key hash from the
 // witness of the same index as the first input using current lock script.
@@ -285,6 +419,7 @@ validate_secp256k1_blake2b_sighash_all(uint8_t *output_public_key_hash) {
 // script code. It could be a different script code using this script via as a
 // library.
 __attribute__((visibility("default"))) int validate_simple() {
+  CKB_TRACE_SCOPE("validate_simple");
   int ret;
   uint64_t len = 0;
 
@@ -305,6 +440,7 @@ __attribute__((visibility("default"))) int validate_simple() {
   if (MolReader_Script_verify(&script_seg, false) != MOL_OK) {
     return ERROR_ENCODING;
   }
+  CKB_TRACE("molecule");
 
   mol_seg_t args_seg = MolReader_Script_get_args(&script_seg);
   mol_seg_t args_bytes_seg = MolReader_Bytes_raw_bytes(&args_seg);
@@ -313,7 +449,7 @@ __attribute__((visibility("default"))) int validate_simple() {
   }
 
   uint8_t public_key_hash[BLAKE160_SIZE];
-  ret = validate_secp256k1_blake2b_sighash_all(public_key_hash);
+  ret = validate_sighash_all(args_bytes_seg.ptr, public_key_hash);
   if (ret != CKB_SUCCESS) {
     return ret;
   }
@@ -343,6 +479,7 @@ int main_() {
 #else
 int main() {
 #endif
+  CKB_TRACE_SCOPE("secp256k1_blake2b_sighash_all_dual");
 
   uint64_t *phoff = (uint64_t *)OFFSETOF(Elf64_Ehdr, e_phoff);
   uint16_t *phnum = (uint16_t *)OFFSETOF(Elf64_Ehdr, e_phnum);
@@ -375,6 +512,7 @@ int main() {
       }
     }
   }
+  CKB_TRACE("relocate");
   return validate_simple();
 }
 
@@ -5,6 +5,7 @@
 #include "blake2b.h"
 #include "ckb_syscalls.h"
 #include "secp256k1_helper.h"
+#include "sighash_all_helper.h"
 
 #define BLAKE2B_BLOCK_SIZE 32
 #define BLAKE160_SIZE 20
@@ -19,61 +20,19 @@
 #define ERROR_SECP_SERIALIZE_PUBKEY -53
 #define ERROR_PUBKEY_BLAKE160_HASH -54
 
-__attribute__((visibility("default"))) int
-validate_secp256k1_blake2b_sighash_all(const uint8_t *pubkey_hash,
-                                       const uint8_t *compact_signature,
-                                       const uint8_t *first_witness_data,
-                                       size_t first_witness_length) {
-  uint8_t tx_hash[BLAKE2B_BLOCK_SIZE];
-  uint64_t len = BLAKE2B_BLOCK_SIZE;
-  int ret = ckb_checked_load_tx_hash(tx_hash, &len, 0);
-  if (ret != CKB_SUCCESS) {
-    return ret;
-  }
-
-  blake2b_state blake2b_ctx;
-  blake2b_init(&blake2b_ctx, BLAKE2B_BLOCK_SIZE);
-  blake2b_update(&blake2b_ctx, tx_hash, BLAKE2B_BLOCK_SIZE);
-  blake2b_update(&blake2b_ctx, (char *)&first_witness_length, sizeof(uint64_t));
-  blake2b_update(&blake2b_ctx, first_witness_data, first_witness_length);
-
-  uint8_t buffer[TEMP_SIZE];
-  /* Digest same group witnesses */
-  size_t i = 1;
-  while (1) {
-    len = TEMP_SIZE;
-    ret = ckb_checked_load_witness(buffer, &len, 0, i, CKB_SOURCE_GROUP_INPUT);
-    if (ret == CKB_INDEX_OUT_OF_BOUND) {
-      break;
-    }
-    if (ret != CKB_SUCCESS) {
-      return ERROR_SYSCALL;
-    }
-    blake2b_update(&blake2b_ctx, (char *)&len, sizeof(uint64_t));
-    blake2b_update(&blake2b_ctx, buffer, len);
-    i += 1;
-  }
-  /* Digest witnesses that not covered by inputs */
-  i = ckb_calculate_inputs_len();
-  while (1) {
-    len = TEMP_SIZE;
-    ret = ckb_checked_load_witness(buffer, &len, 0, i, CKB_SOURCE_INPUT);
-    if (ret == CKB_INDEX_OUT_OF_BOUND) {
-      break;
-    }
-    if (ret != CKB_SUCCESS) {
-      return ERROR_SYSCALL;
-    }
-    blake2b_update(&blake2b_ctx, (char *)&len, sizeof(uint64_t));
-    blake2b_update(&blake2b_ctx, buffer, len);
-    i += 1;
-  }
-  uint8_t message[BLAKE2B_BLOCK_SIZE];
-  blake2b_final(&blake2b_ctx, message, BLAKE2B_BLOCK_SIZE);
-
+// Recovers the signer of message from compact_signature and checks its
+// blake160 against pubkey_hash.
+static int verify_recoverable_signature(const uint8_t *pubkey_hash,
+                                        const uint8_t *compact_signature,
+                                        const uint8_t *message) {
   /* Load signature */
   secp256k1_context context;
-  uint8_t secp_data[CKB_SECP256K1_DATA_SIZE];
+  uint8_t secp_data[CKB_SECP256K1_DATA_BUFFER_SIZE];
+  int ret = ckb_secp256k1_custom_load_data_variant(secp_data);
+  if (ret != 0) {
+    return ret;
+  }
+  CKB_TRACE("secp_data");
   ret = ckb_secp256k1_custom_verify_only_initialize(&context, secp_data);
   if (ret != 0) {
     return ret;
@@ -88,24 +47,85 @@ validate_secp256k1_blake2b_sighash_all(const uint8_t *pubkey_hash,
 
   /* Recover pubkey */
   secp256k1_pubkey pubkey;
-  if (secp256k1_ecdsa_recover(&context, &pubkey, &signature, message) != 1) {
+  if (ckb_secp256k1_ecdsa_recover(&context, &pubkey, &signature, message) !=
+      1) {
     return ERROR_SECP_RECOVER_PUBKEY;
   }
+  CKB_TRACE("recover");
 
   /* Check pubkey hash */
+  uint8_t buffer[PUBKEY_SIZE];
   size_t pubkey_size = PUBKEY_SIZE;
   if (secp256k1_ec_pubkey_serialize(&context, buffer, &pubkey_size, &pubkey,
                                     SECP256K1_EC_COMPRESSED) != 1) {
     return ERROR_SECP_SERIALIZE_PUBKEY;
   }
 
+  uint8_t hash[BLAKE2B_BLOCK_SIZE];
+  blake2b_state blake2b_ctx;
   blake2b_init(&blake2b_ctx, BLAKE2B_BLOCK_SIZE);
   blake2b_update(&blake2b_ctx, buffer, pubkey_size);
-  blake2b_final(&blake2b_ctx, buffer, BLAKE2B_BLOCK_SIZE);
+  blake2b_final(&blake2b_ctx, hash, BLAKE2B_BLOCK_SIZE);
+  CKB_TRACE("pubkey_hash");
 
-  if (memcmp(pubkey_hash, buffer, BLAKE160_SIZE) != 0) {
+  if (memcmp(pubkey_hash, hash, BLAKE160_SIZE) != 0) {
     return ERROR_PUBKEY_BLAKE160_HASH;
   }
 
   return CKB_SUCCESS;
 }
+
+/*
+ * The original export, the caller loads the first witness of current script
+ * group and clears its lock field. New callers should use
+ * validate_secp256k1_blake2b_sighash_all_v2.
+ */
+__attribute__((visibility("default"))) int
+validate_secp256k1_blake2b_sighash_all(const uint8_t *pubkey_hash,
+                                       const uint8_t *compact_signature,
+                                       const uint8_t *first_witness_data,
+                                       size_t first_witness_length) {
+  CKB_TRACE_SCOPE("secp256k1_blake2b_sighash_all_lib");
+  uint8_t buffer[TEMP_SIZE];
+  CkbSighashAllCtx sighash_ctx;
+  ckb_sighash_all_init(&sighash_ctx, buffer, TEMP_SIZE);
+  int ret = ckb_sighash_all_hash_tx_hash(&sighash_ctx);
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  uint64_t len = first_witness_length;
+  ckb_sighash_all_update(&sighash_ctx, &len, sizeof(uint64_t));
+  ckb_sighash_all_update(&sighash_ctx, first_witness_data,
+                         first_witness_length);
+  ret = ckb_sighash_all_hash_remaining_witnesses(&sighash_ctx);
+  if (ret != CKB_SUCCESS) {
+    return ERROR_SYSCALL;
+  }
+  uint8_t message[BLAKE2B_BLOCK_SIZE];
+  ckb_sighash_all_final(&sighash_ctx, message);
+  return verify_recoverable_signature(pubkey_hash, compact_signature, message);
+}
+
+/*
+ * The whole lock field of the first witness in current script group is
+ * digested as zeros, callers don't need to load the witness nor clear it.
+ */
+__attribute__((visibility("default"))) int
+validate_secp256k1_blake2b_sighash_all_v2(const uint8_t *pubkey_hash,
+                                          const uint8_t *compact_signature) {
+  CKB_TRACE_SCOPE("secp256k1_blake2b_sighash_all_lib");
+  uint8_t buffer[TEMP_SIZE];
+  CkbSighashAllCtx sighash_ctx;
+  ckb_sighash_all_init(&sighash_ctx, buffer, TEMP_SIZE);
+  CkbSighashAllFirstWitness first_witness;
+  int ret = ckb_sighash_all_load_first_witness(&sighash_ctx, &first_witness);
+  if (ret != CKB_SUCCESS) {
+    return ERROR_SYSCALL;
+  }
+  uint8_t message[BLAKE2B_BLOCK_SIZE];
+  ret = ckb_sighash_all_calculate(&sighash_ctx, &first_witness, message);
+  if (ret != CKB_SUCCESS) {
+    return ERROR_SYSCALL;
+  }
+  return verify_recoverable_signature(pubkey_hash, compact_signature, message);
+}
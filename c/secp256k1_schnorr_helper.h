@@ -0,0 +1,265 @@
+#ifndef CKB_MISCELLANEOUS_SCRIPTS_SECP256K1_SCHNORR_HELPER_H_
+#define CKB_MISCELLANEOUS_SCRIPTS_SECP256K1_SCHNORR_HELPER_H_
+
+// BIP340 Schnorr signature verification over the secp256k1 library included
+// by secp256k1_helper.h, which should be included before this file. The
+// library in deps predates its schnorrsig module, so verification is built
+// from the library internals, using the precomputed G tables loaded by
+// ckb_secp256k1_custom_load_data or ckb_secp256k1_custom_load_data_variant.
+//
+// Public keys are 32 byte x-only keys, signatures are 64 bytes: R.x | s.
+//
+// Batch verification checks n signatures with one multi-scalar
+// multiplication:
+//
+// (sum a_i * s_i) * G - sum a_i * R_i - sum (a_i * e_i) * P_i = 0
+//
+// where a_0 = 1 and other a_i are derived from a hash of every input of the
+// batch. 256 doublings are shared by all signatures, instead of one ecmult
+// per signature. A failing batch doesn't tell which signature is invalid.
+
+#define CKB_SCHNORR_PUBKEY_SIZE 32
+#define CKB_SCHNORR_SIGNATURE_SIZE 64
+// signatures checked by one multi-scalar multiplication, larger batches are
+// split so stack usage stays bounded, roughly 4 KB per signature.
+#define CKB_SCHNORR_BATCH_SIZE 32
+// wNAF window of R_i and P_i tables
+#define CKB_SCHNORR_WINDOW 5
+#define CKB_SCHNORR_TABLE_SIZE (1 << (CKB_SCHNORR_WINDOW - 2))
+#define CKB_SCHNORR_WNAF_SIZE 256
+
+typedef struct CkbSchnorrItem {
+  secp256k1_ge p;
+  secp256k1_fe rx;
+  secp256k1_scalar s;
+  secp256k1_scalar e;
+} CkbSchnorrItem;
+
+static void ckb_schnorr_tagged_sha256(secp256k1_sha256 *sha, const char *tag) {
+  unsigned char tag_hash[32];
+  secp256k1_sha256_initialize(sha);
+  secp256k1_sha256_write(sha, (const unsigned char *)tag, strlen(tag));
+  secp256k1_sha256_finalize(sha, tag_hash);
+  secp256k1_sha256_initialize(sha);
+  secp256k1_sha256_write(sha, tag_hash, 32);
+  secp256k1_sha256_write(sha, tag_hash, 32);
+}
+
+// Parses pubkey and signature, and computes the challenge e.
+static int ckb_schnorr_load_item(CkbSchnorrItem *item, const uint8_t *pubkey,
+                                 const uint8_t *signature,
+                                 const uint8_t *message) {
+  secp256k1_fe x;
+  if (!secp256k1_fe_set_b32(&x, pubkey) ||
+      !secp256k1_ge_set_xo_var(&item->p, &x, 0)) {
+    return 0;
+  }
+  if (!secp256k1_fe_set_b32(&item->rx, signature)) {
+    return 0;
+  }
+  int overflow = 0;
+  secp256k1_scalar_set_b32(&item->s, &signature[32], &overflow);
+  if (overflow) {
+    return 0;
+  }
+
+  unsigned char hash[32];
+  secp256k1_sha256 sha;
+  ckb_schnorr_tagged_sha256(&sha, "BIP0340/challenge");
+  secp256k1_sha256_write(&sha, signature, 32);
+  secp256k1_sha256_write(&sha, pubkey, CKB_SCHNORR_PUBKEY_SIZE);
+  secp256k1_sha256_write(&sha, message, 32);
+  secp256k1_sha256_finalize(&sha, hash);
+  secp256k1_scalar_set_b32(&item->e, hash, NULL);
+  return 1;
+}
+
+int ckb_secp256k1_schnorr_verify(const secp256k1_context *ctx,
+                                 const uint8_t *pubkey,
+                                 const uint8_t *signature,
+                                 const uint8_t *message) {
+  CkbSchnorrItem item;
+  if (!ckb_schnorr_load_item(&item, pubkey, signature, message)) {
+    return 0;
+  }
+  // R = s * G - e * P
+  secp256k1_gej pj, rj;
+  secp256k1_gej_set_ge(&pj, &item.p);
+  secp256k1_scalar_negate(&item.e, &item.e);
+  ckb_secp256k1_ecmult(&ctx->ecmult_ctx, &rj, &pj, &item.e, &item.s);
+  if (secp256k1_gej_is_infinity(&rj)) {
+    return 0;
+  }
+  secp256k1_ge r;
+  secp256k1_ge_set_gej_var(&r, &rj);
+  secp256k1_fe_normalize_var(&r.y);
+  if (secp256k1_fe_is_odd(&r.y)) {
+    return 0;
+  }
+  secp256k1_fe_normalize_var(&r.x);
+  return secp256k1_fe_equal_var(&item.rx, &r.x);
+}
+
+static void ckb_schnorr_table_add(secp256k1_gej *r, const secp256k1_gej *table,
+                                  int n) {
+  if (n > 0) {
+    secp256k1_gej_add_var(r, r, &table[(n - 1) / 2], NULL);
+  } else {
+    secp256k1_gej tmp;
+    secp256k1_gej_neg(&tmp, &table[(-n - 1) / 2]);
+    secp256k1_gej_add_var(r, r, &tmp, NULL);
+  }
+}
+
+// Returns 1 when ng * G + sum scalars[i] * points[i] is infinity.
+static int ckb_schnorr_multi_mult_is_zero(const secp256k1_ecmult_context *ctx,
+                                          const secp256k1_ge *points,
+                                          const secp256k1_scalar *scalars,
+                                          size_t count,
+                                          const secp256k1_scalar *ng) {
+  secp256k1_gej tables[2 * CKB_SCHNORR_BATCH_SIZE][CKB_SCHNORR_TABLE_SIZE];
+  int wnafs[2 * CKB_SCHNORR_BATCH_SIZE][CKB_SCHNORR_WNAF_SIZE];
+  int bits[2 * CKB_SCHNORR_BATCH_SIZE];
+  int max_bits = 0;
+  for (size_t k = 0; k < count; k++) {
+    // odd multiples P, 3P, 5P, ...
+    secp256k1_gej d;
+    secp256k1_gej_set_ge(&tables[k][0], &points[k]);
+    secp256k1_gej_double_var(&d, &tables[k][0], NULL);
+    for (int j = 1; j < CKB_SCHNORR_TABLE_SIZE; j++) {
+      secp256k1_gej_add_var(&tables[k][j], &tables[k][j - 1], &d, NULL);
+    }
+    bits[k] = secp256k1_ecmult_wnaf(wnafs[k], CKB_SCHNORR_WNAF_SIZE,
+                                    &scalars[k], CKB_SCHNORR_WINDOW);
+    if (bits[k] > max_bits) {
+      max_bits = bits[k];
+    }
+  }
+
+  // G part over pre_g and pre_g_128, as in ckb_secp256k1_ecmult
+  int wnaf_ng_1[129];
+  int wnaf_ng_128[129];
+  secp256k1_scalar ng_1, ng_128;
+  secp256k1_scalar_split_128(&ng_1, &ng_128, ng);
+  int window = ckb_secp256k1_context_window(ctx);
+  int bits_ng_1 = secp256k1_ecmult_wnaf(wnaf_ng_1, 129, &ng_1, window);
+  int bits_ng_128 = secp256k1_ecmult_wnaf(wnaf_ng_128, 129, &ng_128, window);
+  if (bits_ng_1 > max_bits) {
+    max_bits = bits_ng_1;
+  }
+  if (bits_ng_128 > max_bits) {
+    max_bits = bits_ng_128;
+  }
+
+  secp256k1_gej r;
+  secp256k1_ge tmp;
+  secp256k1_gej_set_infinity(&r);
+  for (int i = max_bits - 1; i >= 0; i--) {
+    int n;
+    secp256k1_gej_double_var(&r, &r, NULL);
+    for (size_t k = 0; k < count; k++) {
+      if (i < bits[k] && (n = wnafs[k][i])) {
+        ckb_schnorr_table_add(&r, tables[k], n);
+      }
+    }
+    if (i < bits_ng_1 && (n = wnaf_ng_1[i])) {
+      ckb_secp256k1_table_get(&tmp, *ctx->pre_g, n);
+      secp256k1_gej_add_ge_var(&r, &r, &tmp, NULL);
+    }
+    if (i < bits_ng_128 && (n = wnaf_ng_128[i])) {
+      ckb_secp256k1_table_get(&tmp, *ctx->pre_g_128, n);
+      secp256k1_gej_add_ge_var(&r, &r, &tmp, NULL);
+    }
+  }
+  return secp256k1_gej_is_infinity(&r);
+}
+
+static int ckb_schnorr_verify_chunk(const secp256k1_context *ctx,
+                                    const uint8_t *items, size_t item_stride,
+                                    const uint8_t *messages,
+                                    size_t message_stride, size_t count) {
+  secp256k1_ge points[2 * CKB_SCHNORR_BATCH_SIZE];
+  secp256k1_scalar scalars[2 * CKB_SCHNORR_BATCH_SIZE];
+  secp256k1_scalar ng;
+  secp256k1_scalar_set_int(&ng, 0);
+
+  // Seed of the randomizers commits to every input of the batch
+  unsigned char seed[32];
+  secp256k1_sha256 sha;
+  ckb_schnorr_tagged_sha256(&sha, "CKB/schnorr_batch");
+  for (size_t i = 0; i < count; i++) {
+    secp256k1_sha256_write(
+        &sha, &items[i * item_stride],
+        CKB_SCHNORR_PUBKEY_SIZE + CKB_SCHNORR_SIGNATURE_SIZE);
+    secp256k1_sha256_write(&sha, &messages[i * message_stride], 32);
+  }
+  secp256k1_sha256_finalize(&sha, seed);
+
+  for (size_t i = 0; i < count; i++) {
+    const uint8_t *pubkey = &items[i * item_stride];
+    const uint8_t *signature = &pubkey[CKB_SCHNORR_PUBKEY_SIZE];
+    CkbSchnorrItem item;
+    if (!ckb_schnorr_load_item(&item, pubkey, signature,
+                               &messages[i * message_stride])) {
+      return 0;
+    }
+    // R is the point of even y with x = r
+    if (!secp256k1_ge_set_xo_var(&points[2 * i], &item.rx, 0)) {
+      return 0;
+    }
+    points[2 * i + 1] = item.p;
+
+    secp256k1_scalar a;
+    if (i == 0) {
+      secp256k1_scalar_set_int(&a, 1);
+    } else {
+      unsigned char a32[32];
+      unsigned char index[4];
+      for (int j = 0; j < 4; j++) {
+        index[j] = (unsigned char)(i >> (8 * j));
+      }
+      secp256k1_sha256_initialize(&sha);
+      secp256k1_sha256_write(&sha, seed, 32);
+      secp256k1_sha256_write(&sha, index, 4);
+      secp256k1_sha256_finalize(&sha, a32);
+      secp256k1_scalar_set_b32(&a, a32, NULL);
+    }
+    // ng += a * s, R scalar is -a, P scalar is -a * e
+    secp256k1_scalar as;
+    secp256k1_scalar_mul(&as, &a, &item.s);
+    secp256k1_scalar_add(&ng, &ng, &as);
+    secp256k1_scalar_negate(&scalars[2 * i], &a);
+    secp256k1_scalar_mul(&scalars[2 * i + 1], &scalars[2 * i], &item.e);
+  }
+  return ckb_schnorr_multi_mult_is_zero(&ctx->ecmult_ctx, points, scalars,
+                                        2 * count, &ng);
+}
+
+// Verifies count signatures in batches. Item i is an x-only pubkey followed
+// by its signature at items[i * item_stride], its message is at
+// messages[i * message_stride]. message_stride can be 0 when all signatures
+// sign the same message.
+int ckb_secp256k1_schnorr_verify_batch(const secp256k1_context *ctx,
+                                       const uint8_t *items,
+                                       size_t item_stride,
+                                       const uint8_t *messages,
+                                       size_t message_stride, size_t count) {
+  if (count == 1) {
+    return ckb_secp256k1_schnorr_verify(
+        ctx, items, &items[CKB_SCHNORR_PUBKEY_SIZE], messages);
+  }
+  for (size_t i = 0; i < count; i += CKB_SCHNORR_BATCH_SIZE) {
+    size_t n = count - i;
+    if (n > CKB_SCHNORR_BATCH_SIZE) {
+      n = CKB_SCHNORR_BATCH_SIZE;
+    }
+    if (!ckb_schnorr_verify_chunk(ctx, &items[i * item_stride], item_stride,
+                                  &messages[i * message_stride],
+                                  message_stride, n)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+#endif  // CKB_MISCELLANEOUS_SCRIPTS_SECP256K1_SCHNORR_HELPER_H_
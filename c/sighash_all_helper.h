@@ -0,0 +1,344 @@
+#ifndef CKB_MISCELLANEOUS_SCRIPTS_SIGHASH_ALL_HELPER_H_
+#define CKB_MISCELLANEOUS_SCRIPTS_SIGHASH_ALL_HELPER_H_
+
+// A streaming sighash-all engine shared by the lock scripts in this repo.
+//
+// The sighash-all message is the blake2b hash of:
+//
+// tx_hash | len(w0) | w0 (lock zeroed) | len(w1) | w1 | ... | len(wn) | wn
+//
+// where w0 is the first witness of current script group, followed by the rest
+// of witnesses in the group, then the witnesses not covered by any input.
+//
+// Every witness is streamed through one caller supplied scratch buffer in
+// chunks of at most `chunk_size` bytes, so the stack cost of hashing is fixed
+// no matter how many or how large the witnesses are. The engine also counts
+// bytes hashed and syscalls issued, which is handy when tuning chunk size:
+// both are reported as sighash_bytes and sighash_syscalls in the cycle trace
+// line, see cycle_trace.h.
+//
+// The first witness is never modified: it is hashed as three segments, the
+// part before the zeroed range, a run of zeros, and the part after it. The
+// head of the first witness up to the end of lock field stays pinned at the
+// start of scratch buffer, so lock bytes can be read in place until the
+// message is finalized. When the pinned head leaves less than
+// CKB_SIGHASH_ALL_MIN_WINDOW bytes of scratch buffer, streaming goes through
+// a window of that size on the stack instead, so a lock that nearly fills
+// scratch buffer doesn't turn the rest of the witnesses into one syscall per
+// few bytes.
+//
+// This header doesn't include syscalls or blake2b by itself: the including
+// script should include the flavour it is built with (on chain, simulator)
+// before including this file.
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "cycle_trace.h"
+
+#define CKB_SIGHASH_ALL_HASH_SIZE 32
+#ifndef CKB_SIGHASH_ALL_MIN_WINDOW
+#define CKB_SIGHASH_ALL_MIN_WINDOW 1024
+#endif
+
+#define CKB_SIGHASH_ALL_ERROR_LENGTH -121
+#define CKB_SIGHASH_ALL_ERROR_ENCODING -122
+
+// WitnessArgs is a molecule table of 3 BytesOpt fields, lock comes first
+#define CKB_SIGHASH_ALL_WITNESS_ARGS_HEADER_SIZE 16
+#define CKB_SIGHASH_ALL_WITNESS_ARGS_FIELD_COUNT 3
+
+typedef int (*ckb_sighash_all_load_fn)(void *addr, uint64_t *len,
+                                       size_t offset, size_t index,
+                                       size_t source);
+
+typedef struct CkbSighashAllCtx {
+  blake2b_state blake2b_ctx;
+  uint8_t *scratch;
+  size_t chunk_size;
+  // bytes at the start of scratch that are pinned by the first witness
+  size_t reserved;
+  // statistics
+  uint64_t bytes_hashed;
+  uint64_t syscalls;
+} CkbSighashAllCtx;
+
+void ckb_sighash_all_init(CkbSighashAllCtx *ctx, uint8_t *scratch,
+                          size_t chunk_size) {
+  blake2b_init(&ctx->blake2b_ctx, CKB_SIGHASH_ALL_HASH_SIZE);
+  ctx->scratch = scratch;
+  ctx->chunk_size = chunk_size;
+  ctx->reserved = 0;
+  ctx->bytes_hashed = 0;
+  ctx->syscalls = 0;
+}
+
+void ckb_sighash_all_update(CkbSighashAllCtx *ctx, const void *data,
+                            size_t len) {
+  blake2b_update(&ctx->blake2b_ctx, data, len);
+  ctx->bytes_hashed += len;
+}
+
+void ckb_sighash_all_final(CkbSighashAllCtx *ctx, uint8_t *message) {
+  blake2b_final(&ctx->blake2b_ctx, message, CKB_SIGHASH_ALL_HASH_SIZE);
+  CKB_TRACE_VALUE("sighash_bytes", ctx->bytes_hashed);
+  CKB_TRACE_VALUE("sighash_syscalls", ctx->syscalls);
+}
+
+// Stream the item loaded by `f` starting from `start` into the hash. When
+// `hash_length` is true, the length of the streamed part is hashed first as a
+// little endian uint64_t, which is how witnesses are committed.
+//
+// `f` can be any of the partial loading syscalls sharing the witness
+// signature: ckb_load_witness, ckb_load_cell, ckb_load_cell_data,
+// ckb_load_input, etc.
+int ckb_sighash_all_load_and_hash(CkbSighashAllCtx *ctx,
+                                  ckb_sighash_all_load_fn f, size_t start,
+                                  size_t index, size_t source,
+                                  bool hash_length) {
+  uint8_t window[CKB_SIGHASH_ALL_MIN_WINDOW];
+  uint8_t *buf = ctx->scratch + ctx->reserved;
+  size_t buf_size = ctx->chunk_size - ctx->reserved;
+  if (buf_size < CKB_SIGHASH_ALL_MIN_WINDOW) {
+    buf = window;
+    buf_size = CKB_SIGHASH_ALL_MIN_WINDOW;
+  }
+  uint64_t len = buf_size;
+  int ret = f(buf, &len, start, index, source);
+  ctx->syscalls += 1;
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  if (hash_length) {
+    ckb_sighash_all_update(ctx, (uint8_t *)&len, sizeof(uint64_t));
+  }
+  uint64_t offset = (len > buf_size) ? buf_size : len;
+  ckb_sighash_all_update(ctx, buf, offset);
+  while (offset < len) {
+    uint64_t current_len = buf_size;
+    ret = f(buf, &current_len, start + offset, index, source);
+    ctx->syscalls += 1;
+    if (ret != CKB_SUCCESS) {
+      return ret;
+    }
+    uint64_t current_read = (current_len > buf_size) ? buf_size : current_len;
+    ckb_sighash_all_update(ctx, buf, current_read);
+    offset += current_read;
+  }
+  return CKB_SUCCESS;
+}
+
+int ckb_sighash_all_hash_witness(CkbSighashAllCtx *ctx, size_t index,
+                                 size_t source) {
+  return ckb_sighash_all_load_and_hash(ctx, ckb_load_witness, 0, index,
+                                       source, true);
+}
+
+int ckb_sighash_all_hash_tx_hash(CkbSighashAllCtx *ctx) {
+  uint8_t tx_hash[CKB_SIGHASH_ALL_HASH_SIZE];
+  uint64_t len = CKB_SIGHASH_ALL_HASH_SIZE;
+  int ret = ckb_load_tx_hash(tx_hash, &len, 0);
+  ctx->syscalls += 1;
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  if (len != CKB_SIGHASH_ALL_HASH_SIZE) {
+    return CKB_SIGHASH_ALL_ERROR_LENGTH;
+  }
+  ckb_sighash_all_update(ctx, tx_hash, CKB_SIGHASH_ALL_HASH_SIZE);
+  return CKB_SUCCESS;
+}
+
+// Digest every witness after the first one: same group witnesses first, then
+// witnesses that are not covered by inputs.
+int ckb_sighash_all_hash_remaining_witnesses(CkbSighashAllCtx *ctx) {
+  size_t i = 1;
+  while (1) {
+    int ret = ckb_sighash_all_hash_witness(ctx, i, CKB_SOURCE_GROUP_INPUT);
+    if (ret == CKB_INDEX_OUT_OF_BOUND) {
+      break;
+    }
+    if (ret != CKB_SUCCESS) {
+      return ret;
+    }
+    i += 1;
+  }
+  i = (size_t)ckb_calculate_inputs_len();
+  while (1) {
+    int ret = ckb_sighash_all_hash_witness(ctx, i, CKB_SOURCE_INPUT);
+    if (ret == CKB_INDEX_OUT_OF_BOUND) {
+      break;
+    }
+    if (ret != CKB_SUCCESS) {
+      return ret;
+    }
+    i += 1;
+  }
+  return CKB_SUCCESS;
+}
+
+typedef struct CkbSighashAllFirstWitness {
+  // full length of the first witness
+  uint64_t len;
+  // lock raw bytes, pointing into the pinned part of scratch buffer
+  uint8_t *lock;
+  uint64_t lock_offset;
+  uint64_t lock_len;
+  // range in the witness hashed as zeros, defaults to the whole lock
+  uint64_t zero_offset;
+  uint64_t zero_len;
+} CkbSighashAllFirstWitness;
+
+// Read a molecule number at `offset` of the first witness, `loaded` bytes of
+// which are already in scratch buffer.
+int _ckb_sighash_all_read_number(CkbSighashAllCtx *ctx, uint64_t loaded,
+                                 uint64_t offset, uint32_t *value) {
+  if (offset + 4 <= loaded) {
+    memcpy(value, ctx->scratch + offset, 4);
+    return CKB_SUCCESS;
+  }
+  uint64_t len = 4;
+  int ret = ckb_load_witness(value, &len, offset, 0, CKB_SOURCE_GROUP_INPUT);
+  ctx->syscalls += 1;
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  if (len < 4) {
+    return CKB_SIGHASH_ALL_ERROR_ENCODING;
+  }
+  return CKB_SUCCESS;
+}
+
+// Verify a BytesOpt field of WitnessArgs spanning [start, end)
+int _ckb_sighash_all_verify_bytes_opt(CkbSighashAllCtx *ctx, uint64_t loaded,
+                                      uint64_t start, uint64_t end) {
+  if (start == end) {
+    return CKB_SUCCESS;
+  }
+  if (end - start < 4) {
+    return CKB_SIGHASH_ALL_ERROR_ENCODING;
+  }
+  uint32_t bytes_len = 0;
+  int ret = _ckb_sighash_all_read_number(ctx, loaded, start, &bytes_len);
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  if ((uint64_t)bytes_len + 4 != end - start) {
+    return CKB_SIGHASH_ALL_ERROR_ENCODING;
+  }
+  return CKB_SUCCESS;
+}
+
+// Load the first witness of current script group as WitnessArgs and locate
+// its lock field, which must be present. Only the head of the witness is
+// loaded into scratch buffer. The witness up to the end of lock field is
+// pinned there, it must fit in scratch buffer, the rest is streamed through
+// whatever scratch buffer is left or the minimum window.
+//
+// Returns CKB_SIGHASH_ALL_ERROR_ENCODING when the witness is malformed, or
+// the error of failed syscall.
+int ckb_sighash_all_load_first_witness(CkbSighashAllCtx *ctx,
+                                       CkbSighashAllFirstWitness *witness) {
+  ctx->reserved = 0;
+  uint64_t len = ctx->chunk_size;
+  int ret = ckb_load_witness(ctx->scratch, &len, 0, 0, CKB_SOURCE_GROUP_INPUT);
+  ctx->syscalls += 1;
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  uint64_t loaded = (len > ctx->chunk_size) ? ctx->chunk_size : len;
+  if (loaded < CKB_SIGHASH_ALL_WITNESS_ARGS_HEADER_SIZE) {
+    return CKB_SIGHASH_ALL_ERROR_ENCODING;
+  }
+  uint32_t header[CKB_SIGHASH_ALL_WITNESS_ARGS_FIELD_COUNT + 1];
+  memcpy(header, ctx->scratch, CKB_SIGHASH_ALL_WITNESS_ARGS_HEADER_SIZE);
+  if (header[0] != len ||
+      header[1] != CKB_SIGHASH_ALL_WITNESS_ARGS_HEADER_SIZE ||
+      header[2] < header[1] || header[3] < header[2] || header[0] < header[3]) {
+    return CKB_SIGHASH_ALL_ERROR_ENCODING;
+  }
+  // lock is required
+  if (header[2] - header[1] < 4) {
+    return CKB_SIGHASH_ALL_ERROR_ENCODING;
+  }
+  uint32_t lock_len = 0;
+  memcpy(&lock_len, ctx->scratch + header[1], 4);
+  if ((uint64_t)lock_len + 4 != header[2] - header[1]) {
+    return CKB_SIGHASH_ALL_ERROR_ENCODING;
+  }
+  if (header[2] >= ctx->chunk_size) {
+    return CKB_SIGHASH_ALL_ERROR_LENGTH;
+  }
+  ret = _ckb_sighash_all_verify_bytes_opt(ctx, loaded, header[2], header[3]);
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  ret = _ckb_sighash_all_verify_bytes_opt(ctx, loaded, header[3], header[0]);
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+
+  witness->len = len;
+  witness->lock_offset = header[1] + 4;
+  witness->lock_len = lock_len;
+  witness->lock = ctx->scratch + witness->lock_offset;
+  witness->zero_offset = witness->lock_offset;
+  witness->zero_len = witness->lock_len;
+  ctx->reserved = header[2];
+  CKB_TRACE("load_witness");
+  return CKB_SUCCESS;
+}
+
+void _ckb_sighash_all_update_zeros(CkbSighashAllCtx *ctx, uint64_t len) {
+  static const uint8_t zeros[128] = {0};
+  while (len > 0) {
+    uint64_t n = (len > sizeof(zeros)) ? sizeof(zeros) : len;
+    ckb_sighash_all_update(ctx, zeros, n);
+    len -= n;
+  }
+}
+
+// Digest the first witness loaded by ckb_sighash_all_load_first_witness with
+// its zero range hashed as zeros. The pinned head is hashed from scratch
+// buffer, anything after lock field is streamed again from the VM.
+int ckb_sighash_all_hash_first_witness(
+    CkbSighashAllCtx *ctx, const CkbSighashAllFirstWitness *witness) {
+  uint64_t pinned = ctx->reserved;
+  uint64_t zero_end = witness->zero_offset + witness->zero_len;
+  if (zero_end < witness->zero_offset || zero_end > pinned) {
+    return CKB_SIGHASH_ALL_ERROR_LENGTH;
+  }
+  ckb_sighash_all_update(ctx, (uint8_t *)&witness->len, sizeof(uint64_t));
+  ckb_sighash_all_update(ctx, ctx->scratch, witness->zero_offset);
+  _ckb_sighash_all_update_zeros(ctx, witness->zero_len);
+  ckb_sighash_all_update(ctx, ctx->scratch + zero_end, pinned - zero_end);
+  if (pinned < witness->len) {
+    return ckb_sighash_all_load_and_hash(ctx, ckb_load_witness, pinned, 0,
+                                         CKB_SOURCE_GROUP_INPUT, false);
+  }
+  return CKB_SUCCESS;
+}
+
+// Calculate the full sighash-all message once the first witness is loaded.
+int ckb_sighash_all_calculate(CkbSighashAllCtx *ctx,
+                              const CkbSighashAllFirstWitness *witness,
+                              uint8_t *message) {
+  int ret = ckb_sighash_all_hash_tx_hash(ctx);
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  ret = ckb_sighash_all_hash_first_witness(ctx, witness);
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  ret = ckb_sighash_all_hash_remaining_witnesses(ctx);
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  ckb_sighash_all_final(ctx, message);
+  CKB_TRACE("message");
+  return CKB_SUCCESS;
+}
+
+#endif  // CKB_MISCELLANEOUS_SCRIPTS_SIGHASH_ALL_HELPER_H_
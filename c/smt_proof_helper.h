@@ -0,0 +1,261 @@
+#ifndef CKB_MISCELLANEOUS_SCRIPTS_SMT_PROOF_HELPER_H_
+#define CKB_MISCELLANEOUS_SCRIPTS_SMT_PROOF_HELPER_H_
+
+// Sparse merkle tree proof verification, for the compiled proofs of the
+// sparse-merkle-tree crate, version 0.4, with the ckb-default-hash blake2b.
+//
+// A compiled proof is a program for a small stack machine, over the leaves
+// being proven in key order:
+//
+// 0x4C              push the next leaf, as its key and leaf hash
+// 0x50 height hash  merge the top of stack with a 32 bytes sibling at height
+// 0x48 height       merge the two top entries, siblings at height
+//
+// and the root is what remains on the stack once the program ends.
+//
+// The proof is read straight from its molecule cursor, through a small
+// window refilled from the cursor's data source, so a proof in a witness is
+// never copied as a whole. All hashes start from one blake2b state
+// initialized once, and leaf hashes are computed once per pair, so several
+// proofs of the same key and value, against different roots, only pay for
+// their merges.
+//
+// This header doesn't include blake2b or molecule by itself: the including
+// script should include them before including this file.
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define CKB_SMT_KEY_BYTES 32
+#define CKB_SMT_VALUE_BYTES 32
+#define CKB_SMT_STACK_SIZE 32
+#define CKB_SMT_READ_WINDOW 256
+
+#define CKB_SMT_ERROR_INVALID_STACK -131
+#define CKB_SMT_ERROR_INVALID_PROOF -132
+#define CKB_SMT_ERROR_ROOT_MISMATCH -133
+
+typedef struct CkbSmtPair {
+  uint8_t key[CKB_SMT_KEY_BYTES];
+  // blake2b(key | value), or zeros when value is zero, see ckb_smt_pair_init
+  uint8_t leaf[32];
+} CkbSmtPair;
+
+// proof bytes, read through a window of the cursor
+typedef struct CkbSmtProofReader {
+  mol2_cursor_t cur;
+  uint8_t window[CKB_SMT_READ_WINDOW];
+  uint32_t start;
+  uint32_t len;
+  uint32_t pos;
+} CkbSmtProofReader;
+
+static blake2b_state g_ckb_smt_blake2b;
+static bool g_ckb_smt_blake2b_ready = false;
+
+static void ckb_smt_hash_init(blake2b_state *ctx) {
+  if (!g_ckb_smt_blake2b_ready) {
+    blake2b_init(&g_ckb_smt_blake2b, 32);
+    g_ckb_smt_blake2b_ready = true;
+  }
+  *ctx = g_ckb_smt_blake2b;
+}
+
+static bool ckb_smt_is_zero(const uint8_t *h) {
+  for (int i = 0; i < 32; i++) {
+    if (h[i] != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void ckb_smt_pair_init(CkbSmtPair *pair, const uint8_t *key,
+                              const uint8_t *value) {
+  memcpy(pair->key, key, CKB_SMT_KEY_BYTES);
+  if (ckb_smt_is_zero(value)) {
+    memset(pair->leaf, 0, sizeof(pair->leaf));
+    return;
+  }
+  blake2b_state ctx;
+  ckb_smt_hash_init(&ctx);
+  blake2b_update(&ctx, key, CKB_SMT_KEY_BYTES);
+  blake2b_update(&ctx, value, CKB_SMT_VALUE_BYTES);
+  blake2b_final(&ctx, pair->leaf, 32);
+}
+
+// dest = merge(lhs, rhs), a zero side is skipped without hashing. dest may
+// alias either side
+static void ckb_smt_merge(uint8_t *dest, const uint8_t *lhs,
+                          const uint8_t *rhs) {
+  if (ckb_smt_is_zero(lhs)) {
+    memmove(dest, rhs, 32);
+    return;
+  }
+  if (ckb_smt_is_zero(rhs)) {
+    memmove(dest, lhs, 32);
+    return;
+  }
+  blake2b_state ctx;
+  ckb_smt_hash_init(&ctx);
+  blake2b_update(&ctx, lhs, 32);
+  blake2b_update(&ctx, rhs, 32);
+  blake2b_final(&ctx, dest, 32);
+}
+
+static int ckb_smt_get_bit(const uint8_t *key, uint8_t height) {
+  return (key[height >> 3] >> (height & 7)) & 1;
+}
+
+// clear the bits at height and below, the key of the parent node
+static void ckb_smt_parent_path(uint8_t *key, uint8_t height) {
+  uint32_t bits = (uint32_t)height + 1;
+  uint32_t bytes = bits / 8;
+  memset(key, 0, bytes);
+  if (bytes < CKB_SMT_KEY_BYTES && bits % 8 != 0) {
+    key[bytes] &= (uint8_t)(0xFF << (bits % 8));
+  }
+}
+
+static void ckb_smt_reader_init(CkbSmtProofReader *reader,
+                                const mol2_cursor_t *proof) {
+  reader->cur = *proof;
+  reader->start = 0;
+  reader->len = 0;
+  reader->pos = 0;
+}
+
+static bool ckb_smt_reader_done(const CkbSmtProofReader *reader) {
+  return reader->pos >= reader->cur.size;
+}
+
+// point *out at the next n bytes of the proof, n <= CKB_SMT_READ_WINDOW
+static int ckb_smt_reader_next(CkbSmtProofReader *reader, uint32_t n,
+                               const uint8_t **out) {
+  if (n > reader->cur.size - reader->pos) {
+    return CKB_SMT_ERROR_INVALID_PROOF;
+  }
+  if (reader->pos + n > reader->start + reader->len) {
+    mol2_cursor_t rest = reader->cur;
+    rest.offset += reader->pos;
+    rest.size -= reader->pos;
+    uint32_t want =
+        rest.size < CKB_SMT_READ_WINDOW ? rest.size : CKB_SMT_READ_WINDOW;
+    uint32_t read_len = mol2_read_at(&rest, reader->window, want);
+    if (read_len < n) {
+      return CKB_SMT_ERROR_INVALID_PROOF;
+    }
+    reader->start = reader->pos;
+    reader->len = read_len;
+  }
+  *out = reader->window + (reader->pos - reader->start);
+  reader->pos += n;
+  return 0;
+}
+
+// Computes the root proven by the compiled proof for pairs, in the order the
+// proof pushes them: ascending keys, compared from the last byte.
+static int ckb_smt_calculate_root(uint8_t *root, const CkbSmtPair *pairs,
+                                  uint32_t pairs_len,
+                                  const mol2_cursor_t *proof) {
+  int err = 0;
+  uint8_t stack_keys[CKB_SMT_STACK_SIZE][CKB_SMT_KEY_BYTES];
+  uint8_t stack_values[CKB_SMT_STACK_SIZE][32];
+  uint32_t stack_top = 0;
+  uint32_t pair_index = 0;
+  CkbSmtProofReader reader;
+  const uint8_t *p;
+
+  ckb_smt_reader_init(&reader, proof);
+  while (!ckb_smt_reader_done(&reader)) {
+    err = ckb_smt_reader_next(&reader, 1, &p);
+    if (err != 0) {
+      return err;
+    }
+    uint8_t op = p[0];
+    if (op == 0x4C) {
+      if (stack_top >= CKB_SMT_STACK_SIZE) {
+        return CKB_SMT_ERROR_INVALID_STACK;
+      }
+      if (pair_index >= pairs_len) {
+        return CKB_SMT_ERROR_INVALID_PROOF;
+      }
+      memcpy(stack_keys[stack_top], pairs[pair_index].key, CKB_SMT_KEY_BYTES);
+      memcpy(stack_values[stack_top], pairs[pair_index].leaf, 32);
+      stack_top++;
+      pair_index++;
+    } else if (op == 0x50) {
+      if (stack_top == 0) {
+        return CKB_SMT_ERROR_INVALID_STACK;
+      }
+      err = ckb_smt_reader_next(&reader, 33, &p);
+      if (err != 0) {
+        return err;
+      }
+      uint8_t height = p[0];
+      const uint8_t *sibling = p + 1;
+      uint8_t *key = stack_keys[stack_top - 1];
+      uint8_t *value = stack_values[stack_top - 1];
+      if (ckb_smt_get_bit(key, height)) {
+        ckb_smt_merge(value, sibling, value);
+      } else {
+        ckb_smt_merge(value, value, sibling);
+      }
+      ckb_smt_parent_path(key, height);
+    } else if (op == 0x48) {
+      if (stack_top < 2) {
+        return CKB_SMT_ERROR_INVALID_STACK;
+      }
+      err = ckb_smt_reader_next(&reader, 1, &p);
+      if (err != 0) {
+        return err;
+      }
+      uint8_t height = p[0];
+      uint8_t *key_a = stack_keys[stack_top - 2];
+      uint8_t *value_a = stack_values[stack_top - 2];
+      uint8_t *key_b = stack_keys[stack_top - 1];
+      uint8_t *value_b = stack_values[stack_top - 1];
+      int a_set = ckb_smt_get_bit(key_a, height);
+      int b_set = ckb_smt_get_bit(key_b, height);
+      ckb_smt_parent_path(key_a, height);
+      ckb_smt_parent_path(key_b, height);
+      // only siblings at height can be merged
+      if (a_set == b_set || memcmp(key_a, key_b, CKB_SMT_KEY_BYTES) != 0) {
+        return CKB_SMT_ERROR_INVALID_PROOF;
+      }
+      if (a_set) {
+        ckb_smt_merge(value_a, value_b, value_a);
+      } else {
+        ckb_smt_merge(value_a, value_a, value_b);
+      }
+      stack_top--;
+    } else {
+      return CKB_SMT_ERROR_INVALID_PROOF;
+    }
+  }
+  // every pair must be used
+  if (pair_index != pairs_len) {
+    return CKB_SMT_ERROR_INVALID_PROOF;
+  }
+  if (stack_top != 1) {
+    return CKB_SMT_ERROR_INVALID_STACK;
+  }
+  memcpy(root, stack_values[0], 32);
+  return 0;
+}
+
+static int ckb_smt_verify(const uint8_t *root, const CkbSmtPair *pairs,
+                          uint32_t pairs_len, const mol2_cursor_t *proof) {
+  uint8_t calculated[32];
+  int err = ckb_smt_calculate_root(calculated, pairs, pairs_len, proof);
+  if (err != 0) {
+    return err;
+  }
+  if (memcmp(calculated, root, 32) != 0) {
+    return CKB_SMT_ERROR_ROOT_MISMATCH;
+  }
+  return 0;
+}
+
+#endif  // CKB_MISCELLANEOUS_SCRIPTS_SMT_PROOF_HELPER_H_
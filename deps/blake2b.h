@@ -336,7 +336,7 @@ int blake2b_init_key( blake2b_state *S, size_t outlen, const void *key, size_t k
     G(r,7,v[ 3],v[ 4],v[ 9],v[14]); \
   } while(0)
 
-static void blake2b_compress( blake2b_state *S, const uint8_t block[BLAKE2B_BLOCKBYTES] )
+static void blake2b_compress_ref( blake2b_state *S, const uint8_t block[BLAKE2B_BLOCKBYTES] )
 {
   uint64_t m[16];
   uint64_t v[16];
@@ -380,6 +380,119 @@ static void blake2b_compress( blake2b_state *S, const uint8_t block[BLAKE2B_BLOC
 #undef G
 #undef ROUND
 
+/*
+ * Unrolled compression kernel, enabled by defining BLAKE2B_UNROLLED.
+ *
+ * The state is kept in 16 scalar locals and the message schedule is spelled
+ * out with literal indices for all 12 rounds, so nothing is looked up from
+ * blake2b_sigma at run time. Aligned blocks are read as words straight from
+ * the caller's buffer on little endian targets.
+ *
+ * Defining BLAKE2B_USE_ZBB as well emits the `rori` instruction for rotates.
+ * It is only available on VMs implementing the B extension (ckb-vm-b-cli),
+ * don't enable it for scripts deployed on chain.
+ */
+#if defined(BLAKE2B_UNROLLED)
+
+#if defined(BLAKE2B_USE_ZBB) && defined(__riscv)
+/* rori rd, rs1, c: OP-IMM, funct3 101, imm[11:6] = 011000 */
+#define BLAKE2B_ROTR64(w, c)                      \
+  ({                                              \
+    uint64_t r__;                                 \
+    __asm__(".insn i 0x13, 5, %0, %1, %2"         \
+            : "=r"(r__)                           \
+            : "r"(w), "i"(0x600 | (c)));          \
+    r__;                                          \
+  })
+#else
+#define BLAKE2B_ROTR64(w, c) (((w) >> (c)) | ((w) << (64 - (c))))
+#endif
+
+#define BLAKE2B_G_U(a, b, c, d, x, y)   \
+  do {                                  \
+    a = a + b + (x);                    \
+    d = BLAKE2B_ROTR64(d ^ a, 32);      \
+    c = c + d;                          \
+    b = BLAKE2B_ROTR64(b ^ c, 24);      \
+    a = a + b + (y);                    \
+    d = BLAKE2B_ROTR64(d ^ a, 16);      \
+    c = c + d;                          \
+    b = BLAKE2B_ROTR64(b ^ c, 63);      \
+  } while(0)
+
+#define BLAKE2B_ROUND_U(s0, s1, s2, s3, s4, s5, s6, s7,          \
+                        s8, s9, s10, s11, s12, s13, s14, s15)    \
+  do {                                                           \
+    BLAKE2B_G_U(v0, v4, v8,  v12, m[s0],  m[s1]);                \
+    BLAKE2B_G_U(v1, v5, v9,  v13, m[s2],  m[s3]);                \
+    BLAKE2B_G_U(v2, v6, v10, v14, m[s4],  m[s5]);                \
+    BLAKE2B_G_U(v3, v7, v11, v15, m[s6],  m[s7]);                \
+    BLAKE2B_G_U(v0, v5, v10, v15, m[s8],  m[s9]);                \
+    BLAKE2B_G_U(v1, v6, v11, v12, m[s10], m[s11]);               \
+    BLAKE2B_G_U(v2, v7, v8,  v13, m[s12], m[s13]);               \
+    BLAKE2B_G_U(v3, v4, v9,  v14, m[s14], m[s15]);               \
+  } while(0)
+
+typedef uint64_t blake2b_aliased_u64 __attribute__((may_alias));
+
+static void blake2b_compress_unrolled( blake2b_state *S, const uint8_t block[BLAKE2B_BLOCKBYTES] )
+{
+  uint64_t buf[16];
+  const uint64_t *m;
+  size_t i;
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+  if( ( ( uintptr_t )block & 7 ) == 0 ) {
+    m = ( const blake2b_aliased_u64 * )block;
+  } else
+#endif
+  {
+    for( i = 0; i < 16; ++i ) {
+      buf[i] = load64( block + i * sizeof( buf[i] ) );
+    }
+    m = buf;
+  }
+
+  uint64_t v0 = S->h[0], v1 = S->h[1], v2 = S->h[2], v3 = S->h[3];
+  uint64_t v4 = S->h[4], v5 = S->h[5], v6 = S->h[6], v7 = S->h[7];
+  uint64_t v8 = blake2b_IV[0], v9 = blake2b_IV[1];
+  uint64_t v10 = blake2b_IV[2], v11 = blake2b_IV[3];
+  uint64_t v12 = blake2b_IV[4] ^ S->t[0];
+  uint64_t v13 = blake2b_IV[5] ^ S->t[1];
+  uint64_t v14 = blake2b_IV[6] ^ S->f[0];
+  uint64_t v15 = blake2b_IV[7] ^ S->f[1];
+
+  BLAKE2B_ROUND_U( 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15);
+  BLAKE2B_ROUND_U(14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3);
+  BLAKE2B_ROUND_U(11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4);
+  BLAKE2B_ROUND_U( 7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8);
+  BLAKE2B_ROUND_U( 9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13);
+  BLAKE2B_ROUND_U( 2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9);
+  BLAKE2B_ROUND_U(12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11);
+  BLAKE2B_ROUND_U(13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10);
+  BLAKE2B_ROUND_U( 6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5);
+  BLAKE2B_ROUND_U(10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0);
+  BLAKE2B_ROUND_U( 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15);
+  BLAKE2B_ROUND_U(14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3);
+
+  S->h[0] ^= v0 ^ v8;
+  S->h[1] ^= v1 ^ v9;
+  S->h[2] ^= v2 ^ v10;
+  S->h[3] ^= v3 ^ v11;
+  S->h[4] ^= v4 ^ v12;
+  S->h[5] ^= v5 ^ v13;
+  S->h[6] ^= v6 ^ v14;
+  S->h[7] ^= v7 ^ v15;
+}
+
+#undef BLAKE2B_G_U
+#undef BLAKE2B_ROUND_U
+
+#define blake2b_compress blake2b_compress_unrolled
+#else
+#define blake2b_compress blake2b_compress_ref
+#endif
+
 int blake2b_update( blake2b_state *S, const void *pin, size_t inlen )
 {
   const unsigned char * in = (const unsigned char *)pin;
@@ -389,11 +502,15 @@ int blake2b_update( blake2b_state *S, const void *pin, size_t inlen )
     size_t fill = BLAKE2B_BLOCKBYTES - left;
     if( inlen > fill )
     {
-      S->buflen = 0;
-      memcpy( S->buf + left, in, fill ); /* Fill buffer */
-      blake2b_increment_counter( S, BLAKE2B_BLOCKBYTES );
-      blake2b_compress( S, S->buf ); /* Compress */
-      in += fill; inlen -= fill;
+      /* With an empty buffer, full blocks are hashed straight from input */
+      if( left > 0 )
+      {
+        S->buflen = 0;
+        memcpy( S->buf + left, in, fill ); /* Fill buffer */
+        blake2b_increment_counter( S, BLAKE2B_BLOCKBYTES );
+        blake2b_compress( S, S->buf ); /* Compress */
+        in += fill; inlen -= fill;
+      }
       while(inlen > BLAKE2B_BLOCKBYTES) {
         blake2b_increment_counter(S, BLAKE2B_BLOCKBYTES);
         blake2b_compress( S, in );
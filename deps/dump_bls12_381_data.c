@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include "blake2b.h"
+#include "blst.h"
+
+/*
+ * Dumps the Miller loop line coefficients of the BLS12-381 G2 generator, as
+ * computed by blst_precompute_lines. A verification pairing the generator
+ * with a G1 point evaluates these lines instead of doubling and adding the
+ * generator along the loop, see bls12_381_sighash_all.c.
+ *
+ * blst is built without assembly, so the coefficients are in the same
+ * Montgomery form and 64 bit little endian limbs as on CKB-VM.
+ */
+
+#define ERROR_IO -1
+
+#define LINES_COUNT 68
+
+void write_hash(FILE* fp, const uint8_t* hash) {
+  fprintf(fp, "{");
+  for (int i = 0; i < 32; i++) {
+    fprintf(fp, "%u", hash[i]);
+    if (i != 31) {
+      fprintf(fp, ", ");
+    }
+  }
+  fprintf(fp, "}");
+}
+
+int main(int argc, char* argv[]) {
+  blst_fp6 lines[LINES_COUNT];
+  blst_precompute_lines(lines, blst_p2_affine_generator());
+
+  FILE* fp_data = fopen("build/bls12_381_data", "wb");
+  if (!fp_data) {
+    return ERROR_IO;
+  }
+  fwrite(lines, sizeof(lines), 1, fp_data);
+  fclose(fp_data);
+
+  uint8_t hash[32];
+  blake2b_state blake2b_ctx;
+  blake2b_init(&blake2b_ctx, 32);
+  blake2b_update(&blake2b_ctx, lines, sizeof(lines));
+  blake2b_final(&blake2b_ctx, hash, 32);
+
+  FILE* fp = fopen("build/bls12_381_data_info.h", "w");
+  if (!fp) {
+    return ERROR_IO;
+  }
+
+  fprintf(fp, "#ifndef CKB_BLS12_381_DATA_INFO_H_\n");
+  fprintf(fp, "#define CKB_BLS12_381_DATA_INFO_H_\n");
+  fprintf(fp, "#define CKB_BLS12_381_DATA_SIZE %ld\n", sizeof(lines));
+  fprintf(fp, "#define CKB_BLS12_381_DATA_LINES %d\n", LINES_COUNT);
+
+  fprintf(fp, "static uint8_t ckb_bls12_381_data_hash[32] = ");
+  write_hash(fp, hash);
+  fprintf(fp, ";\n");
+
+  fprintf(fp, "#endif\n");
+  fclose(fp);
+
+  return 0;
+}
@@ -10,19 +10,77 @@
 #include <secp256k1.c>
 
 #define ERROR_IO -1
+#define ERROR_TABLE_SIZE -2
 
-int main(int argc, char* argv[]) {
-  size_t pre_size = sizeof(secp256k1_ecmult_static_pre_context);
-  size_t pre128_size = sizeof(secp256k1_ecmult_static_pre128_context);
+/*
+ * Besides the full table, smaller window variants down to this size are
+ * dumped. A table of window w holds odd multiples 1G, 3G, ..., (2^(w-1)-1)G,
+ * so each variant is a prefix of pre_g and pre_g_128 of the full table.
+ */
+#define MIN_WINDOW 8
+
+void write_hash(FILE* fp, const uint8_t* hash) {
+  fprintf(fp, "{");
+  for (int i = 0; i < 32; i++) {
+    fprintf(fp, "%u", hash[i]);
+    if (i != 31) {
+      fprintf(fp, ", ");
+    }
+  }
+  fprintf(fp, "}");
+}
 
-  FILE* fp_data = fopen("build/secp256k1_data", "wb");
+int dump_variant(const char* path, size_t variant_size, uint8_t* hash) {
+  FILE* fp_data = fopen(path, "wb");
   if (!fp_data) {
     return ERROR_IO;
   }
-  fwrite(secp256k1_ecmult_static_pre_context, pre_size, 1, fp_data);
-  fwrite(secp256k1_ecmult_static_pre128_context, pre128_size, 1, fp_data);
+  fwrite(secp256k1_ecmult_static_pre_context, variant_size, 1, fp_data);
+  fwrite(secp256k1_ecmult_static_pre128_context, variant_size, 1, fp_data);
   fclose(fp_data);
 
+  blake2b_state blake2b_ctx;
+  blake2b_init(&blake2b_ctx, 32);
+  blake2b_update(&blake2b_ctx, secp256k1_ecmult_static_pre_context,
+                 variant_size);
+  blake2b_update(&blake2b_ctx, secp256k1_ecmult_static_pre128_context,
+                 variant_size);
+  blake2b_final(&blake2b_ctx, hash, 32);
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  size_t pre_size = sizeof(secp256k1_ecmult_static_pre_context);
+  size_t pre128_size = sizeof(secp256k1_ecmult_static_pre128_context);
+  size_t entry_size = sizeof(secp256k1_ge_storage);
+
+  int window = 2;
+  while (((size_t)1 << (window - 2)) * entry_size < pre_size) {
+    window++;
+  }
+  if (((size_t)1 << (window - 2)) * entry_size != pre_size ||
+      pre128_size != pre_size || window < MIN_WINDOW) {
+    return ERROR_TABLE_SIZE;
+  }
+  int variants = window - MIN_WINDOW + 1;
+  uint8_t hashes[variants][32];
+
+  for (int i = 0; i < variants; i++) {
+    int w = window - i;
+    char path[64];
+    if (i == 0) {
+      /* full table keeps its original name */
+      snprintf(path, sizeof(path), "build/secp256k1_data");
+    } else {
+      snprintf(path, sizeof(path), "build/secp256k1_data_w%d", w);
+    }
+    int ret = dump_variant(path, ((size_t)1 << (w - 2)) * entry_size,
+                           hashes[i]);
+    if (ret != 0) {
+      return ret;
+    }
+  }
+
   FILE* fp = fopen("build/secp256k1_data_info.h", "w");
   if (!fp) {
     return ERROR_IO;
@@ -33,23 +91,31 @@ int main(int argc, char* argv[]) {
   fprintf(fp, "#define CKB_SECP256K1_DATA_SIZE %ld\n", pre_size + pre128_size);
   fprintf(fp, "#define CKB_SECP256K1_DATA_PRE_SIZE %ld\n", pre_size);
   fprintf(fp, "#define CKB_SECP256K1_DATA_PRE128_SIZE %ld\n", pre128_size);
+  fprintf(fp, "#define CKB_SECP256K1_DATA_WINDOW %d\n", window);
+  fprintf(fp, "#define CKB_SECP256K1_DATA_VARIANTS %d\n", variants);
 
-  blake2b_state blake2b_ctx;
-  uint8_t hash[32];
-  blake2b_init(&blake2b_ctx, 32);
-  blake2b_update(&blake2b_ctx, secp256k1_ecmult_static_pre_context, pre_size);
-  blake2b_update(&blake2b_ctx, secp256k1_ecmult_static_pre128_context,
-                 pre128_size);
-  blake2b_final(&blake2b_ctx, hash, 32);
+  fprintf(fp, "static uint8_t ckb_secp256k1_data_hash[32] = ");
+  write_hash(fp, hashes[0]);
+  fprintf(fp, ";\n");
 
-  fprintf(fp, "static uint8_t ckb_secp256k1_data_hash[32] = {\n  ");
-  for (int i = 0; i < 32; i++) {
-    fprintf(fp, "%u", hash[i]);
-    if (i != 31) {
+  /* variants are ordered from the largest window to the smallest one */
+  fprintf(fp, "static uint8_t ckb_secp256k1_data_variant_windows[%d] = {",
+          variants);
+  for (int i = 0; i < variants; i++) {
+    fprintf(fp, "%d", window - i);
+    if (i != variants - 1) {
       fprintf(fp, ", ");
     }
   }
-  fprintf(fp, "\n};\n");
+  fprintf(fp, "};\n");
+  fprintf(fp, "static uint8_t ckb_secp256k1_data_variant_hashes[%d][32] = {\n",
+          variants);
+  for (int i = 0; i < variants; i++) {
+    fprintf(fp, "  ");
+    write_hash(fp, hashes[i]);
+    fprintf(fp, i != variants - 1 ? ",\n" : "\n");
+  }
+  fprintf(fp, "};\n");
   fprintf(fp, "#endif\n");
   fclose(fp);
 
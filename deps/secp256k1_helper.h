@@ -17,6 +17,9 @@
 #define USE_EXTERNAL_DEFAULT_CALLBACKS
 #include <secp256k1.c>
 
+/* safegcd inversions used by the library with -DUSE_SAFEGCD_INV_VAR */
+#include "secp256k1_modinv_var.h"
+
 void secp256k1_default_illegal_callback_fn(const char* str, void* data) {
   (void)str;
   (void)data;
@@ -29,6 +32,48 @@ void secp256k1_default_error_callback_fn(const char* str, void* data) {
   ckb_exit(CKB_SECP256K1_HELPER_ERROR_ERROR_CALLBACK);
 }
 
+/*
+ * Two layouts of loaded data are accepted:
+ * - the full table at offset 0, CKB_SECP256K1_DATA_SIZE bytes, as loaded by
+ *   ckb_secp256k1_custom_load_data. Its window is CKB_SECP256K1_DATA_WINDOW,
+ *   which matches WINDOW_G of the library.
+ * - a header followed by any window variant emitted by dump_secp256k1_data,
+ *   as loaded by ckb_secp256k1_custom_load_data_variant.
+ * The full table starts with the storage of G, whose first 4 bytes are never
+ * CKB_SECP256K1_DATA_MAGIC, so the header tells them apart. The context
+ * initialized over either keeps pre_g_128 at 2^(window-2) entries after
+ * pre_g, see ckb_secp256k1_context_window, so a context handed over by
+ * another module is indexed with its own window.
+ */
+#define CKB_SECP256K1_DATA_MAGIC 0x77703273 /* "s2pw" */
+
+typedef struct CkbSecp256k1DataHeader {
+  uint32_t magic;
+  uint32_t window;
+  uint64_t reserved;
+} CkbSecp256k1DataHeader;
+
+#define CKB_SECP256K1_DATA_HEADER_SIZE sizeof(CkbSecp256k1DataHeader)
+/* size of buffers passed to ckb_secp256k1_custom_load_data_variant */
+#define CKB_SECP256K1_DATA_BUFFER_SIZE \
+  (CKB_SECP256K1_DATA_HEADER_SIZE + CKB_SECP256K1_DATA_SIZE)
+
+#define CKB_SECP256K1_DATA_VARIANT_PRE_SIZE(window) \
+  (((size_t)1 << ((window)-2)) * sizeof(secp256k1_ge_storage))
+
+static int ckb_secp256k1_context_window(const secp256k1_ecmult_context* ctx) {
+  size_t entries = *ctx->pre_g_128 - *ctx->pre_g;
+  int window = 2;
+  while (((size_t)1 << (window - 2)) < entries) {
+    window++;
+  }
+  return window;
+}
+
+/*
+ * Loads the full table into data, which should be at least
+ * CKB_SECP256K1_DATA_SIZE big.
+ */
 int ckb_secp256k1_custom_load_data(void* data) {
   size_t index = SIZE_MAX;
   int ret = ckb_look_for_dep_with_hash(ckb_secp256k1_data_hash, &index);
@@ -45,26 +90,258 @@ int ckb_secp256k1_custom_load_data(void* data) {
 }
 
 /*
- * data should at least be CKB_SECP256K1_DATA_SIZE big
- * so as to hold all loaded data.
+ * Looks for the first cell dep holding any of the table variants, and
+ * loads it into data, which should be at least CKB_SECP256K1_DATA_BUFFER_SIZE
+ * big: the header comes first, then the table.
+ */
+int ckb_secp256k1_custom_load_data_variant(void* data) {
+  size_t index = 0;
+  int variant = -1;
+  while (variant < 0) {
+    uint8_t hash[32];
+    uint64_t len = 32;
+    int ret = ckb_load_cell_by_field(hash, &len, 0, index, CKB_SOURCE_CELL_DEP,
+                                     CKB_CELL_FIELD_DATA_HASH);
+    if (ret == CKB_INDEX_OUT_OF_BOUND) {
+      return ret;
+    }
+    if (ret == CKB_SUCCESS) {
+      for (int i = 0; i < CKB_SECP256K1_DATA_VARIANTS; i++) {
+        if (memcmp(hash, ckb_secp256k1_data_variant_hashes[i], 32) == 0) {
+          variant = i;
+          break;
+        }
+      }
+    }
+    if (variant < 0) {
+      index++;
+    }
+  }
+  /* Found a match, load data here */
+  int window = ckb_secp256k1_data_variant_windows[variant];
+  uint64_t size = 2 * CKB_SECP256K1_DATA_VARIANT_PRE_SIZE(window);
+  uint64_t len = size;
+  uint8_t* table = (uint8_t*)data + CKB_SECP256K1_DATA_HEADER_SIZE;
+  int ret = ckb_load_cell_data(table, &len, 0, index, CKB_SOURCE_CELL_DEP);
+  if (ret != CKB_SUCCESS || len != size) {
+    return CKB_SECP256K1_HELPER_ERROR_LOADING_DATA;
+  }
+  CkbSecp256k1DataHeader* header = data;
+  header->magic = CKB_SECP256K1_DATA_MAGIC;
+  header->window = (uint32_t)window;
+  header->reserved = 0;
+  return CKB_SUCCESS;
+}
+
+/*
+ * loaded_data should be filled by ckb_secp256k1_custom_load_data, or by
+ * ckb_secp256k1_custom_load_data_variant, in which case the table window is
+ * taken from its header.
  */
 int ckb_secp256k1_custom_verify_only_initialize(secp256k1_context* context,
                                                 void* loaded_data) {
+  const CkbSecp256k1DataHeader* header = loaded_data;
+  int window = CKB_SECP256K1_DATA_WINDOW;
+  uint8_t* p = loaded_data;
+  if (header->magic == CKB_SECP256K1_DATA_MAGIC) {
+    window = (int)header->window;
+    if (window < 2 || window > WINDOW_G) {
+      return CKB_SECP256K1_HELPER_ERROR_LOADING_DATA;
+    }
+    p += CKB_SECP256K1_DATA_HEADER_SIZE;
+  }
+
   context->illegal_callback = default_illegal_callback;
   context->error_callback = default_error_callback;
 
   secp256k1_ecmult_context_init(&context->ecmult_ctx);
   secp256k1_ecmult_gen_context_init(&context->ecmult_gen_ctx);
 
-  /* Recasting loaded_data to (uint8_t*) for pointer math */
-  uint8_t* p = loaded_data;
   secp256k1_ge_storage(*pre_g)[] = (secp256k1_ge_storage(*)[])p;
-  secp256k1_ge_storage(*pre_g_128)[] =
-      (secp256k1_ge_storage(*)[])(&p[CKB_SECP256K1_DATA_PRE_SIZE]);
+  secp256k1_ge_storage(*pre_g_128)[] = (secp256k1_ge_storage(*)[])(
+      &p[CKB_SECP256K1_DATA_VARIANT_PRE_SIZE(window)]);
   context->ecmult_ctx.pre_g = pre_g;
   context->ecmult_ctx.pre_g_128 = pre_g_128;
 
   return 0;
 }
 
+/*
+ * WINDOW_G is fixed when the library is compiled, so secp256k1_ecmult only
+ * works with the full table. For smaller variants the G part below is
+ * computed with the loaded window, using the same split of ng into 128 bit
+ * halves over pre_g and pre_g_128 as the library does.
+ */
+static void ckb_secp256k1_table_get(secp256k1_ge* r,
+                                    const secp256k1_ge_storage* pre, int n) {
+  if (n > 0) {
+    secp256k1_ge_from_storage(r, &pre[(n - 1) / 2]);
+  } else {
+    secp256k1_ge_from_storage(r, &pre[(-n - 1) / 2]);
+    secp256k1_ge_neg(r, r);
+  }
+}
+
+static void ckb_secp256k1_ecmult(const secp256k1_ecmult_context* ctx,
+                                 secp256k1_gej* r, const secp256k1_gej* a,
+                                 const secp256k1_scalar* na,
+                                 const secp256k1_scalar* ng) {
+  int window = ckb_secp256k1_context_window(ctx);
+  if (window == WINDOW_G) {
+    secp256k1_ecmult(ctx, r, a, na, ng);
+    return;
+  }
+  secp256k1_gej ra;
+  secp256k1_scalar zero;
+  secp256k1_scalar_set_int(&zero, 0);
+  secp256k1_ecmult(ctx, &ra, a, na, &zero);
+
+  int wnaf_ng_1[129];
+  int wnaf_ng_128[129];
+  secp256k1_scalar ng_1, ng_128;
+  secp256k1_scalar_split_128(&ng_1, &ng_128, ng);
+  int bits_ng_1 = secp256k1_ecmult_wnaf(wnaf_ng_1, 129, &ng_1, window);
+  int bits_ng_128 = secp256k1_ecmult_wnaf(wnaf_ng_128, 129, &ng_128, window);
+  int bits = bits_ng_1 > bits_ng_128 ? bits_ng_1 : bits_ng_128;
+
+  secp256k1_ge tmp;
+  secp256k1_gej_set_infinity(r);
+  for (int i = bits - 1; i >= 0; i--) {
+    int n;
+    secp256k1_gej_double_var(r, r, NULL);
+    if (i < bits_ng_1 && (n = wnaf_ng_1[i])) {
+      ckb_secp256k1_table_get(&tmp, *ctx->pre_g, n);
+      secp256k1_gej_add_ge_var(r, r, &tmp, NULL);
+    }
+    if (i < bits_ng_128 && (n = wnaf_ng_128[i])) {
+      ckb_secp256k1_table_get(&tmp, *ctx->pre_g_128, n);
+      secp256k1_gej_add_ge_var(r, r, &tmp, NULL);
+    }
+  }
+  secp256k1_gej_add_var(r, r, &ra, NULL);
+}
+
+/* Same as secp256k1_ecdsa_sig_recover, on top of ckb_secp256k1_ecmult */
+static int ckb_secp256k1_ecdsa_sig_recover(const secp256k1_ecmult_context* ctx,
+                                           const secp256k1_scalar* sigr,
+                                           const secp256k1_scalar* sigs,
+                                           secp256k1_ge* pubkey,
+                                           const secp256k1_scalar* message,
+                                           int recid) {
+  unsigned char brx[32];
+  secp256k1_fe fx;
+  secp256k1_ge x;
+  secp256k1_gej xj;
+  secp256k1_scalar rn, u1, u2;
+  secp256k1_gej qj;
+
+  if (secp256k1_scalar_is_zero(sigr) || secp256k1_scalar_is_zero(sigs)) {
+    return 0;
+  }
+  secp256k1_scalar_get_b32(brx, sigr);
+  secp256k1_fe_set_b32(&fx, brx);
+  if (recid & 2) {
+    if (secp256k1_fe_cmp_var(&fx, &secp256k1_ecdsa_const_p_minus_order) >= 0) {
+      return 0;
+    }
+    secp256k1_fe_add(&fx, &secp256k1_ecdsa_const_order_as_fe);
+  }
+  if (!secp256k1_ge_set_xo_var(&x, &fx, recid & 1)) {
+    return 0;
+  }
+  secp256k1_gej_set_ge(&xj, &x);
+  secp256k1_scalar_inverse_var(&rn, sigr);
+  secp256k1_scalar_mul(&u1, &rn, message);
+  secp256k1_scalar_negate(&u1, &u1);
+  secp256k1_scalar_mul(&u2, &rn, sigs);
+  ckb_secp256k1_ecmult(ctx, &qj, &xj, &u2, &u1);
+  secp256k1_ge_set_gej_var(pubkey, &qj);
+  return !secp256k1_gej_is_infinity(&qj);
+}
+
+/*
+ * Drop-in replacement of secp256k1_ecdsa_recover working with any table
+ * variant loaded by ckb_secp256k1_custom_load_data.
+ */
+int ckb_secp256k1_ecdsa_recover(
+    const secp256k1_context* ctx, secp256k1_pubkey* pubkey,
+    const secp256k1_ecdsa_recoverable_signature* signature,
+    const unsigned char* msg32) {
+  if (ckb_secp256k1_context_window(&ctx->ecmult_ctx) == WINDOW_G) {
+    return secp256k1_ecdsa_recover(ctx, pubkey, signature, msg32);
+  }
+  secp256k1_ge q;
+  secp256k1_scalar r, s;
+  secp256k1_scalar m;
+  int recid;
+
+  secp256k1_ecdsa_recoverable_signature_load(ctx, &r, &s, &recid, signature);
+  secp256k1_scalar_set_b32(&m, msg32, NULL);
+  if (ckb_secp256k1_ecdsa_sig_recover(&ctx->ecmult_ctx, &r, &s, &q, &m,
+                                      recid)) {
+    secp256k1_pubkey_save(pubkey, &q);
+    return 1;
+  }
+  memset(pubkey, 0, sizeof(*pubkey));
+  return 0;
+}
+
+/* Same as secp256k1_ecdsa_sig_verify, on top of ckb_secp256k1_ecmult */
+static int ckb_secp256k1_ecdsa_sig_verify(const secp256k1_ecmult_context* ctx,
+                                          const secp256k1_scalar* sigr,
+                                          const secp256k1_scalar* sigs,
+                                          const secp256k1_ge* pubkey,
+                                          const secp256k1_scalar* message) {
+  unsigned char c[32];
+  secp256k1_scalar sn, u1, u2;
+  secp256k1_fe xr;
+  secp256k1_gej pubkeyj;
+  secp256k1_gej pr;
+
+  if (secp256k1_scalar_is_zero(sigr) || secp256k1_scalar_is_zero(sigs)) {
+    return 0;
+  }
+  secp256k1_scalar_inverse_var(&sn, sigs);
+  secp256k1_scalar_mul(&u1, &sn, message);
+  secp256k1_scalar_mul(&u2, &sn, sigr);
+  secp256k1_gej_set_ge(&pubkeyj, pubkey);
+  ckb_secp256k1_ecmult(ctx, &pr, &pubkeyj, &u2, &u1);
+  if (secp256k1_gej_is_infinity(&pr)) {
+    return 0;
+  }
+  secp256k1_scalar_get_b32(c, sigr);
+  secp256k1_fe_set_b32(&xr, c);
+  if (secp256k1_gej_eq_x_var(&xr, &pr)) {
+    return 1;
+  }
+  if (secp256k1_fe_cmp_var(&xr, &secp256k1_ecdsa_const_p_minus_order) >= 0) {
+    return 0;
+  }
+  secp256k1_fe_add(&xr, &secp256k1_ecdsa_const_order_as_fe);
+  return secp256k1_gej_eq_x_var(&xr, &pr);
+}
+
+/*
+ * Drop-in replacement of secp256k1_ecdsa_verify working with any table
+ * variant loaded by ckb_secp256k1_custom_load_data. Like the library, only
+ * lower-S signatures are accepted.
+ */
+int ckb_secp256k1_ecdsa_verify(const secp256k1_context* ctx,
+                               const secp256k1_ecdsa_signature* signature,
+                               const unsigned char* msg32,
+                               const secp256k1_pubkey* pubkey) {
+  if (ckb_secp256k1_context_window(&ctx->ecmult_ctx) == WINDOW_G) {
+    return secp256k1_ecdsa_verify(ctx, signature, msg32, pubkey);
+  }
+  secp256k1_ge q;
+  secp256k1_scalar r, s;
+  secp256k1_scalar m;
+
+  secp256k1_scalar_set_b32(&m, msg32, NULL);
+  secp256k1_ecdsa_signature_load(ctx, &r, &s, signature);
+  return !secp256k1_scalar_is_high(&s) &&
+         secp256k1_pubkey_load(ctx, &q, pubkey) &&
+         ckb_secp256k1_ecdsa_sig_verify(&ctx->ecmult_ctx, &r, &s, &q, &m);
+}
+
 #endif
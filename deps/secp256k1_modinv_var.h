@@ -0,0 +1,376 @@
+#ifndef CKB_SECP256K1_MODINV_VAR_H_
+#define CKB_SECP256K1_MODINV_VAR_H_
+
+/*
+ * Variable time modular inversion of secp256k1 field elements and scalars,
+ * using the safegcd algorithm of Bernstein and Yang, in the variant with
+ * batches of 62 variable time divsteps that bitcoin-core/secp256k1 adopted
+ * after the version vendored in deps/secp256k1.
+ *
+ * The bundled library inverts by exponentiation: around 260 squarings and
+ * multiplications per inverse, which is a big part of a pubkey recovery.
+ * Only public data is inverted in the verify-only scripts here, so a variable
+ * time algorithm is fine. With -DUSE_SAFEGCD_INV_VAR, secp256k1/secp256k1.patch
+ * routes secp256k1_fe_inv_var and secp256k1_scalar_inverse_var to the
+ * functions below, the constant time secp256k1_fe_inv and
+ * secp256k1_scalar_inverse are left untouched.
+ *
+ * This file needs the secp256k1 types, secp256k1_helper.h includes it right
+ * after secp256k1.c.
+ */
+
+/*
+ * A signed 5x62 bit representation, value = sum(v[i] * 2^(62 * i)). Limbs are
+ * in range (-2^62, 2^62) except the top one.
+ */
+typedef struct {
+  int64_t v[5];
+} ckb_modinv64_signed62;
+
+typedef struct {
+  ckb_modinv64_signed62 modulus;
+  // modulus^-1 mod 2^62
+  uint64_t modulus_inv62;
+} ckb_modinv64_modinfo;
+
+/*
+ * Transition matrix of 62 divsteps, scaled by 2^62:
+ * [f', g'] = [u v; q r] * [f, g] / 2^62
+ */
+typedef struct {
+  int64_t u, v, q, r;
+} ckb_modinv64_trans2x2;
+
+__extension__ typedef __int128 ckb_modinv64_int128;
+
+#define CKB_MODINV64_M62 (UINT64_MAX >> 2)
+
+// 2^256 - 2^32 - 977
+static const ckb_modinv64_modinfo ckb_modinv64_modinfo_fe = {
+    {{-0x1000003D1LL, 0, 0, 0, 256}}, 0x27C7F6E22DDACACFULL};
+
+// order of the curve
+static const ckb_modinv64_modinfo ckb_modinv64_modinfo_scalar = {
+    {{0x3FD25E8CD0364141LL, 0x2ABB739ABD2280EELL, -0x15LL, 0, 256}},
+    0x34F20099AA774EC1ULL};
+
+// x must not be 0, RV64 has no count trailing zeros instruction without Zbb
+static int ckb_modinv64_ctz64_var(uint64_t x) {
+  static const uint8_t debruijn[64] = {
+      0,  1,  2,  53, 3,  7,  54, 27, 4,  38, 41, 8,  34, 55, 48, 28,
+      62, 5,  39, 46, 44, 42, 22, 9,  24, 35, 59, 56, 49, 18, 29, 11,
+      63, 52, 6,  26, 37, 40, 33, 47, 61, 45, 43, 21, 23, 58, 17, 10,
+      51, 25, 36, 32, 60, 20, 57, 16, 50, 31, 19, 15, 30, 14, 13, 12};
+  return debruijn[((x & -x) * 0x022FDD63CC95386DULL) >> 58];
+}
+
+/*
+ * Do 62 divsteps on the low 64 bits of f and g, starting from eta = -delta,
+ * and return the new eta. Runs of zero bits of g are skipped at once, and
+ * each step with an odd g cancels up to 6 (or 4) low bits of g with a single
+ * multiple of f.
+ */
+static int64_t ckb_modinv64_divsteps_62_var(int64_t eta, uint64_t f0,
+                                            uint64_t g0,
+                                            ckb_modinv64_trans2x2 *t) {
+  uint64_t u = 1, v = 0, q = 0, r = 1;
+  uint64_t f = f0, g = g0, m;
+  uint32_t w;
+  int i = 62, limit, zeros;
+
+  for (;;) {
+    // the sentinel bit stops the count at i
+    zeros = ckb_modinv64_ctz64_var(g | (UINT64_MAX << i));
+    g >>= zeros;
+    u <<= zeros;
+    v <<= zeros;
+    eta -= zeros;
+    i -= zeros;
+    if (i == 0) {
+      break;
+    }
+    // g is odd now, if eta is negative, swap f and g with g and -f
+    if (eta < 0) {
+      uint64_t tmp;
+      eta = -eta;
+      tmp = f;
+      f = g;
+      g = -tmp;
+      tmp = u;
+      u = q;
+      q = -tmp;
+      tmp = v;
+      v = r;
+      r = -tmp;
+      // cancel up to min(eta + 1, i, 6) bits of g
+      limit = ((int)eta + 1) > i ? i : ((int)eta + 1);
+      m = (UINT64_MAX >> (64 - limit)) & 63U;
+      w = (f * g * (f * f - 2)) & m;
+    } else {
+      // cancel up to min(eta + 1, i, 4) bits of g
+      limit = ((int)eta + 1) > i ? i : ((int)eta + 1);
+      m = (UINT64_MAX >> (64 - limit)) & 15U;
+      w = f + (((f + 1) & 4) << 1);
+      w = (-w * g) & m;
+    }
+    g += f * w;
+    q += u * w;
+    r += v * w;
+  }
+  t->u = (int64_t)u;
+  t->v = (int64_t)v;
+  t->q = (int64_t)q;
+  t->r = (int64_t)r;
+  return eta;
+}
+
+/*
+ * [d, e] = t * [d, e] / 2^62 mod modulus, a multiple of modulus is added
+ * first so the division is exact. d and e stay in range (-2 * modulus,
+ * modulus).
+ */
+static void ckb_modinv64_update_de_62(ckb_modinv64_signed62 *d,
+                                      ckb_modinv64_signed62 *e,
+                                      const ckb_modinv64_trans2x2 *t,
+                                      const ckb_modinv64_modinfo *modinfo) {
+  const int64_t d0 = d->v[0], d1 = d->v[1], d2 = d->v[2], d3 = d->v[3],
+                d4 = d->v[4];
+  const int64_t e0 = e->v[0], e1 = e->v[1], e2 = e->v[2], e3 = e->v[3],
+                e4 = e->v[4];
+  const int64_t u = t->u, v = t->v, q = t->q, r = t->r;
+  const int64_t *mod = modinfo->modulus.v;
+  int64_t md, me, sd, se;
+  ckb_modinv64_int128 cd, ce;
+
+  // [md, me] start as [u, q] if d is negative, plus [v, r] if e is negative
+  sd = d4 >> 63;
+  se = e4 >> 63;
+  md = (u & sd) + (v & se);
+  me = (q & sd) + (r & se);
+  cd = (ckb_modinv64_int128)u * d0 + (ckb_modinv64_int128)v * e0;
+  ce = (ckb_modinv64_int128)q * d0 + (ckb_modinv64_int128)r * e0;
+  // correct md, me so the low 62 bits of the sums become zero
+  md -= (modinfo->modulus_inv62 * (uint64_t)cd + md) & CKB_MODINV64_M62;
+  me -= (modinfo->modulus_inv62 * (uint64_t)ce + me) & CKB_MODINV64_M62;
+  cd += (ckb_modinv64_int128)mod[0] * md;
+  ce += (ckb_modinv64_int128)mod[0] * me;
+  cd >>= 62;
+  ce >>= 62;
+
+  cd += (ckb_modinv64_int128)u * d1 + (ckb_modinv64_int128)v * e1;
+  ce += (ckb_modinv64_int128)q * d1 + (ckb_modinv64_int128)r * e1;
+  if (mod[1]) {
+    cd += (ckb_modinv64_int128)mod[1] * md;
+    ce += (ckb_modinv64_int128)mod[1] * me;
+  }
+  d->v[0] = (int64_t)cd & CKB_MODINV64_M62;
+  cd >>= 62;
+  e->v[0] = (int64_t)ce & CKB_MODINV64_M62;
+  ce >>= 62;
+
+  cd += (ckb_modinv64_int128)u * d2 + (ckb_modinv64_int128)v * e2;
+  ce += (ckb_modinv64_int128)q * d2 + (ckb_modinv64_int128)r * e2;
+  if (mod[2]) {
+    cd += (ckb_modinv64_int128)mod[2] * md;
+    ce += (ckb_modinv64_int128)mod[2] * me;
+  }
+  d->v[1] = (int64_t)cd & CKB_MODINV64_M62;
+  cd >>= 62;
+  e->v[1] = (int64_t)ce & CKB_MODINV64_M62;
+  ce >>= 62;
+
+  cd += (ckb_modinv64_int128)u * d3 + (ckb_modinv64_int128)v * e3;
+  ce += (ckb_modinv64_int128)q * d3 + (ckb_modinv64_int128)r * e3;
+  if (mod[3]) {
+    cd += (ckb_modinv64_int128)mod[3] * md;
+    ce += (ckb_modinv64_int128)mod[3] * me;
+  }
+  d->v[2] = (int64_t)cd & CKB_MODINV64_M62;
+  cd >>= 62;
+  e->v[2] = (int64_t)ce & CKB_MODINV64_M62;
+  ce >>= 62;
+
+  cd += (ckb_modinv64_int128)u * d4 + (ckb_modinv64_int128)v * e4;
+  ce += (ckb_modinv64_int128)q * d4 + (ckb_modinv64_int128)r * e4;
+  cd += (ckb_modinv64_int128)mod[4] * md;
+  ce += (ckb_modinv64_int128)mod[4] * me;
+  d->v[3] = (int64_t)cd & CKB_MODINV64_M62;
+  cd >>= 62;
+  e->v[3] = (int64_t)ce & CKB_MODINV64_M62;
+  ce >>= 62;
+
+  d->v[4] = (int64_t)cd;
+  e->v[4] = (int64_t)ce;
+}
+
+// [f, g] = t * [f, g] / 2^62 on the low len limbs, the division is exact
+static void ckb_modinv64_update_fg_62_var(int len, ckb_modinv64_signed62 *f,
+                                          ckb_modinv64_signed62 *g,
+                                          const ckb_modinv64_trans2x2 *t) {
+  const int64_t u = t->u, v = t->v, q = t->q, r = t->r;
+  int64_t fi, gi;
+  ckb_modinv64_int128 cf, cg;
+
+  fi = f->v[0];
+  gi = g->v[0];
+  cf = (ckb_modinv64_int128)u * fi + (ckb_modinv64_int128)v * gi;
+  cg = (ckb_modinv64_int128)q * fi + (ckb_modinv64_int128)r * gi;
+  cf >>= 62;
+  cg >>= 62;
+  for (int i = 1; i < len; i++) {
+    fi = f->v[i];
+    gi = g->v[i];
+    cf += (ckb_modinv64_int128)u * fi + (ckb_modinv64_int128)v * gi;
+    cg += (ckb_modinv64_int128)q * fi + (ckb_modinv64_int128)r * gi;
+    f->v[i - 1] = (int64_t)cf & CKB_MODINV64_M62;
+    cf >>= 62;
+    g->v[i - 1] = (int64_t)cg & CKB_MODINV64_M62;
+    cg >>= 62;
+  }
+  f->v[len - 1] = (int64_t)cf;
+  g->v[len - 1] = (int64_t)cg;
+}
+
+/*
+ * Bring r from range (-2 * modulus, modulus) to [0, modulus), negating it
+ * first when sign is negative.
+ */
+static void ckb_modinv64_normalize_62(ckb_modinv64_signed62 *r, int64_t sign,
+                                      const ckb_modinv64_modinfo *modinfo) {
+  const int64_t M62 = (int64_t)CKB_MODINV64_M62;
+  const int64_t *mod = modinfo->modulus.v;
+  int64_t r0 = r->v[0], r1 = r->v[1], r2 = r->v[2], r3 = r->v[3],
+          r4 = r->v[4];
+  int64_t cond_add, cond_negate;
+
+  cond_add = r4 >> 63;
+  r0 += mod[0] & cond_add;
+  r1 += mod[1] & cond_add;
+  r2 += mod[2] & cond_add;
+  r3 += mod[3] & cond_add;
+  r4 += mod[4] & cond_add;
+  cond_negate = sign >> 63;
+  r0 = (r0 ^ cond_negate) - cond_negate;
+  r1 = (r1 ^ cond_negate) - cond_negate;
+  r2 = (r2 ^ cond_negate) - cond_negate;
+  r3 = (r3 ^ cond_negate) - cond_negate;
+  r4 = (r4 ^ cond_negate) - cond_negate;
+  r1 += r0 >> 62;
+  r0 &= M62;
+  r2 += r1 >> 62;
+  r1 &= M62;
+  r3 += r2 >> 62;
+  r2 &= M62;
+  r4 += r3 >> 62;
+  r3 &= M62;
+
+  cond_add = r4 >> 63;
+  r0 += mod[0] & cond_add;
+  r1 += mod[1] & cond_add;
+  r2 += mod[2] & cond_add;
+  r3 += mod[3] & cond_add;
+  r4 += mod[4] & cond_add;
+  r1 += r0 >> 62;
+  r0 &= M62;
+  r2 += r1 >> 62;
+  r1 &= M62;
+  r3 += r2 >> 62;
+  r2 &= M62;
+  r4 += r3 >> 62;
+  r3 &= M62;
+
+  r->v[0] = r0;
+  r->v[1] = r1;
+  r->v[2] = r2;
+  r->v[3] = r3;
+  r->v[4] = r4;
+}
+
+// x = x^-1 mod modulus for x in [0, modulus), 0 is mapped to 0
+static void ckb_modinv64_var(ckb_modinv64_signed62 *x,
+                             const ckb_modinv64_modinfo *modinfo) {
+  ckb_modinv64_signed62 d = {{0, 0, 0, 0, 0}};
+  ckb_modinv64_signed62 e = {{1, 0, 0, 0, 0}};
+  ckb_modinv64_signed62 f = modinfo->modulus;
+  ckb_modinv64_signed62 g = *x;
+  int len = 5;
+  int64_t eta = -1;
+  int64_t cond, fn, gn;
+
+  for (;;) {
+    ckb_modinv64_trans2x2 t;
+    eta = ckb_modinv64_divsteps_62_var(eta, f.v[0], g.v[0], &t);
+    ckb_modinv64_update_de_62(&d, &e, &t, modinfo);
+    ckb_modinv64_update_fg_62_var(len, &f, &g, &t);
+    if (g.v[0] == 0) {
+      cond = 0;
+      for (int j = 1; j < len; j++) {
+        cond |= g.v[j];
+      }
+      if (cond == 0) {
+        break;
+      }
+    }
+    // drop the top limb once it is 0 or -1 in both f and g
+    fn = f.v[len - 1];
+    gn = g.v[len - 1];
+    cond = ((int64_t)len - 2) >> 63;
+    cond |= fn ^ (fn >> 63);
+    cond |= gn ^ (gn >> 63);
+    if (cond == 0) {
+      f.v[len - 2] |= (uint64_t)fn << 62;
+      g.v[len - 2] |= (uint64_t)gn << 62;
+      len--;
+    }
+  }
+  // f is +/-1 now, and d is +/- the inverse
+  ckb_modinv64_normalize_62(&d, f.v[len - 1], modinfo);
+  *x = d;
+}
+
+static void ckb_secp256k1_fe_inv_var(secp256k1_fe *r, const secp256k1_fe *a) {
+  secp256k1_fe tmp = *a;
+  ckb_modinv64_signed62 s;
+  secp256k1_fe_normalize_var(&tmp);
+  const uint64_t a0 = tmp.n[0], a1 = tmp.n[1], a2 = tmp.n[2], a3 = tmp.n[3],
+                 a4 = tmp.n[4];
+  s.v[0] = (a0 | a1 << 52) & CKB_MODINV64_M62;
+  s.v[1] = (a1 >> 10 | a2 << 42) & CKB_MODINV64_M62;
+  s.v[2] = (a2 >> 20 | a3 << 32) & CKB_MODINV64_M62;
+  s.v[3] = (a3 >> 30 | a4 << 22) & CKB_MODINV64_M62;
+  s.v[4] = a4 >> 40;
+
+  ckb_modinv64_var(&s, &ckb_modinv64_modinfo_fe);
+
+  const uint64_t M52 = UINT64_MAX >> 12;
+  const uint64_t s0 = s.v[0], s1 = s.v[1], s2 = s.v[2], s3 = s.v[3],
+                 s4 = s.v[4];
+  tmp.n[0] = s0 & M52;
+  tmp.n[1] = (s0 >> 52 | s1 << 10) & M52;
+  tmp.n[2] = (s1 >> 42 | s2 << 20) & M52;
+  tmp.n[3] = (s2 >> 32 | s3 << 30) & M52;
+  tmp.n[4] = s3 >> 22 | s4 << 40;
+  *r = tmp;
+}
+
+static void ckb_secp256k1_scalar_inverse_var(secp256k1_scalar *r,
+                                             const secp256k1_scalar *x) {
+  ckb_modinv64_signed62 s;
+  const uint64_t x0 = x->d[0], x1 = x->d[1], x2 = x->d[2], x3 = x->d[3];
+  s.v[0] = x0 & CKB_MODINV64_M62;
+  s.v[1] = (x0 >> 62 | x1 << 2) & CKB_MODINV64_M62;
+  s.v[2] = (x1 >> 60 | x2 << 4) & CKB_MODINV64_M62;
+  s.v[3] = (x2 >> 58 | x3 << 6) & CKB_MODINV64_M62;
+  s.v[4] = x3 >> 56;
+
+  ckb_modinv64_var(&s, &ckb_modinv64_modinfo_scalar);
+
+  const uint64_t s0 = s.v[0], s1 = s.v[1], s2 = s.v[2], s3 = s.v[3],
+                 s4 = s.v[4];
+  r->d[0] = s0 | s1 << 62;
+  r->d[1] = s1 >> 2 | s2 << 60;
+  r->d[2] = s2 >> 4 | s3 << 58;
+  r->d[3] = s3 >> 6 | s4 << 56;
+}
+
+#endif
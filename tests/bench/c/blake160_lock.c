@@ -0,0 +1,42 @@
+/*
+ * A blake160 hash lock exporting the verify function expected by or and and
+ * lock scripts, tests/bench uses it as their child script so the numbers
+ * mostly show the composing overhead.
+ *
+ * Arguments:
+ * 20 byte blake160 hash of the preimage.
+ *
+ * Witness:
+ * The preimage.
+ */
+#define __SHARED_LIBRARY__ 1
+#include "blake2b.h"
+#include "blockchain.h"
+#include "ckb_syscalls.h"
+
+#define ERROR_ARGUMENTS_LEN -1
+#define ERROR_PREIMAGE_HASH -111
+
+#define BLAKE2B_BLOCK_SIZE 32
+#define BLAKE160_SIZE 20
+
+__attribute__((visibility("default"))) int verify(const mol_seg_t *script,
+                                                  const mol_seg_t *witness) {
+  mol_seg_t args_seg = MolReader_Script_get_args(script);
+  mol_seg_t args_bytes_seg = MolReader_Bytes_raw_bytes(&args_seg);
+  if (args_bytes_seg.size != BLAKE160_SIZE) {
+    return ERROR_ARGUMENTS_LEN;
+  }
+  mol_seg_t preimage_seg = MolReader_Bytes_raw_bytes(witness);
+
+  uint8_t hash[BLAKE2B_BLOCK_SIZE];
+  blake2b_state blake2b_ctx;
+  blake2b_init(&blake2b_ctx, BLAKE2B_BLOCK_SIZE);
+  blake2b_update(&blake2b_ctx, preimage_seg.ptr, preimage_seg.size);
+  blake2b_final(&blake2b_ctx, hash, BLAKE2B_BLOCK_SIZE);
+
+  if (memcmp(args_bytes_seg.ptr, hash, BLAKE160_SIZE) != 0) {
+    return ERROR_PREIMAGE_HASH;
+  }
+  return CKB_SUCCESS;
+}
@@ -0,0 +1,77 @@
+/*
+ * Lock script used by tests/bench to drive rsa_sighash_all, which is only
+ * shipped as a library. It loads rsa_sighash_all by data hash, runs
+ * validate_rsa_sighash_all and compares the output with script args.
+ *
+ * Arguments:
+ * 20 byte output expected from validate_rsa_sighash_all, which is the RSA
+ * public key blake160 hash. Empty args only check the return code, this is
+ * used by ISO 9796-2 signatures which output the recovered message instead.
+ */
+#include "blockchain.h"
+#include "ckb_dlfcn.h"
+#include "ckb_syscalls.h"
+#include "rsa_sighash_all_lib.h"
+
+#define ERROR_ARGUMENTS_LEN -1
+#define ERROR_ENCODING -2
+#define ERROR_SYSCALL -3
+#define ERROR_SCRIPT_TOO_LONG -21
+#define ERROR_PUBKEY_BLAKE160_HASH -31
+#define ERROR_DYNAMIC_LOADING -103
+
+#define BLAKE160_SIZE 20
+#define SCRIPT_SIZE 32768
+#define CODE_SIZE (512 * 1024)
+
+static uint8_t code_buffer[CODE_SIZE] __attribute__((aligned(RISCV_PGSIZE)));
+
+int main() {
+  void *handle = NULL;
+  uint64_t consumed_size = 0;
+  int ret = ckb_dlopen(rsa_sighash_all_data_hash, code_buffer, CODE_SIZE,
+                       &handle, &consumed_size);
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  int (*verify_func)(uint8_t *);
+  *(void **)(&verify_func) = ckb_dlsym(handle, "validate_rsa_sighash_all");
+  if (verify_func == NULL) {
+    return ERROR_DYNAMIC_LOADING;
+  }
+
+  /* Load args */
+  unsigned char script[SCRIPT_SIZE];
+  uint64_t len = SCRIPT_SIZE;
+  ret = ckb_load_script(script, &len, 0);
+  if (ret != CKB_SUCCESS) {
+    return ERROR_SYSCALL;
+  }
+  if (len > SCRIPT_SIZE) {
+    return ERROR_SCRIPT_TOO_LONG;
+  }
+  mol_seg_t script_seg;
+  script_seg.ptr = (uint8_t *)script;
+  script_seg.size = len;
+
+  if (MolReader_Script_verify(&script_seg, false) != MOL_OK) {
+    return ERROR_ENCODING;
+  }
+
+  mol_seg_t args_seg = MolReader_Script_get_args(&script_seg);
+  mol_seg_t args_bytes_seg = MolReader_Bytes_raw_bytes(&args_seg);
+  if (args_bytes_seg.size != 0 && args_bytes_seg.size != BLAKE160_SIZE) {
+    return ERROR_ARGUMENTS_LEN;
+  }
+
+  uint8_t output[BLAKE160_SIZE];
+  ret = verify_func(output);
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  if (args_bytes_seg.size == BLAKE160_SIZE &&
+      memcmp(output, args_bytes_seg.ptr, BLAKE160_SIZE) != 0) {
+    return ERROR_PUBKEY_BLAKE160_HASH;
+  }
+  return CKB_SUCCESS;
+}
@@ -0,0 +1,98 @@
+/*
+ * A secp256k1 blake160 sighash-all lock exporting the verify function
+ * expected by or and and lock scripts. tests/bench nests it in and as the
+ * baseline of secp256k1_blake2b_multisig: every child computes the message
+ * and loads the secp256k1 table on its own.
+ *
+ * Arguments:
+ * 20 byte blake160 hash of the compressed pubkey.
+ *
+ * Witness:
+ * 65 byte recoverable signature. The message digests the whole lock field of
+ * the first witness, which holds all children witnesses, as zeros.
+ */
+#define __SHARED_LIBRARY__ 1
+#include "blake2b.h"
+#include "blockchain.h"
+#include "ckb_syscalls.h"
+#include "secp256k1_helper.h"
+#include "sighash_all_helper.h"
+
+#define ERROR_ARGUMENTS_LEN -1
+#define ERROR_SYSCALL -3
+#define ERROR_SECP_RECOVER_PUBKEY -11
+#define ERROR_SECP_PARSE_SIGNATURE -14
+#define ERROR_SECP_SERIALIZE_PUBKEY -15
+#define ERROR_WITNESS_SIZE -22
+#define ERROR_PUBKEY_BLAKE160_HASH -31
+
+#define BLAKE2B_BLOCK_SIZE 32
+#define BLAKE160_SIZE 20
+#define PUBKEY_SIZE 33
+#define RECID_INDEX 64
+#define SIGNATURE_SIZE 65
+#define TEMP_SIZE 32768
+
+__attribute__((visibility("default"))) int verify(const mol_seg_t *script,
+                                                  const mol_seg_t *witness) {
+  mol_seg_t args_seg = MolReader_Script_get_args(script);
+  mol_seg_t args_bytes_seg = MolReader_Bytes_raw_bytes(&args_seg);
+  if (args_bytes_seg.size != BLAKE160_SIZE) {
+    return ERROR_ARGUMENTS_LEN;
+  }
+  mol_seg_t signature_seg = MolReader_Bytes_raw_bytes(witness);
+  if (signature_seg.size != SIGNATURE_SIZE) {
+    return ERROR_WITNESS_SIZE;
+  }
+
+  uint8_t temp[TEMP_SIZE];
+  CkbSighashAllCtx sighash_ctx;
+  ckb_sighash_all_init(&sighash_ctx, temp, TEMP_SIZE);
+  CkbSighashAllFirstWitness first_witness;
+  int ret = ckb_sighash_all_load_first_witness(&sighash_ctx, &first_witness);
+  if (ret != CKB_SUCCESS) {
+    return ERROR_SYSCALL;
+  }
+  uint8_t message[BLAKE2B_BLOCK_SIZE];
+  ret = ckb_sighash_all_calculate(&sighash_ctx, &first_witness, message);
+  if (ret != CKB_SUCCESS) {
+    return ERROR_SYSCALL;
+  }
+
+  secp256k1_context context;
+  uint8_t secp_data[CKB_SECP256K1_DATA_BUFFER_SIZE];
+  ret = ckb_secp256k1_custom_load_data_variant(secp_data);
+  if (ret != 0) {
+    return ret;
+  }
+  ret = ckb_secp256k1_custom_verify_only_initialize(&context, secp_data);
+  if (ret != 0) {
+    return ret;
+  }
+
+  secp256k1_ecdsa_recoverable_signature signature;
+  if (secp256k1_ecdsa_recoverable_signature_parse_compact(
+          &context, &signature, signature_seg.ptr,
+          signature_seg.ptr[RECID_INDEX]) == 0) {
+    return ERROR_SECP_PARSE_SIGNATURE;
+  }
+  secp256k1_pubkey pubkey;
+  if (ckb_secp256k1_ecdsa_recover(&context, &pubkey, &signature, message) !=
+      1) {
+    return ERROR_SECP_RECOVER_PUBKEY;
+  }
+  size_t pubkey_size = PUBKEY_SIZE;
+  if (secp256k1_ec_pubkey_serialize(&context, temp, &pubkey_size, &pubkey,
+                                    SECP256K1_EC_COMPRESSED) != 1) {
+    return ERROR_SECP_SERIALIZE_PUBKEY;
+  }
+
+  blake2b_state blake2b_ctx;
+  blake2b_init(&blake2b_ctx, BLAKE2B_BLOCK_SIZE);
+  blake2b_update(&blake2b_ctx, temp, pubkey_size);
+  blake2b_final(&blake2b_ctx, temp, BLAKE2B_BLOCK_SIZE);
+  if (memcmp(args_bytes_seg.ptr, temp, BLAKE160_SIZE) != 0) {
+    return ERROR_PUBKEY_BLAKE160_HASH;
+  }
+  return CKB_SUCCESS;
+}
@@ -0,0 +1,851 @@
+// Fixed corpus of mock transactions, one per benchmarked script.
+//
+// Every key, preimage and out point is derived from constants, so the same
+// binaries always produce the same transactions and the same cycles.
+use std::fs;
+use std::path::{Path, PathBuf};
+
+use blst::min_pk::SecretKey;
+use ckb_crypto::secp::Privkey;
+use ckb_script::ScriptGroupType;
+use ckb_types::{
+    bytes::{BufMut, Bytes, BytesMut},
+    core::{Capacity, DepType, ScriptHashType, TransactionBuilder, TransactionView},
+    packed::{
+        self, Byte32, BytesVec, CellDep, CellInput, CellOutput, OutPoint, Script, ScriptVec,
+        WitnessArgs,
+    },
+    prelude::*,
+    H256,
+};
+use rand::SeedableRng;
+use rand_chacha::ChaCha20Rng;
+use rsa::{BigUint, PublicKeyParts, RSAPrivateKey};
+use secp256k1::{PublicKey, Secp256k1, SecretKey};
+use sha1::Sha1;
+use sha2::{Digest, Sha256};
+
+use blst_test::rc_lock::RcLockWitnessLock;
+
+use crate::loader::DummyDataLoader;
+
+pub const BLS_DST: &[u8] = b"BLS_SIG_BLS12381G2_XMD:SHA-256_SSWU_RO_NUL_";
+pub const IDENTITY_FLAGS_BLS12_381: u8 = 15;
+
+pub const SECP256K1_SIGNATURE_SIZE: usize = 65;
+pub const SECP256K1_PUBKEY_SIZE: usize = 33;
+// BIP340 signatures of the dual library: algorithm id | x-only pubkey | sig,
+// see the signature layouts in c/secp256k1_blake2b_sighash_all_dual.c
+pub const SCHNORR_ALGORITHM_ID: u8 = 0x80;
+pub const SCHNORR_SIGNATURE_SIZE: usize = 97;
+pub const RSA_ALGORITHM_ID: u32 = 1;
+pub const ISO9796_2_ALGORITHM_ID: u32 = 3;
+pub const RSA_E: u32 = 65537;
+
+// open transaction sighash coverage array: sighash all, then end of list
+const OPEN_TX_SIGHASH_ARRAY: [u8; 6] = [0x00, 0x00, 0x00, 0xF0, 0x00, 0x00];
+
+// SHA-256 DigestInfo prefix of EMSA-PKCS1-v1_5
+const PKCS1_SHA256_PREFIX: [u8; 19] = [
+    0x30, 0x31, 0x30, 0x0d, 0x06, 0x09, 0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x01, 0x05,
+    0x00, 0x04, 0x20,
+];
+// ISO 9796-2 explicit trailer for SHA-1
+const ISO9796_2_TRAILER_SHA1: [u8; 2] = [0x33, 0xCC];
+
+pub struct Case {
+    pub name: &'static str,
+    // binary whose size is reported
+    pub binary: &'static str,
+    // binary loaded by CKB-VM, its image span is reported as memory
+    pub entry: &'static str,
+    pub data_loader: DummyDataLoader,
+    pub tx: TransactionView,
+    pub group_type: ScriptGroupType,
+    pub script_hash: Byte32,
+}
+
+pub struct Binaries {
+    build_dir: PathBuf,
+}
+
+impl Binaries {
+    pub fn new(build_dir: &Path) -> Self {
+        Binaries {
+            build_dir: build_dir.to_owned(),
+        }
+    }
+
+    pub fn load(&self, name: &str) -> Bytes {
+        let path = self.build_dir.join(name);
+        let data = fs::read(&path).unwrap_or_else(|e| {
+            panic!(
+                "failed to read {}: {}, run `make bench` from repo root",
+                path.display(),
+                e
+            )
+        });
+        Bytes::from(data)
+    }
+}
+
+pub fn blake160(message: &[u8]) -> Bytes {
+    let r = ckb_hash::blake2b_256(message);
+    Bytes::copy_from_slice(&r[..20])
+}
+
+fn data_script(code_hash: &Byte32, args: Bytes) -> Script {
+    Script::new_builder()
+        .code_hash(code_hash.clone())
+        .hash_type(ScriptHashType::Data.into())
+        .args(args.pack())
+        .build()
+}
+
+// A lock that is never executed, used by cells whose lock is not measured.
+fn dummy_lock() -> Script {
+    Script::new_builder()
+        .hash_type(ScriptHashType::Data.into())
+        .build()
+}
+
+struct Context {
+    data_loader: DummyDataLoader,
+    tx_builder: TransactionBuilder,
+    out_points: u64,
+}
+
+impl Context {
+    fn new() -> Self {
+        Context {
+            data_loader: DummyDataLoader::new(),
+            tx_builder: TransactionBuilder::default(),
+            out_points: 0,
+        }
+    }
+
+    fn new_out_point(&mut self) -> OutPoint {
+        self.out_points += 1;
+        let tx_hash = ckb_hash::blake2b_256(&self.out_points.to_le_bytes());
+        OutPoint::new(tx_hash.pack(), 0)
+    }
+
+    // deploy "bin" in a cell dep, returns its data hash
+    fn deploy(&mut self, bin: &Bytes) -> Byte32 {
+        let out_point = self.new_out_point();
+        let cell = CellOutput::new_builder()
+            .capacity(Capacity::bytes(bin.len()).expect("capacity").pack())
+            .build();
+        self.data_loader
+            .cells
+            .insert(out_point.clone(), (cell, bin.clone()));
+        let tx_builder = std::mem::take(&mut self.tx_builder);
+        self.tx_builder = tx_builder.cell_dep(
+            CellDep::new_builder()
+                .out_point(out_point)
+                .dep_type(DepType::Code.into())
+                .build(),
+        );
+        CellOutput::calc_data_hash(bin)
+    }
+
+    fn cell(lock: Script, type_: Option<Script>) -> CellOutput {
+        CellOutput::new_builder()
+            .capacity(Capacity::shannons(42).pack())
+            .lock(lock)
+            .type_(type_.pack())
+            .build()
+    }
+
+    // add an input with an empty WitnessArgs
+    fn input(&mut self, lock: Script, type_: Option<Script>, data: Bytes) {
+        let out_point = self.new_out_point();
+        self.data_loader
+            .cells
+            .insert(out_point.clone(), (Self::cell(lock, type_), data));
+        let tx_builder = std::mem::take(&mut self.tx_builder);
+        self.tx_builder = tx_builder
+            .input(CellInput::new(out_point, 0))
+            .witness(WitnessArgs::default().as_bytes().pack());
+    }
+
+    fn output(&mut self, lock: Script, type_: Option<Script>, data: Bytes) {
+        let tx_builder = std::mem::take(&mut self.tx_builder);
+        self.tx_builder = tx_builder
+            .output(Self::cell(lock, type_))
+            .output_data(data.pack());
+    }
+
+    fn build(
+        self,
+        name: &'static str,
+        binary: &'static str,
+        entry: &'static str,
+        group_type: ScriptGroupType,
+        script: &Script,
+    ) -> Case {
+        Case {
+            name,
+            binary,
+            entry,
+            data_loader: self.data_loader,
+            tx: self.tx_builder.build(),
+            group_type,
+            script_hash: script.calc_script_hash(),
+        }
+    }
+}
+
+fn set_first_lock(tx: &TransactionView, lock: Bytes) -> TransactionView {
+    let mut witnesses: Vec<packed::Bytes> = tx.witnesses().into_iter().collect();
+    let witness = WitnessArgs::new_unchecked(witnesses[0].unpack())
+        .as_builder()
+        .lock(Some(lock).pack())
+        .build();
+    witnesses[0] = witness.as_bytes().pack();
+    tx.as_advanced_builder().set_witnesses(witnesses).build()
+}
+
+// blake2b(prefix | tx_hash | len(w0) | w0 | len(w1) | w1 | ...), every input
+// of the corpus transactions belongs to the signed group, so all witnesses are
+// digested in order.
+fn sighash_all_message(prefix: &[u8], tx: &TransactionView) -> [u8; 32] {
+    let mut blake2b = ckb_hash::new_blake2b();
+    blake2b.update(prefix);
+    blake2b.update(&tx.hash().raw_data());
+    for witness in tx.witnesses().into_iter() {
+        let witness = witness.raw_data();
+        blake2b.update(&(witness.len() as u64).to_le_bytes());
+        blake2b.update(&witness);
+    }
+    let mut message = [0u8; 32];
+    blake2b.finalize(&mut message);
+    message
+}
+
+// Digest the tx with "zero_lock" in the first witness, then replace it with
+// the lock returned by "sign". "zero_lock" holds zeros wherever the script
+// digests zeros.
+fn sign_sighash_all<F>(
+    tx: TransactionView,
+    prefix: &[u8],
+    zero_lock: Bytes,
+    sign: F,
+) -> TransactionView
+where
+    F: FnOnce(&[u8; 32]) -> Bytes,
+{
+    let tx = set_first_lock(&tx, zero_lock.clone());
+    let message = sighash_all_message(prefix, &tx);
+    let lock = sign(&message);
+    assert_eq!(lock.len(), zero_lock.len());
+    set_first_lock(&tx, lock)
+}
+
+fn secp256k1_key(seed: u8) -> Privkey {
+    Privkey::from_slice(&[seed; 32])
+}
+
+fn secp256k1_pubkey_hash(key: &Privkey) -> Bytes {
+    blake160(&key.pubkey().expect("pubkey").serialize())
+}
+
+fn secp256k1_sign(key: &Privkey, message: &[u8; 32]) -> Bytes {
+    let message = H256::from(*message);
+    let signature = key.sign_recoverable(&message).expect("sign");
+    Bytes::from(signature.serialize())
+}
+
+// The dual lock accepts any window variant of the secp256k1 table in cell
+// deps, secp256k1_data is the full table. With "with_pubkey", the lock
+// carries the compressed pubkey and a 64 byte signature, which the script
+// verifies instead of recovering the pubkey.
+fn dual_with_table(bins: &Binaries, name: &'static str, table: &str, with_pubkey: bool) -> Case {
+    let mut ctx = Context::new();
+    let code_hash = ctx.deploy(&bins.load("secp256k1_blake2b_sighash_all_dual"));
+    ctx.deploy(&bins.load(table));
+
+    let key = secp256k1_key(0x11);
+    let lock = data_script(&code_hash, secp256k1_pubkey_hash(&key));
+    ctx.input(lock.clone(), None, Bytes::new());
+    ctx.output(lock.clone(), None, Bytes::new());
+
+    let mut case = ctx.build(
+        name,
+        "secp256k1_blake2b_sighash_all_dual",
+        "secp256k1_blake2b_sighash_all_dual",
+        ScriptGroupType::Lock,
+        &lock,
+    );
+    let lock_len = if with_pubkey {
+        SECP256K1_PUBKEY_SIZE + SECP256K1_SIGNATURE_SIZE - 1
+    } else {
+        SECP256K1_SIGNATURE_SIZE
+    };
+    let zero_lock = Bytes::from(vec![0u8; lock_len]);
+    case.tx = sign_sighash_all(case.tx, &[], zero_lock, |message| {
+        let signature = secp256k1_sign(&key, message);
+        if with_pubkey {
+            let mut lock = key.pubkey().expect("pubkey").serialize();
+            lock.extend_from_slice(&signature[..SECP256K1_SIGNATURE_SIZE - 1]);
+            Bytes::from(lock)
+        } else {
+            signature
+        }
+    });
+    case
+}
+
+pub fn secp256k1_blake2b_sighash_all_dual(bins: &Binaries) -> Case {
+    dual_with_table(
+        bins,
+        "secp256k1_blake2b_sighash_all_dual",
+        "secp256k1_data",
+        false,
+    )
+}
+
+pub fn secp256k1_blake2b_sighash_all_dual_pubkey(bins: &Binaries) -> Case {
+    dual_with_table(
+        bins,
+        "secp256k1_blake2b_sighash_all_dual_pubkey",
+        "secp256k1_data",
+        true,
+    )
+}
+
+pub fn secp256k1_blake2b_sighash_all_dual_w12(bins: &Binaries) -> Case {
+    dual_with_table(
+        bins,
+        "secp256k1_blake2b_sighash_all_dual_w12",
+        "secp256k1_data_w12",
+        false,
+    )
+}
+
+pub fn secp256k1_blake2b_sighash_all_dual_w8(bins: &Binaries) -> Case {
+    dual_with_table(
+        bins,
+        "secp256k1_blake2b_sighash_all_dual_w8",
+        "secp256k1_data_w8",
+        false,
+    )
+}
+
+// Unlocked through the secret path: signature of the second pubkey hash plus
+// the preimage of secret hash.
+pub fn htlc(bins: &Binaries) -> Case {
+    let mut ctx = Context::new();
+    let code_hash = ctx.deploy(&bins.load("htlc"));
+    ctx.deploy(&bins.load("secp256k1_blake2b_sighash_all_lib.so"));
+    ctx.deploy(&bins.load("secp256k1_data"));
+
+    let refund_key = secp256k1_key(0x21);
+    let secret_key = secp256k1_key(0x22);
+    let preimage = [0x23u8; 32];
+    let mut args = BytesMut::with_capacity(80);
+    args.put(secp256k1_pubkey_hash(&refund_key).as_ref());
+    args.put(secp256k1_pubkey_hash(&secret_key).as_ref());
+    args.put(Sha256::digest(&preimage).as_slice());
+    args.put_u64_le(0);
+    let lock = data_script(&code_hash, args.freeze());
+    ctx.input(lock.clone(), None, Bytes::new());
+    ctx.output(lock.clone(), None, Bytes::new());
+
+    let mut case = ctx.build("htlc", "htlc", "htlc", ScriptGroupType::Lock, &lock);
+    let zero_lock = Bytes::from(vec![0u8; SECP256K1_SIGNATURE_SIZE + preimage.len()]);
+    case.tx = sign_sighash_all(case.tx, &[], zero_lock, |message| {
+        let mut lock = BytesMut::from(secp256k1_sign(&secret_key, message).as_ref());
+        lock.put(&preimage[..]);
+        lock.freeze()
+    });
+    case
+}
+
+pub fn open_transaction(bins: &Binaries) -> Case {
+    let mut ctx = Context::new();
+    let code_hash = ctx.deploy(&bins.load("open_transaction"));
+    ctx.deploy(&bins.load("secp256k1_data"));
+
+    let key = secp256k1_key(0x31);
+    let lock = data_script(&code_hash, secp256k1_pubkey_hash(&key));
+    ctx.input(lock.clone(), None, Bytes::new());
+    ctx.output(lock.clone(), None, Bytes::new());
+
+    let mut case = ctx.build(
+        "open_transaction",
+        "open_transaction",
+        "open_transaction",
+        ScriptGroupType::Lock,
+        &lock,
+    );
+    // group inputs are digested ahead of the sighash coverage array
+    let input = case.tx.inputs().get(0).unwrap();
+    let mut zero_lock = BytesMut::from(&OPEN_TX_SIGHASH_ARRAY[..]);
+    zero_lock.put(&[0u8; SECP256K1_SIGNATURE_SIZE][..]);
+    case.tx = sign_sighash_all(case.tx, input.as_slice(), zero_lock.freeze(), |message| {
+        let mut lock = BytesMut::from(&OPEN_TX_SIGHASH_ARRAY[..]);
+        lock.put(secp256k1_sign(&key, message).as_ref());
+        lock.freeze()
+    });
+    case
+}
+
+// or and and compose two blake160 hash locks, or's first child is given a
+// wrong preimage so both children run in either case.
+fn composed(bins: &Binaries, name: &'static str, first_preimage_valid: bool) -> Case {
+    let mut ctx = Context::new();
+    let code_hash = ctx.deploy(&bins.load(name));
+    let child_hash = ctx.deploy(&bins.load("bench_blake160_lock.so"));
+
+    let preimages: Vec<Bytes> = vec![Bytes::from(vec![0x41u8; 32]), Bytes::from(vec![0x42u8; 32])];
+    let children: Vec<Script> = preimages
+        .iter()
+        .map(|preimage| data_script(&child_hash, blake160(preimage)))
+        .collect();
+    let mut child_witnesses: Vec<packed::Bytes> = preimages.iter().map(|p| p.pack()).collect();
+    if !first_preimage_valid {
+        child_witnesses[0] = Bytes::from(vec![0x43u8; 32]).pack();
+    }
+    let args = ScriptVec::new_builder().set(children).build().as_bytes();
+    let lock = data_script(&code_hash, args);
+    ctx.input(lock.clone(), None, Bytes::new());
+    ctx.output(lock.clone(), None, Bytes::new());
+
+    let mut case = ctx.build(name, name, name, ScriptGroupType::Lock, &lock);
+    let witness_lock = BytesVec::new_builder()
+        .set(child_witnesses)
+        .build()
+        .as_bytes();
+    case.tx = set_first_lock(&case.tx, witness_lock);
+    case
+}
+
+pub fn or(bins: &Binaries) -> Case {
+    composed(bins, "or", false)
+}
+
+pub fn and(bins: &Binaries) -> Case {
+    composed(bins, "and", true)
+}
+
+// x-only pubkey of the secp256k1 key with seed, it stands for the point with
+// even y.
+fn schnorr_pubkey(seed: u8) -> [u8; 32] {
+    let secp = Secp256k1::new();
+    let key = SecretKey::from_slice(&[seed; 32]).expect("secret key");
+    let mut x = [0u8; 32];
+    x.copy_from_slice(&PublicKey::from_secret_key(&secp, &key).serialize()[1..]);
+    x
+}
+
+fn bip340_tagged_hash(tag: &[u8], parts: &[&[u8]]) -> [u8; 32] {
+    let tag_hash = Sha256::digest(tag);
+    let mut hasher = Sha256::new();
+    hasher.update(&tag_hash);
+    hasher.update(&tag_hash);
+    for part in parts {
+        hasher.update(part);
+    }
+    let mut hash = [0u8; 32];
+    hash.copy_from_slice(hasher.finalize().as_slice());
+    hash
+}
+
+// BIP340 signature in the layout of the dual library: algorithm id, x-only
+// pubkey, R.x and s. The nonce is derived without auxiliary randomness so the
+// corpus stays deterministic.
+fn schnorr_sign(seed: u8, message: &[u8; 32]) -> Bytes {
+    let secp = Secp256k1::new();
+    let mut d = SecretKey::from_slice(&[seed; 32]).expect("secret key");
+    let p = PublicKey::from_secret_key(&secp, &d).serialize();
+    if p[0] == 0x03 {
+        d.negate_assign();
+    }
+    let nonce = bip340_tagged_hash(b"BIP0340/nonce", &[&d[..], &p[1..], &message[..]]);
+    let mut k = SecretKey::from_slice(&nonce).expect("nonce");
+    let r = PublicKey::from_secret_key(&secp, &k).serialize();
+    if r[0] == 0x03 {
+        k.negate_assign();
+    }
+    let e = bip340_tagged_hash(b"BIP0340/challenge", &[&r[1..], &p[1..], &message[..]]);
+    let mut s = d;
+    s.mul_assign(&e).expect("challenge");
+    s.add_assign(&k[..]).expect("nonce");
+
+    let mut signature = BytesMut::with_capacity(SCHNORR_SIGNATURE_SIZE);
+    signature.put_u8(SCHNORR_ALGORITHM_ID);
+    signature.put(&p[1..]);
+    signature.put(&r[1..]);
+    signature.put(&s[..]);
+    signature.freeze()
+}
+
+// Key seeds of the multisig cases with their pubkey hashes, sorted by pubkey
+// hash as the multisig lock requires. The pubkey hash of a Schnorr key is
+// blake160 of 0x02 | x-only pubkey.
+fn multisig_keys(count: usize, schnorr: bool) -> Vec<(Bytes, u8)> {
+    let mut keys: Vec<(Bytes, u8)> = (0..count)
+        .map(|i| {
+            let seed = 0x51 + i as u8;
+            let hash = if schnorr {
+                let mut pubkey = vec![0x02u8];
+                pubkey.extend_from_slice(&schnorr_pubkey(seed));
+                blake160(&pubkey)
+            } else {
+                secp256k1_pubkey_hash(&secp256k1_key(seed))
+            };
+            (hash, seed)
+        })
+        .collect();
+    keys.sort_by(|a, b| a.0.cmp(&b.0));
+    keys
+}
+
+// and over one secp256k1 child per key, the nested equivalent of an N of N
+// multisig.
+fn and_secp256k1(bins: &Binaries, name: &'static str, count: usize) -> Case {
+    let mut ctx = Context::new();
+    let code_hash = ctx.deploy(&bins.load("and"));
+    let child_hash = ctx.deploy(&bins.load("bench_secp256k1_blake160_child.so"));
+    ctx.deploy(&bins.load("secp256k1_data"));
+
+    let keys = multisig_keys(count, false);
+    let children: Vec<Script> = keys
+        .iter()
+        .map(|(hash, _)| data_script(&child_hash, hash.clone()))
+        .collect();
+    let args = ScriptVec::new_builder().set(children).build().as_bytes();
+    let lock = data_script(&code_hash, args);
+    ctx.input(lock.clone(), None, Bytes::new());
+    ctx.output(lock.clone(), None, Bytes::new());
+
+    let mut case = ctx.build(name, "and", "and", ScriptGroupType::Lock, &lock);
+    let child_witnesses = |signatures: Vec<Bytes>| {
+        let items: Vec<packed::Bytes> = signatures.iter().map(|s| s.pack()).collect();
+        BytesVec::new_builder().set(items).build().as_bytes()
+    };
+    let zero_lock = child_witnesses(vec![
+        Bytes::from(vec![0u8; SECP256K1_SIGNATURE_SIZE]);
+        count
+    ]);
+    case.tx = sign_sighash_all(case.tx, &[], zero_lock, |message| {
+        child_witnesses(
+            keys.iter()
+                .map(|(_, seed)| secp256k1_sign(&secp256k1_key(*seed), message))
+                .collect(),
+        )
+    });
+    case
+}
+
+// M of N multisig signed by the first "signers" keys. ECDSA signatures past
+// the M-th valid one are not checked, Schnorr signatures are all checked in
+// one batch.
+fn multisig(
+    bins: &Binaries,
+    name: &'static str,
+    threshold: u8,
+    count: usize,
+    signers: usize,
+    schnorr: bool,
+) -> Case {
+    let keys = multisig_keys(count, schnorr);
+    multisig_with_keys(bins, name, threshold, &keys, signers, schnorr)
+}
+
+// Same as multisig, over keys in the given order, which the lock expects to
+// be sorted by pubkey hash.
+fn multisig_with_keys(
+    bins: &Binaries,
+    name: &'static str,
+    threshold: u8,
+    keys: &[(Bytes, u8)],
+    signers: usize,
+    schnorr: bool,
+) -> Case {
+    let count = keys.len();
+    let mut ctx = Context::new();
+    let code_hash = ctx.deploy(&bins.load("secp256k1_blake2b_multisig"));
+    ctx.deploy(&bins.load("secp256k1_blake2b_sighash_all_dual"));
+    ctx.deploy(&bins.load("secp256k1_data"));
+
+    let mut args = BytesMut::with_capacity(2 + count * 20);
+    args.put_u8(threshold);
+    args.put_u8(count as u8);
+    for (hash, _) in keys {
+        args.put(hash.as_ref());
+    }
+    let lock = data_script(&code_hash, args.freeze());
+    ctx.input(lock.clone(), None, Bytes::new());
+    ctx.output(lock.clone(), None, Bytes::new());
+
+    let mut case = ctx.build(
+        name,
+        "secp256k1_blake2b_multisig",
+        "secp256k1_blake2b_multisig",
+        ScriptGroupType::Lock,
+        &lock,
+    );
+    let signature_size = if schnorr {
+        SCHNORR_SIGNATURE_SIZE
+    } else {
+        SECP256K1_SIGNATURE_SIZE
+    };
+    let zero_lock = Bytes::from(vec![0u8; signature_size * signers]);
+    case.tx = sign_sighash_all(case.tx, &[], zero_lock, |message| {
+        let mut lock = BytesMut::with_capacity(signature_size * signers);
+        for (_, seed) in keys.iter().take(signers) {
+            if schnorr {
+                lock.put(schnorr_sign(*seed, message).as_ref());
+            } else {
+                lock.put(secp256k1_sign(&secp256k1_key(*seed), message).as_ref());
+            }
+        }
+        lock.freeze()
+    });
+    case
+}
+
+pub fn and_secp256k1_2_of_2(bins: &Binaries) -> Case {
+    and_secp256k1(bins, "and_secp256k1_2_of_2", 2)
+}
+
+pub fn multisig_2_of_2(bins: &Binaries) -> Case {
+    multisig(bins, "secp256k1_blake2b_multisig_2_of_2", 2, 2, 2, false)
+}
+
+pub fn multisig_2_of_3(bins: &Binaries) -> Case {
+    multisig(bins, "secp256k1_blake2b_multisig_2_of_3", 2, 3, 3, false)
+}
+
+// N of N ECDSA recovery against one N signature Schnorr batch
+macro_rules! multisig_n_of_n {
+    ($ecdsa:ident, $schnorr:ident, $n:expr) => {
+        pub fn $ecdsa(bins: &Binaries) -> Case {
+            let name = concat!("secp256k1_blake2b_multisig_ecdsa_", $n);
+            multisig(bins, name, $n, $n, $n, false)
+        }
+
+        pub fn $schnorr(bins: &Binaries) -> Case {
+            let name = concat!("secp256k1_blake2b_multisig_schnorr_", $n);
+            multisig(bins, name, $n, $n, $n, true)
+        }
+    };
+}
+
+multisig_n_of_n!(multisig_ecdsa_1, multisig_schnorr_1, 1);
+multisig_n_of_n!(multisig_ecdsa_4, multisig_schnorr_4, 4);
+multisig_n_of_n!(multisig_ecdsa_16, multisig_schnorr_16, 16);
+multisig_n_of_n!(multisig_ecdsa_64, multisig_schnorr_64, 64);
+
+// Normal mode: 2 inputs of 1000 and 2000 tokens are split into 2 outputs.
+pub fn simple_udt(bins: &Binaries) -> Case {
+    let mut ctx = Context::new();
+    let code_hash = ctx.deploy(&bins.load("simple_udt"));
+
+    let owner_lock_hash = ckb_hash::blake2b_256(b"simple_udt owner");
+    let type_ = data_script(&code_hash, Bytes::copy_from_slice(&owner_lock_hash));
+    let amount = |n: u128| Bytes::copy_from_slice(&n.to_le_bytes());
+    ctx.input(dummy_lock(), Some(type_.clone()), amount(1000));
+    ctx.input(dummy_lock(), Some(type_.clone()), amount(2000));
+    ctx.output(dummy_lock(), Some(type_.clone()), amount(1500));
+    ctx.output(dummy_lock(), Some(type_.clone()), amount(1500));
+
+    ctx.build(
+        "simple_udt",
+        "simple_udt",
+        "simple_udt",
+        ScriptGroupType::Type,
+        &type_,
+    )
+}
+
+// layout of RsaInfo in c/rsa_sighash_all.h
+fn rsa_info(algorithm_id: u32, key: &RSAPrivateKey, signature: &BigUint) -> Bytes {
+    let key_bytes = key.size();
+    let mut n = key.n().to_bytes_le();
+    n.resize(key_bytes, 0);
+    let mut info = BytesMut::with_capacity(12 + key_bytes * 2);
+    info.put_u32_le(algorithm_id);
+    info.put_u32_le(key_bytes as u32 * 8);
+    info.put_u32_le(RSA_E);
+    info.put(&n[..]);
+    let sig = signature.to_bytes_be();
+    info.put(&vec![0u8; key_bytes - sig.len()][..]);
+    info.put(&sig[..]);
+    info.freeze()
+}
+
+fn rsa_private(key: &RSAPrivateKey, block: &[u8]) -> BigUint {
+    BigUint::from_bytes_be(block).modpow(key.d(), key.n())
+}
+
+// EMSA-PKCS1-v1_5 block of sha256(message)
+fn pkcs1_sha256_block(message: &[u8], len: usize) -> Vec<u8> {
+    let t_len = PKCS1_SHA256_PREFIX.len() + 32;
+    let mut block = vec![0xFFu8; len];
+    block[0] = 0x00;
+    block[1] = 0x01;
+    block[len - t_len - 1] = 0x00;
+    block[len - t_len..len - 32].copy_from_slice(&PKCS1_SHA256_PREFIX);
+    block[len - 32..].copy_from_slice(Sha256::digest(message).as_slice());
+    block
+}
+
+// ISO 9796-2 scheme 1 block with full message recovery, SHA-1 and explicit
+// trailer, matching iso97962_sign in c/rsa_sighash_all.c
+fn iso9796_2_sha1_block(message: &[u8], len: usize) -> Vec<u8> {
+    let digest = Sha1::digest(message);
+    let delta = len - digest.len() - ISO9796_2_TRAILER_SHA1.len() - message.len();
+    let mut block = vec![0xBBu8; len];
+    block[0] = 0x4B;
+    block[delta - 1] ^= 0x01;
+    block[delta..delta + message.len()].copy_from_slice(message);
+    block[len - 2 - digest.len()..len - 2].copy_from_slice(digest.as_slice());
+    block[len - 2..].copy_from_slice(&ISO9796_2_TRAILER_SHA1);
+    block
+}
+
+fn rsa(bins: &Binaries, name: &'static str, bits: usize, iso9796_2: bool) -> Case {
+    let mut ctx = Context::new();
+    let code_hash = ctx.deploy(&bins.load("bench_rsa_sighash_all_host"));
+    ctx.deploy(&bins.load("rsa_sighash_all"));
+
+    let mut rng = ChaCha20Rng::seed_from_u64(bits as u64);
+    let key = RSAPrivateKey::new(&mut rng, bits).expect("rsa key");
+    assert_eq!(key.e(), &BigUint::from(RSA_E));
+    let algorithm_id = if iso9796_2 {
+        ISO9796_2_ALGORITHM_ID
+    } else {
+        RSA_ALGORITHM_ID
+    };
+    let zero_lock = rsa_info(algorithm_id, &key, &BigUint::from(0u32));
+    // validate_signature_rsa outputs blake160 of the first 8 + N bytes of
+    // RsaInfo, ISO 9796-2 outputs recovered message which is not checked.
+    let args = if iso9796_2 {
+        Bytes::new()
+    } else {
+        blake160(&zero_lock[..8 + key.size()])
+    };
+    let lock = data_script(&code_hash, args);
+    ctx.input(lock.clone(), None, Bytes::new());
+    ctx.output(lock.clone(), None, Bytes::new());
+
+    let mut case = ctx.build(
+        name,
+        "rsa_sighash_all",
+        "bench_rsa_sighash_all_host",
+        ScriptGroupType::Lock,
+        &lock,
+    );
+    case.tx = sign_sighash_all(case.tx, &[], zero_lock, |message| {
+        let block = if iso9796_2 {
+            iso9796_2_sha1_block(message, key.size())
+        } else {
+            pkcs1_sha256_block(message, key.size())
+        };
+        rsa_info(algorithm_id, &key, &rsa_private(&key, &block))
+    });
+    case
+}
+
+pub fn rsa_1024(bins: &Binaries) -> Case {
+    rsa(bins, "rsa_sighash_all_1024", 1024, false)
+}
+
+pub fn rsa_2048(bins: &Binaries) -> Case {
+    rsa(bins, "rsa_sighash_all_2048", 2048, false)
+}
+
+pub fn rsa_4096(bins: &Binaries) -> Case {
+    rsa(bins, "rsa_sighash_all_4096", 4096, false)
+}
+
+// the ISO 9796-2 path only supports 1024 bit keys
+pub fn rsa_iso9796_2(bins: &Binaries) -> Case {
+    rsa(bins, "rsa_sighash_all_iso9796_2", 1024, true)
+}
+
+fn bls_witness_lock(signature: Bytes) -> Bytes {
+    RcLockWitnessLock::new_builder()
+        .signature(Some(signature).pack())
+        .build()
+        .as_bytes()
+}
+
+pub fn bls12_381_sighash_all(bins: &Binaries) -> Case {
+    let mut ctx = Context::new();
+    let code_hash = ctx.deploy(&bins.load("bls12_381_sighash_all"));
+
+    let sk = SecretKey::key_gen(&[0x51u8; 32], &[]).expect("bls key");
+    let pk = sk.sk_to_pk().compress();
+    let mut args = BytesMut::with_capacity(21);
+    args.put_u8(IDENTITY_FLAGS_BLS12_381);
+    args.put(blake160(&pk).as_ref());
+    let lock = data_script(&code_hash, args.freeze());
+    ctx.input(lock.clone(), None, Bytes::new());
+    ctx.output(lock.clone(), None, Bytes::new());
+
+    let mut case = ctx.build(
+        "bls12_381_sighash_all",
+        "bls12_381_sighash_all",
+        "bls12_381_sighash_all",
+        ScriptGroupType::Lock,
+        &lock,
+    );
+    let lock_len = bls_witness_lock(Bytes::from(vec![0u8; 48 + 96])).len();
+    case.tx = sign_sighash_all(case.tx, &[], Bytes::from(vec![0u8; lock_len]), |message| {
+        let sig = sk.sign(&message[..], BLS_DST, &[]).compress();
+        let mut signature = BytesMut::with_capacity(48 + 96);
+        signature.put(&pk[..]);
+        signature.put(&sig[..]);
+        bls_witness_lock(signature.freeze())
+    });
+    case
+}
+
+pub fn all() -> Vec<(&'static str, fn(&Binaries) -> Case)> {
+    vec![
+        ("htlc", htlc),
+        ("or", or),
+        ("and", and),
+        ("and_secp256k1_2_of_2", and_secp256k1_2_of_2),
+        ("secp256k1_blake2b_multisig_2_of_2", multisig_2_of_2),
+        ("secp256k1_blake2b_multisig_2_of_3", multisig_2_of_3),
+        ("secp256k1_blake2b_multisig_ecdsa_1", multisig_ecdsa_1),
+        ("secp256k1_blake2b_multisig_schnorr_1", multisig_schnorr_1),
+        ("secp256k1_blake2b_multisig_ecdsa_4", multisig_ecdsa_4),
+        ("secp256k1_blake2b_multisig_schnorr_4", multisig_schnorr_4),
+        ("secp256k1_blake2b_multisig_ecdsa_16", multisig_ecdsa_16),
+        ("secp256k1_blake2b_multisig_schnorr_16", multisig_schnorr_16),
+        ("secp256k1_blake2b_multisig_ecdsa_64", multisig_ecdsa_64),
+        ("secp256k1_blake2b_multisig_schnorr_64", multisig_schnorr_64),
+        ("simple_udt", simple_udt),
+        ("open_transaction", open_transaction),
+        (
+            "secp256k1_blake2b_sighash_all_dual",
+            secp256k1_blake2b_sighash_all_dual,
+        ),
+        (
+            "secp256k1_blake2b_sighash_all_dual_pubkey",
+            secp256k1_blake2b_sighash_all_dual_pubkey,
+        ),
+        (
+            "secp256k1_blake2b_sighash_all_dual_w12",
+            secp256k1_blake2b_sighash_all_dual_w12,
+        ),
+        (
+            "secp256k1_blake2b_sighash_all_dual_w8",
+            secp256k1_blake2b_sighash_all_dual_w8,
+        ),
+        ("rsa_sighash_all_1024", rsa_1024),
+        ("rsa_sighash_all_2048", rsa_2048),
+        ("rsa_sighash_all_4096", rsa_4096),
+        ("rsa_sighash_all_iso9796_2", rsa_iso9796_2),
+        ("bls12_381_sighash_all", bls12_381_sighash_all),
+    ]
+}
+
+#[cfg(test)]
+mod tests;
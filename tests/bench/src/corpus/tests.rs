@@ -0,0 +1,151 @@
+// Transactions the multisig lock and the dual lock must reject, built from the
+// same corpus cases as the benchmark with the signed lock tampered with. The
+// lock field is digested as zeros, so editing signatures in place keeps the
+// signed message unchanged.
+//
+// Run `make bench-test` from repo root to build binaries first.
+use std::path::Path;
+
+use ckb_error::assert_error_eq;
+use ckb_script::{ScriptError, TransactionScriptsVerifier};
+
+use super::*;
+use crate::loader::build_resolved_tx;
+use crate::MAX_CYCLES;
+
+// error codes of c/secp256k1_blake2b_multisig.c and
+// c/secp256k1_blake2b_sighash_all_dual.c
+const ERROR_SECP_VERIFICATION: i8 = -12;
+const ERROR_WITNESS_SIZE: i8 = -22;
+const ERROR_PUBKEY_BLAKE160_HASH: i8 = -31;
+const ERROR_UNSORTED_PUBKEY_HASHES: i8 = -52;
+const ERROR_THRESHOLD_NOT_REACHED: i8 = -53;
+
+// order of the secp256k1 group, big endian
+const SECP256K1_ORDER: [u8; 32] = [
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFE,
+    0xBA, 0xAE, 0xDC, 0xE6, 0xAF, 0x48, 0xA0, 0x3B, 0xBF, 0xD2, 0x5E, 0x8C, 0xD0, 0x36, 0x41, 0x41,
+];
+
+fn bins() -> Binaries {
+    Binaries::new(Path::new(concat!(
+        env!("CARGO_MANIFEST_DIR"),
+        "/../../build"
+    )))
+}
+
+fn verify(case: &Case) -> Result<u64, ckb_error::Error> {
+    let resolved_tx = build_resolved_tx(&case.data_loader, &case.tx);
+    let verifier = TransactionScriptsVerifier::new(&resolved_tx, &case.data_loader);
+    verifier.verify(MAX_CYCLES)
+}
+
+fn assert_rejected(case: &Case, code: i8) {
+    assert_error_eq!(
+        verify(case).unwrap_err(),
+        ScriptError::ValidationFailure(code).input_lock_script(0),
+    );
+}
+
+fn first_lock(case: &Case) -> Vec<u8> {
+    let witness = WitnessArgs::new_unchecked(case.tx.witnesses().get(0).unwrap().unpack());
+    witness.lock().to_opt().unwrap().raw_data().to_vec()
+}
+
+fn tamper_first_lock<F: FnOnce(&mut Vec<u8>)>(mut case: Case, tamper: F) -> Case {
+    let mut lock = first_lock(&case);
+    tamper(&mut lock);
+    case.tx = set_first_lock(&case.tx, Bytes::from(lock));
+    case
+}
+
+#[test]
+fn multisig_accepts_threshold_signatures() {
+    let case = multisig(&bins(), "multisig", 2, 3, 2, false);
+    verify(&case).expect("pass verification");
+}
+
+#[test]
+fn multisig_rejects_too_few_signatures() {
+    let case = multisig(&bins(), "multisig", 2, 3, 1, false);
+    assert_rejected(&case, ERROR_WITNESS_SIZE);
+}
+
+#[test]
+fn multisig_rejects_corrupted_ecdsa_signature() {
+    let case = multisig(&bins(), "multisig", 2, 3, 2, false);
+    let case = tamper_first_lock(case, |lock| {
+        lock[SECP256K1_SIGNATURE_SIZE + 10] ^= 0x01;
+    });
+    assert_rejected(&case, ERROR_THRESHOLD_NOT_REACHED);
+}
+
+#[test]
+fn multisig_rejects_duplicate_signer() {
+    let case = multisig(&bins(), "multisig", 2, 3, 2, false);
+    let case = tamper_first_lock(case, |lock| {
+        let first = lock[..SECP256K1_SIGNATURE_SIZE].to_vec();
+        lock[SECP256K1_SIGNATURE_SIZE..].copy_from_slice(&first);
+    });
+    assert_rejected(&case, ERROR_THRESHOLD_NOT_REACHED);
+}
+
+#[test]
+fn multisig_rejects_unsorted_args() {
+    let mut keys = multisig_keys(3, false);
+    keys.reverse();
+    let case = multisig_with_keys(&bins(), "multisig", 2, &keys, 2, false);
+    assert_rejected(&case, ERROR_UNSORTED_PUBKEY_HASHES);
+}
+
+#[test]
+fn multisig_rejects_schnorr_signature_with_pubkey_prefix() {
+    // 0x02 | 32 bytes | 64 bytes is the pubkey and signature lock of the dual
+    // script, not a Schnorr signature, so the lock is read as ECDSA ones
+    let case = multisig(&bins(), "multisig", 1, 1, 1, true);
+    let case = tamper_first_lock(case, |lock| {
+        lock[0] = 0x02;
+    });
+    assert_rejected(&case, ERROR_WITNESS_SIZE);
+}
+
+#[test]
+fn multisig_rejects_corrupted_schnorr_signature_in_batch() {
+    let case = multisig(&bins(), "multisig", 4, 4, 4, true);
+    verify(&case).expect("pass verification");
+    let case = tamper_first_lock(case, |lock| {
+        // a byte of s in the third signature: id | x-only pubkey | R.x | s
+        lock[2 * SCHNORR_SIGNATURE_SIZE + 1 + 32 + 32 + 8] ^= 0x01;
+    });
+    assert_rejected(&case, ERROR_SECP_VERIFICATION);
+}
+
+#[test]
+fn dual_pubkey_rejects_wrong_pubkey() {
+    let case = dual_with_table(&bins(), "dual", "secp256k1_data", true);
+    verify(&case).expect("pass verification");
+    let other = secp256k1_key(0x12).pubkey().expect("pubkey").serialize();
+    let case = tamper_first_lock(case, |lock| {
+        lock[..SECP256K1_PUBKEY_SIZE].copy_from_slice(&other);
+    });
+    assert_rejected(&case, ERROR_PUBKEY_BLAKE160_HASH);
+}
+
+#[test]
+fn dual_pubkey_rejects_high_s_signature() {
+    let case = dual_with_table(&bins(), "dual", "secp256k1_data", true);
+    let case = tamper_first_lock(case, |lock| {
+        // s = n - s, a valid signature for the same message with high S
+        let s = &mut lock[SECP256K1_PUBKEY_SIZE + 32..SECP256K1_PUBKEY_SIZE + 64];
+        let mut borrow = 0i16;
+        for i in (0..32).rev() {
+            let mut v = SECP256K1_ORDER[i] as i16 - s[i] as i16 - borrow;
+            borrow = if v < 0 { 1 } else { 0 };
+            if v < 0 {
+                v += 256;
+            }
+            s[i] = v as u8;
+        }
+    });
+    assert_rejected(&case, ERROR_SECP_VERIFICATION);
+}
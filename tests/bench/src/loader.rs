@@ -0,0 +1,88 @@
+use std::collections::HashMap;
+
+use ckb_traits::{CellDataProvider, HeaderProvider};
+use ckb_types::{
+    bytes::Bytes,
+    core::{
+        cell::{CellMeta, CellMetaBuilder, ResolvedTransaction},
+        HeaderView, TransactionView,
+    },
+    packed::{Byte32, CellOutput, OutPoint},
+    prelude::*,
+};
+
+#[derive(Default)]
+pub struct DummyDataLoader {
+    pub cells: HashMap<OutPoint, (CellOutput, Bytes)>,
+}
+
+impl DummyDataLoader {
+    pub fn new() -> Self {
+        Self::default()
+    }
+}
+
+impl CellDataProvider for DummyDataLoader {
+    // load Cell Data
+    fn load_cell_data(&self, cell: &CellMeta) -> Option<Bytes> {
+        cell.mem_cell_data.clone().or_else(|| {
+            self.cells
+                .get(&cell.out_point)
+                .map(|(_, data)| data.clone())
+        })
+    }
+
+    fn load_cell_data_hash(&self, cell: &CellMeta) -> Option<Byte32> {
+        self.load_cell_data(cell)
+            .map(|e| CellOutput::calc_data_hash(&e))
+    }
+
+    fn get_cell_data(&self, _out_point: &OutPoint) -> Option<Bytes> {
+        None
+    }
+
+    fn get_cell_data_hash(&self, _out_point: &OutPoint) -> Option<Byte32> {
+        None
+    }
+}
+
+impl HeaderProvider for DummyDataLoader {
+    fn get_header(&self, _hash: &Byte32) -> Option<HeaderView> {
+        None
+    }
+}
+
+pub fn build_resolved_tx(
+    data_loader: &DummyDataLoader,
+    tx: &TransactionView,
+) -> ResolvedTransaction {
+    let resolved_cell_deps = tx
+        .cell_deps()
+        .into_iter()
+        .map(|dep| {
+            let (dep_output, dep_data) = data_loader.cells.get(&dep.out_point()).unwrap();
+            CellMetaBuilder::from_cell_output(dep_output.to_owned(), dep_data.to_owned())
+                .out_point(dep.out_point())
+                .build()
+        })
+        .collect();
+
+    let resolved_inputs = tx
+        .inputs()
+        .into_iter()
+        .map(|input| {
+            let previous_out_point = input.previous_output();
+            let (input_output, input_data) = data_loader.cells.get(&previous_out_point).unwrap();
+            CellMetaBuilder::from_cell_output(input_output.to_owned(), input_data.to_owned())
+                .out_point(previous_out_point)
+                .build()
+        })
+        .collect();
+
+    ResolvedTransaction {
+        transaction: tx.clone(),
+        resolved_cell_deps,
+        resolved_inputs,
+        resolved_dep_groups: vec![],
+    }
+}
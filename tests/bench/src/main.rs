@@ -0,0 +1,270 @@
+// Cycle benchmark for the scripts built by the top level Makefile.
+//
+// Each script runs over a fixed mock transaction from corpus.rs in a local
+// CKB-VM, only the measured script group is executed. The result is written
+// as JSON:
+//
+// {"threshold": 5.0, "results": [{"name": "htlc", "binary": "htlc",
+//   "cycles": 1234, "size": 5678, "memory": 9012}, ...]}
+//
+// * cycles: cycles consumed by the script group
+// * size: size of the stripped binary in bytes
+// * memory: span of the loaded ELF image in bytes, including bss where the
+//   scripts keep their dlopen buffers. Stack usage is not visible from
+//   outside of CKB-VM and is not counted.
+//
+// With --baseline, the cycles of every case are printed next to the ones of
+// the baseline, and any metric exceeding baseline by more than threshold
+// percent is reported as a regression and the run fails. So does a missing
+// baseline file, or a case missing from it: run `make bench-baseline` to
+// record one. `make bench` leaves --baseline out and only reports while
+// there is no baseline file. `make bench-compare BENCH_REV=<rev>` uses the scripts of an
+// earlier revision as the baseline, for the before and after of a change.
+//
+// Usage (run `make bench` from repo root to build binaries first):
+// scripts_bench [--build-dir DIR] [--output FILE] [--baseline FILE]
+//               [--threshold PERCENT] [CASE_NAME...]
+use std::collections::HashMap;
+use std::fs;
+use std::path::PathBuf;
+use std::process;
+
+use ckb_script::TransactionScriptsVerifier;
+use ckb_types::packed::Byte32;
+use serde::{Deserialize, Serialize};
+
+mod corpus;
+mod loader;
+
+use corpus::{Binaries, Case};
+use loader::build_resolved_tx;
+
+const MAX_CYCLES: u64 = std::u64::MAX;
+const DEFAULT_THRESHOLD: f64 = 5.0;
+
+const ELF_PHOFF: usize = 0x20;
+const ELF_PHENTSIZE: usize = 0x36;
+const ELF_PHNUM: usize = 0x38;
+const ELF_PT_LOAD: u32 = 1;
+
+#[derive(Serialize, Deserialize, Clone)]
+struct BenchResult {
+    name: String,
+    binary: String,
+    cycles: u64,
+    size: u64,
+    memory: u64,
+}
+
+#[derive(Serialize, Deserialize)]
+struct Report {
+    threshold: f64,
+    results: Vec<BenchResult>,
+}
+
+struct Options {
+    build_dir: PathBuf,
+    output: Option<PathBuf>,
+    baseline: Option<PathBuf>,
+    threshold: f64,
+    filters: Vec<String>,
+}
+
+fn usage() -> ! {
+    eprintln!(
+        "usage: scripts_bench [--build-dir DIR] [--output FILE] [--baseline FILE] \
+         [--threshold PERCENT] [CASE_NAME...]"
+    );
+    process::exit(2);
+}
+
+fn parse_options() -> Options {
+    let mut options = Options {
+        build_dir: PathBuf::from(concat!(env!("CARGO_MANIFEST_DIR"), "/../../build")),
+        output: None,
+        baseline: None,
+        threshold: DEFAULT_THRESHOLD,
+        filters: vec![],
+    };
+    let mut args = std::env::args().skip(1);
+    while let Some(arg) = args.next() {
+        let mut value = || args.next().unwrap_or_else(|| usage());
+        match arg.as_str() {
+            "--build-dir" => options.build_dir = PathBuf::from(value()),
+            "--output" => options.output = Some(PathBuf::from(value())),
+            "--baseline" => options.baseline = Some(PathBuf::from(value())),
+            "--threshold" => {
+                options.threshold = value().parse().unwrap_or_else(|_| usage());
+            }
+            "-h" | "--help" => usage(),
+            _ if arg.starts_with("--") => usage(),
+            _ => options.filters.push(arg),
+        }
+    }
+    options
+}
+
+fn read_u16(data: &[u8], offset: usize) -> u64 {
+    let mut buf = [0u8; 2];
+    buf.copy_from_slice(&data[offset..offset + 2]);
+    u16::from_le_bytes(buf) as u64
+}
+
+fn read_u32(data: &[u8], offset: usize) -> u32 {
+    let mut buf = [0u8; 4];
+    buf.copy_from_slice(&data[offset..offset + 4]);
+    u32::from_le_bytes(buf)
+}
+
+fn read_u64(data: &[u8], offset: usize) -> u64 {
+    let mut buf = [0u8; 8];
+    buf.copy_from_slice(&data[offset..offset + 8]);
+    u64::from_le_bytes(buf)
+}
+
+// Highest address covered by PT_LOAD segments of an ELF64 binary.
+fn image_span(elf: &[u8]) -> u64 {
+    let phoff = read_u64(elf, ELF_PHOFF) as usize;
+    let phentsize = read_u16(elf, ELF_PHENTSIZE) as usize;
+    let phnum = read_u16(elf, ELF_PHNUM) as usize;
+    (0..phnum)
+        .map(|i| phoff + i * phentsize)
+        .filter(|&ph| read_u32(elf, ph) == ELF_PT_LOAD)
+        .map(|ph| read_u64(elf, ph + 0x10) + read_u64(elf, ph + 0x28))
+        .max()
+        .unwrap_or(0)
+}
+
+fn debug_printer(script: &Byte32, msg: &str) {
+    let slice = script.as_slice();
+    let str = format!(
+        "Script({:x}{:x}{:x}{:x}{:x})",
+        slice[0], slice[1], slice[2], slice[3], slice[4]
+    );
+    println!("{:?}: {}", str, msg);
+}
+
+fn run(bins: &Binaries, case: &Case) -> Result<BenchResult, String> {
+    let resolved_tx = build_resolved_tx(&case.data_loader, &case.tx);
+    let mut verifier = TransactionScriptsVerifier::new(&resolved_tx, &case.data_loader);
+    verifier.set_debug_printer(debug_printer);
+    let cycles = verifier
+        .verify_single(case.group_type, &case.script_hash, MAX_CYCLES)
+        .map_err(|e| format!("{}", e))?;
+    Ok(BenchResult {
+        name: case.name.to_owned(),
+        binary: case.binary.to_owned(),
+        cycles,
+        size: bins.load(case.binary).len() as u64,
+        memory: image_span(&bins.load(case.entry)),
+    })
+}
+
+// Returns a line for every metric exceeding baseline by more than threshold.
+fn regressions(result: &BenchResult, base: &BenchResult, threshold: f64) -> Vec<String> {
+    let metrics = [
+        ("cycles", result.cycles, base.cycles),
+        ("size", result.size, base.size),
+        ("memory", result.memory, base.memory),
+    ];
+    metrics
+        .iter()
+        .filter(|(_, current, previous)| {
+            *current as f64 > *previous as f64 * (1.0 + threshold / 100.0)
+        })
+        .map(|(metric, current, previous)| {
+            format!(
+                "{}: {} regressed from {} to {} (+{:.2}%)",
+                result.name,
+                metric,
+                previous,
+                current,
+                (*current as f64 / *previous as f64 - 1.0) * 100.0
+            )
+        })
+        .collect()
+}
+
+fn main() {
+    let options = parse_options();
+    let bins = Binaries::new(&options.build_dir);
+    let baseline: HashMap<String, BenchResult> = match &options.baseline {
+        Some(path) if path.exists() => {
+            let data = fs::read(path).expect("read baseline");
+            let report: Report = serde_json::from_slice(&data).expect("parse baseline");
+            report
+                .results
+                .into_iter()
+                .map(|r| (r.name.clone(), r))
+                .collect()
+        }
+        Some(path) => {
+            eprintln!(
+                "baseline {} not found, run `make bench-baseline` to record one",
+                path.display()
+            );
+            process::exit(1);
+        }
+        None => HashMap::new(),
+    };
+
+    let mut results = vec![];
+    let mut failures = vec![];
+    println!(
+        "{:<36} {:>14} {:>10} {:>10} {:>14} {:>9}",
+        "name", "cycles", "size", "memory", "base cycles", "delta"
+    );
+    for (name, build) in corpus::all() {
+        if !options.filters.is_empty() && !options.filters.iter().any(|f| f == name) {
+            continue;
+        }
+        let case = build(&bins);
+        match run(&bins, &case) {
+            Ok(result) => {
+                let (base_cycles, delta) = match baseline.get(name) {
+                    Some(base) => (
+                        base.cycles.to_string(),
+                        format!(
+                            "{:+.2}%",
+                            (result.cycles as f64 / base.cycles as f64 - 1.0) * 100.0
+                        ),
+                    ),
+                    None => (String::new(), String::new()),
+                };
+                println!(
+                    "{:<36} {:>14} {:>10} {:>10} {:>14} {:>9}",
+                    result.name, result.cycles, result.size, result.memory, base_cycles, delta
+                );
+                if options.baseline.is_some() {
+                    match baseline.get(name) {
+                        Some(base) => {
+                            failures.extend(regressions(&result, base, options.threshold))
+                        }
+                        None => failures.push(format!("{}: not in baseline", name)),
+                    }
+                }
+                results.push(result);
+            }
+            Err(e) => {
+                println!("{:<36} failed: {}", name, e);
+                failures.push(format!("{}: verification failed: {}", name, e));
+            }
+        }
+    }
+
+    if let Some(path) = &options.output {
+        let report = Report {
+            threshold: options.threshold,
+            results,
+        };
+        let data = serde_json::to_string_pretty(&report).expect("serialize report");
+        fs::write(path, data).expect("write report");
+        println!("report written to {}", path.display());
+    }
+    if !failures.is_empty() {
+        for failure in &failures {
+            eprintln!("{}", failure);
+        }
+        process::exit(1);
+    }
+}
@@ -0,0 +1,159 @@
+// Differential test and cycle benchmark for the blake2b kernels in
+// deps/blake2b.h.
+//
+// Built with -DBLAKE2B_UNROLLED, every compression done by the unrolled kernel
+// is checked against the reference one, then a fixed amount of data is hashed
+// so the cycles reported by ckb-vm-cli can be compared between builds.
+#define CKB_C_STDLIB_PRINTF
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef CKB_USE_SIM
+#include "ckb_syscalls.h"
+#endif
+
+#include "blake2b.h"
+
+#define CHECK2(cond, code) \
+  do {                     \
+    if (!(cond)) {         \
+      err = code;          \
+      goto exit;           \
+    }                      \
+  } while (0)
+
+#define CHECK(_code)    \
+  do {                  \
+    int code = (_code); \
+    if (code != 0) {    \
+      err = code;       \
+      goto exit;        \
+    }                   \
+  } while (0)
+
+#define HASH_SIZE 32
+#define DATA_SIZE 4096
+#define BENCH_SIZE (256 * 1024)
+#define BENCH_CHUNK 32768
+
+static uint64_t g_seed = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t next_random(void) {
+  g_seed ^= g_seed << 13;
+  g_seed ^= g_seed >> 7;
+  g_seed ^= g_seed << 17;
+  return g_seed;
+}
+
+static void fill_random(void *buf, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    ((uint8_t *)buf)[i] = (uint8_t)next_random();
+  }
+}
+
+// blake2b with "ckb-default-hash" personalization of empty input
+static const uint8_t g_empty_hash[HASH_SIZE] = {
+    0x44, 0xf4, 0xc6, 0x97, 0x44, 0xd5, 0xf8, 0xc5, 0x5d, 0x64, 0x20,
+    0x62, 0x94, 0x9d, 0xca, 0xe4, 0x9b, 0xc4, 0xe7, 0xef, 0x43, 0xd3,
+    0x88, 0xc5, 0xa1, 0x2f, 0x42, 0xb5, 0x63, 0x3d, 0x16, 0x3e};
+
+int test_empty(void) {
+  int err = 0;
+  blake2b_state ctx;
+  uint8_t hash[HASH_SIZE];
+  blake2b_init(&ctx, HASH_SIZE);
+  blake2b_final(&ctx, hash, HASH_SIZE);
+  CHECK2(memcmp(hash, g_empty_hash, HASH_SIZE) == 0, -1);
+exit:
+  return err;
+}
+
+#if defined(BLAKE2B_UNROLLED)
+// run both kernels on random states and blocks, aligned and unaligned
+int test_compress(void) {
+  int err = 0;
+  uint8_t block[BLAKE2B_BLOCKBYTES + 8];
+  for (int i = 0; i < 256; i++) {
+    blake2b_state s1, s2;
+    fill_random(&s1, sizeof(s1));
+    memcpy(&s2, &s1, sizeof(s1));
+    fill_random(block, sizeof(block));
+    const uint8_t *p = block + (i % 8);
+    blake2b_compress_ref(&s1, p);
+    blake2b_compress_unrolled(&s2, p);
+    CHECK2(memcmp(s1.h, s2.h, sizeof(s1.h)) == 0, -2);
+  }
+exit:
+  return err;
+}
+#endif
+
+// hashing in random sized pieces must match hashing in one go
+int test_update(void) {
+  int err = 0;
+  static uint8_t data[DATA_SIZE + 8];
+  fill_random(data, sizeof(data));
+  for (int i = 0; i < 64; i++) {
+    size_t offset = i % 8;
+    size_t len = next_random() % DATA_SIZE;
+    const uint8_t *p = data + offset;
+
+    uint8_t hash1[HASH_SIZE];
+    blake2b_state ctx;
+    blake2b_init(&ctx, HASH_SIZE);
+    blake2b_update(&ctx, p, len);
+    blake2b_final(&ctx, hash1, HASH_SIZE);
+
+    uint8_t hash2[HASH_SIZE];
+    blake2b_init(&ctx, HASH_SIZE);
+    size_t pos = 0;
+    while (pos < len) {
+      size_t n = next_random() % 300;
+      if (n > len - pos) {
+        n = len - pos;
+      }
+      blake2b_update(&ctx, p + pos, n);
+      pos += n;
+    }
+    blake2b_final(&ctx, hash2, HASH_SIZE);
+    CHECK2(memcmp(hash1, hash2, HASH_SIZE) == 0, -3);
+  }
+exit:
+  return err;
+}
+
+// hash BENCH_SIZE bytes the way sighash scripts stream witnesses
+int bench(void) {
+  static uint8_t chunk[BENCH_CHUNK];
+  fill_random(chunk, sizeof(chunk));
+  blake2b_state ctx;
+  blake2b_init(&ctx, HASH_SIZE);
+  for (size_t i = 0; i < BENCH_SIZE / BENCH_CHUNK; i++) {
+    uint64_t len = BENCH_CHUNK;
+    blake2b_update(&ctx, &len, sizeof(len));
+    blake2b_update(&ctx, chunk, BENCH_CHUNK);
+  }
+  uint8_t hash[HASH_SIZE];
+  blake2b_final(&ctx, hash, HASH_SIZE);
+  return hash[0] == 0 && hash[1] == 0 && hash[2] == 0 && hash[3] == 0;
+}
+
+int main(int argc, const char *argv[]) {
+  int err = 0;
+  CHECK(test_empty());
+#if defined(BLAKE2B_UNROLLED)
+  CHECK(test_compress());
+#endif
+  CHECK(test_update());
+  CHECK(bench());
+  printf("blake2b passed");
+exit:
+  if (err != 0) {
+    printf("blake2b failed: %d", err);
+  }
+  return err;
+}
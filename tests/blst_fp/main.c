@@ -0,0 +1,231 @@
+// Per primitive cycle benchmark for the 384-bit modular primitives of blst,
+// see blst/blst_fp_384.riscv.S.
+//
+// build/blst-fp-bench-no-asm is linked with the C primitives of no_asm.h and
+// build/blst-fp-bench with the assembly ones. The latter is built with
+// -DBLST_FP_BENCH_ASM, which first checks every assembly primitive against
+// its C version, still linked as add_mod_384_c and so on, on random inputs.
+// Both then print the cycles of one call of each primitive, averaged over
+// BENCH_ROUNDS dependent calls, so the two outputs can be compared line by
+// line. The current cycles syscall needs CKB-VM version 1.
+//
+// With -DBLST_FP_BENCH_INV_VAR it also checks the variable time inversion of
+// blst/blst_inv_var.c against the constant time blst_fp_inverse, and prints
+// the cycles of both.
+#define CKB_C_STDLIB_PRINTF
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ckb_syscalls.h"
+#include "consts.h"
+#include "vect.h"
+
+#define CHECK2(cond, code) \
+  do {                     \
+    if (!(cond)) {         \
+      err = code;          \
+      goto exit;           \
+    }                      \
+  } while (0)
+
+#define CHECK(_code)    \
+  do {                  \
+    int code = (_code); \
+    if (code != 0) {    \
+      err = code;       \
+      goto exit;        \
+    }                   \
+  } while (0)
+
+#ifndef SYS_ckb_current_cycles
+#define SYS_ckb_current_cycles 2042
+#endif
+
+#define TEST_ROUNDS 1024
+#define BENCH_ROUNDS 4096
+
+#if defined(BLST_FP_BENCH_ASM)
+void add_mod_384_c(vec384 ret, const vec384 a, const vec384 b,
+                   const vec384 p);
+void sub_mod_384_c(vec384 ret, const vec384 a, const vec384 b,
+                   const vec384 p);
+void mul_by_3_mod_384_c(vec384 ret, const vec384 a, const vec384 p);
+void cneg_mod_384_c(vec384 ret, const vec384 a, bool_t flag, const vec384 p);
+void redc_mont_384_c(vec384 ret, const vec768 a, const vec384 p, limb_t n0);
+void from_mont_384_c(vec384 ret, const vec384 a, const vec384 p, limb_t n0);
+#endif
+
+#if defined(BLST_FP_BENCH_INV_VAR)
+void blst_fp_inverse(vec384 ret, const vec384 a);
+void ckb_blst_reciprocal_fp_var(vec384 out, const vec384 inp);
+#endif
+
+static uint64_t g_seed = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t next_random(void) {
+  g_seed ^= g_seed << 13;
+  g_seed ^= g_seed >> 7;
+  g_seed ^= g_seed << 17;
+  return g_seed;
+}
+
+// a value below p, or one of 0, 1 and p - 1 every 8 rounds
+static void random_fp(vec384 r, int round) {
+  if (round % 8 == 0) {
+    memset(r, 0, sizeof(vec384));
+    r[0] = (round / 8) % 2;
+  } else if (round % 8 == 4) {
+    memcpy(r, BLS12_381_P, sizeof(vec384));
+    r[0] -= 1;
+  } else {
+    for (size_t i = 0; i < NLIMBS(384); i++) {
+      r[i] = next_random();
+    }
+    // the top limb of p is 0x1a0111ea397fe69a
+    r[NLIMBS(384) - 1] %= BLS12_381_P[NLIMBS(384) - 1];
+  }
+}
+
+static uint64_t current_cycles(void) {
+  return (uint64_t)syscall(SYS_ckb_current_cycles, 0, 0, 0, 0, 0, 0);
+}
+
+#if defined(BLST_FP_BENCH_ASM)
+int test_primitives(void) {
+  int err = 0;
+  for (int i = 0; i < TEST_ROUNDS; i++) {
+    vec384 a, b, r1, r2;
+    vec768 w;
+    random_fp(a, i);
+    random_fp(b, i + 3);
+    add_mod_384_c(r1, a, b, BLS12_381_P);
+    add_mod_384(r2, a, b, BLS12_381_P);
+    CHECK2(memcmp(r1, r2, sizeof(r1)) == 0, -1);
+    sub_mod_384_c(r1, a, b, BLS12_381_P);
+    sub_mod_384(r2, a, b, BLS12_381_P);
+    CHECK2(memcmp(r1, r2, sizeof(r1)) == 0, -2);
+    mul_by_3_mod_384_c(r1, a, BLS12_381_P);
+    mul_by_3_mod_384(r2, a, BLS12_381_P);
+    CHECK2(memcmp(r1, r2, sizeof(r1)) == 0, -3);
+    cneg_mod_384_c(r1, a, i & 1, BLS12_381_P);
+    cneg_mod_384(r2, a, i & 1, BLS12_381_P);
+    CHECK2(memcmp(r1, r2, sizeof(r1)) == 0, -4);
+    from_mont_384_c(r1, a, BLS12_381_P, BLS12_381_p0);
+    from_mont_384(r2, a, BLS12_381_P, BLS12_381_p0);
+    CHECK2(memcmp(r1, r2, sizeof(r1)) == 0, -5);
+    // a * b < p * 2^384, as in every call from blst
+    mul_384(w, a, b);
+    redc_mont_384_c(r1, w, BLS12_381_P, BLS12_381_p0);
+    redc_mont_384(r2, w, BLS12_381_P, BLS12_381_p0);
+    CHECK2(memcmp(r1, r2, sizeof(r1)) == 0, -6);
+    // ret aliasing a
+    add_mod_384_c(r1, a, b, BLS12_381_P);
+    add_mod_384(a, a, b, BLS12_381_P);
+    CHECK2(memcmp(r1, a, sizeof(r1)) == 0, -7);
+  }
+exit:
+  return err;
+}
+#endif
+
+#if defined(BLST_FP_BENCH_INV_VAR)
+#define INV_BENCH_ROUNDS 64
+
+int test_inverse(void) {
+  int err = 0;
+  for (int i = 0; i < TEST_ROUNDS; i++) {
+    vec384 a, r1, r2;
+    random_fp(a, i);
+    blst_fp_inverse(r1, a);
+    ckb_blst_reciprocal_fp_var(r2, a);
+    CHECK2(memcmp(r1, r2, sizeof(r1)) == 0, -8);
+  }
+exit:
+  return err;
+}
+
+int bench_inverse(void) {
+  vec384 a;
+  random_fp(a, 1);
+  uint64_t start = current_cycles();
+  for (int i = 0; i < INV_BENCH_ROUNDS; i++) {
+    blst_fp_inverse(a, a);
+  }
+  uint64_t ct = current_cycles();
+  for (int i = 0; i < INV_BENCH_ROUNDS; i++) {
+    ckb_blst_reciprocal_fp_var(a, a);
+  }
+  uint64_t var = current_cycles();
+
+  printf("blst_fp_inverse: %d cycles", (int)((ct - start) / INV_BENCH_ROUNDS));
+  printf("ckb_blst_reciprocal_fp_var: %d cycles",
+         (int)((var - ct) / INV_BENCH_ROUNDS));
+  return a[0] == 0;
+}
+#endif
+
+// each primitive is applied BENCH_ROUNDS times to its own output
+int bench(void) {
+  vec384 a, b;
+  vec768 w;
+  random_fp(a, 1);
+  random_fp(b, 2);
+  uint64_t start = current_cycles();
+  for (int i = 0; i < BENCH_ROUNDS; i++) {
+    add_mod_384(a, a, b, BLS12_381_P);
+  }
+  uint64_t add = current_cycles();
+  for (int i = 0; i < BENCH_ROUNDS; i++) {
+    sub_mod_384(a, a, b, BLS12_381_P);
+  }
+  uint64_t sub = current_cycles();
+  for (int i = 0; i < BENCH_ROUNDS; i++) {
+    mul_by_3_mod_384(a, a, BLS12_381_P);
+  }
+  uint64_t mul_by_3 = current_cycles();
+  for (int i = 0; i < BENCH_ROUNDS; i++) {
+    cneg_mod_384(a, a, 1, BLS12_381_P);
+  }
+  uint64_t cneg = current_cycles();
+  for (int i = 0; i < BENCH_ROUNDS; i++) {
+    from_mont_384(a, a, BLS12_381_P, BLS12_381_p0);
+  }
+  uint64_t from_mont = current_cycles();
+  mul_384(w, a, b);
+  for (int i = 0; i < BENCH_ROUNDS; i++) {
+    redc_mont_384(w, w, BLS12_381_P, BLS12_381_p0);
+  }
+  uint64_t redc = current_cycles();
+
+  printf("add_mod_384: %d cycles", (int)((add - start) / BENCH_ROUNDS));
+  printf("sub_mod_384: %d cycles", (int)((sub - add) / BENCH_ROUNDS));
+  printf("mul_by_3_mod_384: %d cycles",
+         (int)((mul_by_3 - sub) / BENCH_ROUNDS));
+  printf("cneg_mod_384: %d cycles", (int)((cneg - mul_by_3) / BENCH_ROUNDS));
+  printf("from_mont_384: %d cycles",
+         (int)((from_mont - cneg) / BENCH_ROUNDS));
+  printf("redc_mont_384: %d cycles",
+         (int)((redc - from_mont) / BENCH_ROUNDS));
+  return a[0] == 0 && w[0] == 0;
+}
+
+int main(int argc, const char *argv[]) {
+  int err = 0;
+#if defined(BLST_FP_BENCH_ASM)
+  CHECK(test_primitives());
+#endif
+  CHECK(bench());
+#if defined(BLST_FP_BENCH_INV_VAR)
+  CHECK(test_inverse());
+  CHECK(bench_inverse());
+#endif
+  printf("blst fp primitives passed");
+exit:
+  if (err != 0) {
+    printf("blst fp primitives failed: %d", err);
+  }
+  return err;
+}
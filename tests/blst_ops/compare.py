@@ -0,0 +1,52 @@
+#!/usr/bin/env python3
+"""Puts the outputs of build/blst-ops-bench* side by side.
+
+Each input is the ckb-vm-b-cli log of one build, the first one is the
+baseline, normally the C only build. Every "<operation>: <n> cycles" line
+becomes a row of a markdown table, with the cycles of each build and their
+ratio to the baseline.
+
+    python3 tests/blst_ops/compare.py no-asm=build/blst-ops-bench-no-asm.log \
+        asm=build/blst-ops-bench.log
+"""
+import re
+import sys
+
+LINE = re.compile(r"([A-Za-z0-9_]+): (\d+) cycles")
+
+
+def parse(path):
+    result = {}
+    with open(path) as f:
+        for line in f:
+            m = LINE.search(line)
+            if m:
+                result[m.group(1)] = int(m.group(2))
+    return result
+
+
+def main(args):
+    if len(args) < 2:
+        sys.exit("usage: compare.py NAME=LOG NAME=LOG...")
+    names, runs = [], []
+    for arg in args:
+        name, _, path = arg.partition("=")
+        names.append(name)
+        runs.append(parse(path))
+    base = runs[0]
+
+    header = ["operation"] + names + ["%s/%s" % (n, names[0]) for n in names[1:]]
+    print("| " + " | ".join(header) + " |")
+    print("|" + "---|" * len(header))
+    for op in base:
+        row = [op] + [str(run.get(op, "-")) for run in runs]
+        for run in runs[1:]:
+            if op in run and base[op]:
+                row.append("%.2f" % (run[op] / base[op]))
+            else:
+                row.append("-")
+        print("| " + " | ".join(row) + " |")
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
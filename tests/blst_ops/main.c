@@ -0,0 +1,189 @@
+// Per operation cycle benchmark of blst on CKB-VM.
+//
+// The same source is linked three times, see run-blst-ops-bench in the
+// Makefile: build/blst-ops-bench-no-asm with the C code of blst only,
+// build/blst-ops-bench with the RISC-V kernels of blst/*.riscv.S, and
+// build/blst-ops-bench-verify with the kernels plus the verify-only build of
+// blst/blst_verify_var.patch. Each prints one "<operation>: <n> cycles" line
+// per operation, averaged over its rounds, and tests/blst_ops/compare.py puts
+// the outputs side by side. Only public inputs are used, the vectors of
+// tests/blst/main.c, so the verify-only build is fine here. The current cycles
+// syscall needs CKB-VM version 1.
+#define CKB_C_STDLIB_PRINTF
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "blst.h"
+#include "ckb_syscalls.h"
+
+#define CHECK2(cond, code) \
+  do {                     \
+    if (!(cond)) {         \
+      err = code;          \
+      goto exit;           \
+    }                      \
+  } while (0)
+
+#ifndef SYS_ckb_current_cycles
+#define SYS_ckb_current_cycles 2042
+#endif
+
+// rounds per operation, the pairing related ones take millions of cycles
+#define FIELD_ROUNDS 1024
+#define POINT_ROUNDS 8
+#define PAIRING_ROUNDS 2
+
+#define COUNTOF(s) (sizeof(s) / sizeof(s[0]))
+
+const static uint8_t g_dst_label[] =
+    "BLS_SIG_BLS12381G2_XMD:SHA-256_SSWU_RO_NUL_";
+const static size_t g_dst_label_len = 43;
+
+// signature of g_msg under g_pk, from tests/blst/main.c
+const static uint8_t g_sig[96] = {
+    0xAC, 0xFC, 0x4E, 0x0B, 0x16, 0xCE, 0x56, 0x8C, 0x78, 0xBA, 0x3C, 0xCB,
+    0xE9, 0xFA, 0x6F, 0x26, 0x23, 0x1B, 0xEF, 0x65, 0xBC, 0xDB, 0x67, 0x04,
+    0xD9, 0x26, 0x46, 0x87, 0x09, 0xED, 0xFE, 0x31, 0x2C, 0x79, 0x67, 0xF1,
+    0x01, 0x75, 0x4A, 0xF1, 0xC2, 0x28, 0xD5, 0x25, 0x68, 0xA1, 0x75, 0x4E,
+    0x09, 0xE2, 0x93, 0x08, 0xCF, 0x1C, 0x9F, 0x11, 0x39, 0x13, 0xE3, 0x0C,
+    0x59, 0x5E, 0xF5, 0x50, 0x02, 0x12, 0xB5, 0xBB, 0xE7, 0x9E, 0x47, 0xAD,
+    0xE4, 0xFC, 0xB6, 0x5F, 0xAA, 0xE4, 0x87, 0x99, 0xAF, 0x72, 0xD5, 0x6B,
+    0xEB, 0x2C, 0x38, 0xD6, 0xA3, 0xD0, 0x45, 0x56, 0xB1, 0xC0, 0x8E, 0xC2};
+const static uint8_t g_pk[48] = {
+    0x91, 0x12, 0xA0, 0x38, 0x6A, 0x23, 0x40, 0x71, 0x4B, 0xA0, 0xC6, 0xD2,
+    0xDF, 0x23, 0x53, 0x77, 0xA8, 0x67, 0x9C, 0x38, 0x99, 0xD0, 0x3E, 0x6E,
+    0xF0, 0x4D, 0xBA, 0x7A, 0x50, 0xEF, 0x49, 0xE5, 0xA1, 0xDC, 0x93, 0x10,
+    0x5E, 0x93, 0x74, 0xE9, 0x3E, 0xD3, 0x01, 0xB6, 0x34, 0x87, 0xE1, 0x7C};
+const static uint8_t g_msg[12] = {0x68, 0x65, 0x6C, 0x6C, 0x6F, 0x2C,
+                                  0x20, 0x77, 0x6F, 0x72, 0x6C, 0x64};
+
+static uint64_t current_cycles(void) {
+  return (uint64_t)syscall(SYS_ckb_current_cycles, 0, 0, 0, 0, 0, 0);
+}
+
+static uint64_t g_start;
+
+static void bench_start(void) { g_start = current_cycles(); }
+
+static void bench_end(const char *name, int rounds) {
+  uint64_t cycles = current_cycles() - g_start;
+  printf("%s: %d cycles", name, (int)(cycles / rounds));
+}
+
+int main(int argc, const char *argv[]) {
+  int err = 0;
+  blst_p1_affine pk;
+  blst_p2_affine sig;
+  blst_p2 hash;
+  blst_p2_affine hash_affine;
+  blst_fp12 ml, fe;
+  static blst_fp6 lines[68];
+
+  // inputs of the pairing operations, also checks the vectors
+  CHECK2(blst_p1_uncompress(&pk, g_pk) == BLST_SUCCESS, -1);
+  CHECK2(blst_p2_uncompress(&sig, g_sig) == BLST_SUCCESS, -2);
+  blst_hash_to_g2(&hash, g_msg, COUNTOF(g_msg), g_dst_label, g_dst_label_len,
+                  NULL, 0);
+  blst_p2_to_affine(&hash_affine, &hash);
+  blst_precompute_lines(lines, &hash_affine);
+
+  // mul_mont_384, sqr_mont_384, mul_mont_384x and sqr_mont_384x, each applied
+  // to its own output
+  blst_fp a = pk.x, b = pk.y;
+  blst_fp2 a2 = sig.x, b2 = sig.y;
+  bench_start();
+  for (int i = 0; i < FIELD_ROUNDS; i++) {
+    blst_fp_mul(&a, &a, &b);
+  }
+  bench_end("blst_fp_mul", FIELD_ROUNDS);
+  bench_start();
+  for (int i = 0; i < FIELD_ROUNDS; i++) {
+    blst_fp_sqr(&a, &a);
+  }
+  bench_end("blst_fp_sqr", FIELD_ROUNDS);
+  bench_start();
+  for (int i = 0; i < FIELD_ROUNDS; i++) {
+    blst_fp2_mul(&a2, &a2, &b2);
+  }
+  bench_end("blst_fp2_mul", FIELD_ROUNDS);
+  bench_start();
+  for (int i = 0; i < FIELD_ROUNDS; i++) {
+    blst_fp2_sqr(&a2, &a2);
+  }
+  bench_end("blst_fp2_sqr", FIELD_ROUNDS);
+  bench_start();
+  for (int i = 0; i < FIELD_ROUNDS / 16; i++) {
+    blst_fp_inverse(&a, &a);
+  }
+  bench_end("blst_fp_inverse", FIELD_ROUNDS / 16);
+
+  // point decoding and subgroup checks
+  blst_p1_affine pk2;
+  blst_p2_affine sig2;
+  bench_start();
+  for (int i = 0; i < POINT_ROUNDS; i++) {
+    err |= blst_p1_uncompress(&pk2, g_pk);
+  }
+  bench_end("blst_p1_uncompress", POINT_ROUNDS);
+  bench_start();
+  for (int i = 0; i < POINT_ROUNDS; i++) {
+    err |= blst_p2_uncompress(&sig2, g_sig);
+  }
+  bench_end("blst_p2_uncompress", POINT_ROUNDS);
+  CHECK2(err == 0, -3);
+  bool in_group = true;
+  bench_start();
+  for (int i = 0; i < POINT_ROUNDS; i++) {
+    in_group &= blst_p1_affine_in_g1(&pk);
+  }
+  bench_end("blst_p1_affine_in_g1", POINT_ROUNDS);
+  bench_start();
+  for (int i = 0; i < POINT_ROUNDS; i++) {
+    in_group &= blst_p2_affine_in_g2(&sig);
+  }
+  bench_end("blst_p2_affine_in_g2", POINT_ROUNDS);
+  CHECK2(in_group, -4);
+
+  // hashing and pairing
+  bench_start();
+  for (int i = 0; i < POINT_ROUNDS; i++) {
+    blst_hash_to_g2(&hash, g_msg, COUNTOF(g_msg), g_dst_label,
+                    g_dst_label_len, NULL, 0);
+  }
+  bench_end("blst_hash_to_g2", POINT_ROUNDS);
+  bench_start();
+  for (int i = 0; i < PAIRING_ROUNDS; i++) {
+    blst_miller_loop(&ml, &sig, &pk);
+  }
+  bench_end("blst_miller_loop", PAIRING_ROUNDS);
+  bench_start();
+  for (int i = 0; i < PAIRING_ROUNDS; i++) {
+    blst_miller_loop_lines(&ml, lines, &pk);
+  }
+  bench_end("blst_miller_loop_lines", PAIRING_ROUNDS);
+  bench_start();
+  for (int i = 0; i < PAIRING_ROUNDS; i++) {
+    blst_final_exp(&fe, &ml);
+  }
+  bench_end("blst_final_exp", PAIRING_ROUNDS);
+
+  // whole verification, as in bls12_381_sighash_all
+  bench_start();
+  for (int i = 0; i < PAIRING_ROUNDS; i++) {
+    err |= blst_core_verify_pk_in_g1(&pk, &sig, true, g_msg, COUNTOF(g_msg),
+                                     g_dst_label, g_dst_label_len, NULL, 0);
+  }
+  bench_end("blst_core_verify_pk_in_g1", PAIRING_ROUNDS);
+  CHECK2(err == 0, -5);
+
+  printf("blst ops bench passed");
+exit:
+  if (err != 0) {
+    printf("blst ops bench failed: %d", err);
+  }
+  return err;
+}
@@ -20,7 +20,13 @@ use lazy_static::lazy_static;
 use rand::prelude::*;
 use rand::Rng;
 
-use blst_test::rc_lock::RcLockWitnessLock;
+use blake2b_rs::{Blake2b, Blake2bBuilder};
+use blst_test::rc_lock::{
+    RcIdentity, RcIdentityOpt, RcLockWitnessLock, SmtProof, SmtProofEntry, SmtProofEntryVec,
+};
+use sparse_merkle_tree::default_store::DefaultStore;
+use sparse_merkle_tree::traits::Hasher;
+use sparse_merkle_tree::{SparseMerkleTree, H256};
 
 pub const BLAKE2B_KEY: &[u8] = &[];
 pub const BLAKE2B_LEN: usize = 32;
@@ -28,6 +34,14 @@ pub const PERSONALIZATION: &[u8] = b"ckb-default-hash";
 
 pub const MAX_CYCLES: u64 = std::u64::MAX;
 pub const SIGNATURE_SIZE: usize = 144;
+pub const AFFINE_SIGNATURE_SIZE: usize = 288;
+// signers of IDENTITY_FLAGS_BLS12_381_AGGREGATE in TestConfig
+pub const AGGREGATE_SIGNERS: usize = 3;
+// IDENTITY_FLAGS_BLS12_381_MULTISIG in TestConfig: 2 of 3, signed by the
+// first and the last pubkey
+pub const MULTISIG_KEYS: usize = 3;
+pub const MULTISIG_THRESHOLD: u8 = 2;
+pub const MULTISIG_BITMAP: u8 = 0b101;
 
 // errors
 pub const ERROR_ENCODING: i8 = -2;
@@ -41,12 +55,16 @@ pub const ERROR_DUPLICATED_OUTPUTS: i8 = -46;
 pub const ERROR_LOCK_SCRIPT_HASH_NOT_FOUND: i8 = 70;
 pub const ERROR_NOT_ON_WHITE_LIST: i8 = 59;
 pub const ERROR_NO_WHITE_LIST: i8 = 83;
+pub const ERROR_PROOF_LENGTH_MISMATCHED: i8 = 81;
 pub const ERROR_ON_BLACK_LIST: i8 = 57;
 pub const ERROR_RCE_EMERGENCY_HALT: i8 = 54;
 
 lazy_static! {
     pub static ref BLST_LOCK: Bytes =
         Bytes::from(&include_bytes!("../../../build/bls12_381_sighash_all")[..]);
+    // Miller loop lines of the G2 generator, from deps/dump_bls12_381_data.c
+    pub static ref BLST_DATA: Bytes =
+        Bytes::from(&include_bytes!("../../../build/bls12_381_data")[..]);
 }
 
 pub fn gen_random_out_point(rng: &mut ThreadRng) -> OutPoint {
@@ -189,7 +207,6 @@ pub fn sign_tx_by_input_group(
     len: usize,
     config: &TestConfig,
 ) -> TransactionView {
-    let identity = config.id.to_identity();
     let tx_hash = tx.hash();
     let mut signed_witnesses: Vec<packed::Bytes> = tx
         .inputs()
@@ -202,7 +219,7 @@ pub fn sign_tx_by_input_group(
                 blake2b.update(&tx_hash.raw_data());
                 // digest the first witness
                 let witness = WitnessArgs::new_unchecked(tx.witnesses().get(i).unwrap().unpack());
-                let zero_lock = gen_zero_witness_lock(&identity);
+                let zero_lock = gen_zero_witness_lock(config, config.signature_size());
 
                 let witness_for_digest = witness
                     .clone()
@@ -220,7 +237,36 @@ pub fn sign_tx_by_input_group(
                 });
                 blake2b.finalize(&mut message);
 
-                let mut sig = config.blst_data.sign2(&message[..]);
+                let mut sig = if config.is_multisig() {
+                    let sigs: Vec<Signature> = config
+                        .signers
+                        .iter()
+                        .enumerate()
+                        .filter(|(i, _)| MULTISIG_BITMAP & (1 << i) != 0)
+                        .filter(|(i, _)| *i != 0 || config.scheme != TestScheme::IdentityPubKey)
+                        .map(|(_, signer)| signer.sign_pop(&message[..]))
+                        .collect();
+                    let refs: Vec<&Signature> = sigs.iter().collect();
+                    let aggregated = AggregateSignature::aggregate(&refs, false)
+                        .unwrap()
+                        .to_signature();
+                    let mut res = config.multisig_script();
+                    res.push(MULTISIG_BITMAP);
+                    res.extend_from_slice(&aggregated.compress()[..]);
+                    res
+                } else if config.is_aggregate() {
+                    config
+                        .signers
+                        .iter()
+                        .flat_map(|signer| signer.sign_aug(&message[..]).to_vec())
+                        .collect::<Vec<u8>>()
+                } else if config.is_min_sig() {
+                    config.min_sig_data.sign2(&message[..]).to_vec()
+                } else if config.scheme == TestScheme::AffinePoints {
+                    config.blst_data.sign2_affine(&message[..]).to_vec()
+                } else {
+                    config.blst_data.sign2(&message[..]).to_vec()
+                };
                 if config.scheme == TestScheme::WrongSignature {
                     sig[sig.len() - 1] ^= 0x1;
                 }
@@ -229,7 +275,7 @@ pub fn sign_tx_by_input_group(
                 }
 
                 let sig_bytes = Bytes::copy_from_slice(&sig[..]);
-                let witness_lock = gen_witness_lock(sig_bytes, &identity);
+                let witness_lock = gen_witness_lock(sig_bytes, config);
                 witness
                     .as_builder()
                     .lock(Some(witness_lock).pack())
@@ -261,7 +307,7 @@ pub fn gen_tx(dummy: &mut DummyDataLoader, config: &mut TestConfig) -> Transacti
 pub fn gen_tx_with_grouped_args(
     dummy: &mut DummyDataLoader,
     grouped_args: Vec<(Bytes, usize)>,
-    _config: &mut TestConfig,
+    config: &mut TestConfig,
 ) -> TransactionView {
     let mut rng = thread_rng();
     // setup sighash_all dep
@@ -302,6 +348,30 @@ pub fn gen_tx_with_grouped_args(
         )
         .output_data(Bytes::new().pack());
 
+    if config.use_lines_dep {
+        let data_out_point = {
+            let mut buf = [0u8; 32];
+            rng.fill(&mut buf);
+            OutPoint::new(buf.pack(), 0)
+        };
+        let data_cell = CellOutput::new_builder()
+            .capacity(
+                Capacity::bytes(BLST_DATA.len())
+                    .expect("data capacity")
+                    .pack(),
+            )
+            .build();
+        dummy
+            .cells
+            .insert(data_out_point.clone(), (data_cell, BLST_DATA.clone()));
+        tx_builder = tx_builder.cell_dep(
+            CellDep::new_builder()
+                .out_point(data_out_point)
+                .dep_type(DepType::Code.into())
+                .build(),
+        );
+    }
+
     for (args, inputs_size) in grouped_args {
         // setup dummy input unlock script
         for _ in 0..inputs_size {
@@ -389,6 +459,40 @@ pub fn debug_printer(script: &Byte32, msg: &str) {
 pub const IDENTITY_FLAGS_PUBKEY_HASH: u8 = 0;
 pub const IDENTITY_FLAGS_OWNER_LOCK: u8 = 1;
 pub const IDENTITY_FLAGS_BLS12_381: u8 = 15;
+pub const IDENTITY_FLAGS_BLS12_381_AGGREGATE: u8 = 16;
+pub const IDENTITY_FLAGS_BLS12_381_MULTISIG: u8 = 17;
+pub const IDENTITY_FLAGS_BLS12_381_MIN_SIG: u8 = 18;
+
+// leading byte of a list of rules in args, rule flags, and masks of the
+// proofs in the witness
+pub const RC_ARGS_RULES: u8 = 0x1;
+pub const RC_RULE_WHITE_LIST: u8 = 0x2;
+pub const SMT_MASK_ON: u8 = 0x1;
+pub const SMT_MASK_OFF: u8 = 0x2;
+
+pub struct CKBBlake2bHasher(Blake2b);
+
+impl Default for CKBBlake2bHasher {
+    fn default() -> Self {
+        let blake2b = Blake2bBuilder::new(32)
+            .personal(b"ckb-default-hash")
+            .build();
+        CKBBlake2bHasher(blake2b)
+    }
+}
+
+impl Hasher for CKBBlake2bHasher {
+    fn write_h256(&mut self, h: &H256) {
+        self.0.update(h.as_slice());
+    }
+    fn finish(self) -> H256 {
+        let mut hash = [0u8; 32];
+        self.0.finalize(&mut hash);
+        hash.into()
+    }
+}
+
+pub type SMT = SparseMerkleTree<CKBBlake2bHasher, H256, DefaultStore<H256>>;
 
 pub struct Identity {
     pub flags: u8,
@@ -415,10 +519,21 @@ pub struct TestConfig {
     pub use_rc: bool,
     pub scheme: TestScheme,
     pub scheme2: TestScheme2,
-    pub rc_root: Bytes,
+    // flags and smt root of each rule in args, see add_rc_rule
+    pub rc_rules: Vec<(u8, [u8; 32])>,
+    // writes the only rule, a white list, as the 32 bytes rc_root of args
+    // instead of a list of rules
+    pub rc_root_args: bool,
     pub proofs: Vec<Vec<u8>>,
     pub proof_masks: Vec<u8>,
     pub blst_data: BlstData,
+    // all signers of IDENTITY_FLAGS_BLS12_381_AGGREGATE, or all pubkeys of
+    // IDENTITY_FLAGS_BLS12_381_MULTISIG, blst_data is unused
+    pub signers: Vec<BlstData>,
+    // key of IDENTITY_FLAGS_BLS12_381_MIN_SIG
+    pub min_sig_data: BlstMinSigData,
+    // adds the cell dep with the precomputed lines of the G2 generator
+    pub use_lines_dep: bool,
 }
 
 #[derive(Copy, Clone, PartialEq)]
@@ -440,6 +555,11 @@ pub enum TestScheme {
     OwnerLockWithoutWitness,
     WrongSignature,
     WrongPubKey,
+    // serialized affine pubkey and signature instead of compressed ones
+    AffinePoints,
+    // the first multisig pubkey is the identity and does not sign, the others
+    // reach the threshold alone
+    IdentityPubKey,
 }
 
 #[derive(Copy, Clone, PartialEq)]
@@ -451,33 +571,123 @@ pub enum TestScheme2 {
 impl TestConfig {
     pub fn new(flags: u8) -> TestConfig {
         let blst_data = BlstData::new();
-        let pk = blst_data.get_pubkey();
-        let blake160 = blake160(&pk[..]);
+        let signers: Vec<BlstData> = match flags {
+            IDENTITY_FLAGS_BLS12_381_AGGREGATE => {
+                (0..AGGREGATE_SIGNERS).map(|_| BlstData::new()).collect()
+            }
+            IDENTITY_FLAGS_BLS12_381_MULTISIG => {
+                (0..MULTISIG_KEYS).map(|_| BlstData::new()).collect()
+            }
+            _ => Vec::new(),
+        };
 
-        TestConfig {
-            id: Identity { flags, blake160 },
+        let mut config = TestConfig {
+            id: Identity {
+                flags,
+                blake160: Default::default(),
+            },
             use_rc: false,
-            rc_root: Default::default(),
+            rc_rules: Default::default(),
+            rc_root_args: false,
             scheme: TestScheme::None,
             scheme2: TestScheme2::None,
             proofs: Default::default(),
             proof_masks: Default::default(),
             blst_data,
+            signers,
+            min_sig_data: BlstMinSigData::new(),
+            use_lines_dep: false,
+        };
+        config.id.blake160 = if config.is_multisig() {
+            blake160(&config.multisig_script())
+        } else if config.is_min_sig() {
+            blake160(&config.min_sig_data.get_pubkey()[..])
+        } else if config.is_aggregate() {
+            let pks: Vec<u8> = config
+                .signers
+                .iter()
+                .flat_map(|s| s.get_pubkey().to_vec())
+                .collect();
+            blake160(&pks[..])
+        } else {
+            blake160(&config.blst_data.get_pubkey()[..])
+        };
+        config
+    }
+
+    // threshold, pubkeys count and the pubkeys
+    pub fn multisig_script(&self) -> Vec<u8> {
+        let mut res = vec![MULTISIG_THRESHOLD, self.signers.len() as u8];
+        for (i, signer) in self.signers.iter().enumerate() {
+            if i == 0 && self.scheme == TestScheme::IdentityPubKey {
+                // compressed point at infinity
+                let mut pubkey = [0u8; 48];
+                pubkey[0] = 0xc0;
+                res.extend_from_slice(&pubkey);
+            } else {
+                res.extend_from_slice(&signer.get_pubkey()[..]);
+            }
         }
+        res
     }
 
     pub fn set_scheme(&mut self, scheme: TestScheme) {
         self.scheme = scheme;
     }
 
+    // Adds a rule over a tree of tree_size random keys, with the identity on
+    // it or not, and the proof the witness gives for it: on a white list or
+    // off a black list, whatever the tree holds.
+    pub fn add_rc_rule(&mut self, white_list: bool, on_list: bool, tree_size: usize) {
+        let mut rng = thread_rng();
+        let mut on_value = [0u8; 32];
+        on_value[0] = 1;
+        let on_value: H256 = on_value.into();
+
+        let mut smt = SMT::default();
+        for _ in 0..tree_size {
+            let mut key = [0u8; 32];
+            rng.fill_bytes(&mut key);
+            smt.update(key.into(), on_value).unwrap();
+        }
+        let key: H256 = self.id.to_smt_key().into();
+        if on_list {
+            smt.update(key, on_value).unwrap();
+        }
+
+        let (flags, mask, value) = if white_list {
+            (RC_RULE_WHITE_LIST, SMT_MASK_ON, on_value)
+        } else {
+            (0, SMT_MASK_OFF, H256::zero())
+        };
+        let proof = smt
+            .merkle_proof(vec![key])
+            .unwrap()
+            .compile(vec![(key, value)])
+            .unwrap();
+        let mut root = [0u8; 32];
+        root.copy_from_slice(smt.root().as_slice());
+
+        self.use_rc = true;
+        self.rc_rules.push((flags, root));
+        self.proofs.push(proof.0);
+        self.proof_masks.push(mask);
+    }
+
     pub fn gen_args(&self) -> Bytes {
         let mut bytes = BytesMut::with_capacity(128);
-        if self.use_rc {
-            bytes.resize(21, 0);
-            bytes.put(self.rc_root.as_ref());
-        } else {
-            bytes.put_u8(self.id.flags);
-            bytes.put(self.id.blake160.as_ref());
+        // the owner identity, the rc identity of the witness replaces it
+        bytes.put_u8(self.id.flags);
+        bytes.put(self.id.blake160.as_ref());
+        if self.use_rc && self.rc_root_args {
+            assert!(self.rc_rules.len() == 1 && self.rc_rules[0].0 == RC_RULE_WHITE_LIST);
+            bytes.put(&self.rc_rules[0].1[..]);
+        } else if self.use_rc {
+            bytes.put_u8(RC_ARGS_RULES);
+            for (flags, root) in &self.rc_rules {
+                bytes.put_u8(*flags);
+                bytes.put(&root[..]);
+            }
         }
         bytes.freeze()
     }
@@ -491,26 +701,72 @@ impl TestConfig {
     pub fn is_rc(&self) -> bool {
         self.use_rc
     }
+    pub fn is_aggregate(&self) -> bool {
+        self.id.flags == IDENTITY_FLAGS_BLS12_381_AGGREGATE
+    }
+    pub fn is_min_sig(&self) -> bool {
+        self.id.flags == IDENTITY_FLAGS_BLS12_381_MIN_SIG
+    }
+    pub fn is_multisig(&self) -> bool {
+        self.id.flags == IDENTITY_FLAGS_BLS12_381_MULTISIG
+    }
+    pub fn signature_size(&self) -> usize {
+        if self.is_multisig() {
+            self.multisig_script().len() + (self.signers.len() + 7) / 8 + 96
+        } else if self.is_aggregate() {
+            SIGNATURE_SIZE * self.signers.len()
+        } else if self.scheme == TestScheme::AffinePoints {
+            AFFINE_SIGNATURE_SIZE
+        } else {
+            SIGNATURE_SIZE
+        }
+    }
 }
 
-pub fn gen_witness_lock(sig: Bytes, _identity: &blst_test::rc_lock::Identity) -> Bytes {
+pub fn gen_witness_lock(sig: Bytes, config: &TestConfig) -> Bytes {
     let builder = RcLockWitnessLock::new_builder();
 
     let builder = builder.signature(Some(sig).pack());
+    let builder = if config.is_rc() {
+        let entries: Vec<SmtProofEntry> = config
+            .proofs
+            .iter()
+            .zip(config.proof_masks.iter())
+            .map(|(proof, mask)| {
+                let proof = SmtProof::new_builder()
+                    .set(proof.iter().map(|b| packed::Byte::new(*b)).collect())
+                    .build();
+                SmtProofEntry::new_builder()
+                    .mask(packed::Byte::new(*mask))
+                    .proof(proof)
+                    .build()
+            })
+            .collect();
+        let rc_identity = RcIdentity::new_builder()
+            .identity(config.id.to_identity())
+            .proofs(SmtProofEntryVec::new_builder().set(entries).build())
+            .build();
+        builder.rc_identity(RcIdentityOpt::new_builder().set(Some(rc_identity)).build())
+    } else {
+        builder
+    };
 
     builder.build().as_bytes()
 }
 
-pub fn gen_zero_witness_lock(identity: &blst_test::rc_lock::Identity) -> Bytes {
+pub fn gen_zero_witness_lock(config: &TestConfig, size: usize) -> Bytes {
     let mut zero = BytesMut::new();
-    zero.resize(SIGNATURE_SIZE, 0);
-    let witness_lock = gen_witness_lock(zero.freeze(), identity);
+    zero.resize(size, 0);
+    let witness_lock = gen_witness_lock(zero.freeze(), config);
 
     let mut res = BytesMut::new();
     res.resize(witness_lock.len(), 0);
     res.freeze()
 }
 
+pub const DST_AUG: &[u8] = b"BLS_SIG_BLS12381G2_XMD:SHA-256_SSWU_RO_AUG_";
+pub const DST_POP: &[u8] = b"BLS_SIG_BLS12381G2_XMD:SHA-256_SSWU_RO_POP_";
+
 pub struct BlstData {
     sk: SecretKey,
     pk: PublicKey,
@@ -542,6 +798,29 @@ impl BlstData {
         res
     }
 
+    pub fn sign2_affine(&self, msg: &[u8]) -> [u8; 288] {
+        let mut res = [0u8; 288];
+        let pk = self.pk.serialize();
+        let sig = self.sk.sign(&msg, &self.dst, &[]).serialize();
+        res[0..96].copy_from_slice(&pk[..]);
+        res[96..].copy_from_slice(&sig[..]);
+        res
+    }
+
+    pub fn sign_pop(&self, msg: &[u8]) -> Signature {
+        self.sk.sign(&msg, DST_POP, &[])
+    }
+
+    // pubkey followed by the signature of the message augmented by the pubkey
+    pub fn sign_aug(&self, msg: &[u8]) -> [u8; 144] {
+        let mut res = [0u8; 144];
+        let pk = self.pk.compress();
+        let sig = self.sk.sign(&msg, DST_AUG, &pk[..]).compress();
+        res[0..48].copy_from_slice(&pk[..]);
+        res[48..].copy_from_slice(&sig[..]);
+        res
+    }
+
     pub fn verify(&self, msg: &[u8], sig: &[u8; 96]) -> bool {
         let sig = Signature::from_bytes(sig).unwrap();
         let res = sig.verify(true, &msg, &self.dst, &[], &self.pk, false);
@@ -551,3 +830,34 @@ impl BlstData {
         self.pk.compress()
     }
 }
+
+pub const DST_G1: &[u8] = b"BLS_SIG_BLS12381G1_XMD:SHA-256_SSWU_RO_NUL_";
+
+// min-sig keys, pubkeys in G2 and signatures in G1
+pub struct BlstMinSigData {
+    sk: blst::min_sig::SecretKey,
+    pk: blst::min_sig::PublicKey,
+}
+
+impl BlstMinSigData {
+    pub fn new() -> BlstMinSigData {
+        let mut rng = thread_rng();
+        let mut ikm = [0u8; 32];
+        rng.fill_bytes(&mut ikm);
+        let sk = blst::min_sig::SecretKey::key_gen(&ikm, &[]).unwrap();
+        let pk = sk.sk_to_pk();
+        BlstMinSigData { sk, pk }
+    }
+    // 96 bytes pubkey followed by the 48 bytes signature
+    pub fn sign2(&self, msg: &[u8]) -> [u8; 144] {
+        let mut res = [0u8; 144];
+        let pk = self.pk.compress();
+        let sig = self.sk.sign(&msg, DST_G1, &[]).compress();
+        res[0..96].copy_from_slice(&pk[..]);
+        res[96..].copy_from_slice(&sig[..]);
+        res
+    }
+    pub fn get_pubkey(&self) -> [u8; 96] {
+        self.pk.compress()
+    }
+}
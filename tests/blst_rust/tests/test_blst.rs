@@ -15,8 +15,10 @@ use blst::*;
 use misc::{
     blake160, build_resolved_tx, debug_printer, gen_tx, gen_tx_with_grouped_args, gen_witness_lock,
     sign_tx, sign_tx_by_input_group, BlstData, DummyDataLoader, TestConfig, TestScheme,
-    ERROR_BLST_VERIFY_FAILED, ERROR_ENCODING, ERROR_PUBKEY_BLAKE160_HASH, ERROR_WITNESS_SIZE,
-    IDENTITY_FLAGS_BLS12_381, MAX_CYCLES,
+    ERROR_BLST_VERIFY_FAILED, ERROR_ENCODING, ERROR_NOT_ON_WHITE_LIST, ERROR_ON_BLACK_LIST,
+    ERROR_PROOF_LENGTH_MISMATCHED, ERROR_PUBKEY_BLAKE160_HASH, ERROR_WITNESS_SIZE,
+    IDENTITY_FLAGS_BLS12_381, IDENTITY_FLAGS_BLS12_381_AGGREGATE, IDENTITY_FLAGS_BLS12_381_MIN_SIG,
+    IDENTITY_FLAGS_BLS12_381_MULTISIG, MAX_CYCLES,
 };
 
 mod misc;
@@ -80,6 +82,270 @@ fn test_sighash_all_unlock_failed_wrong_pubkey() {
     );
 }
 
+#[test]
+fn test_sighash_all_unlock_affine() {
+    let mut data_loader = DummyDataLoader::new();
+
+    let mut config = TestConfig::new(IDENTITY_FLAGS_BLS12_381);
+    config.scheme = TestScheme::AffinePoints;
+
+    let tx = gen_tx(&mut data_loader, &mut config);
+    let tx = sign_tx(&mut data_loader, tx, &mut config);
+    let resolved_tx = build_resolved_tx(&data_loader, &tx);
+
+    let mut verifier = TransactionScriptsVerifier::new(&resolved_tx, &data_loader);
+    verifier.set_debug_printer(debug_printer);
+    let verify_result = verifier.verify(MAX_CYCLES);
+    verify_result.expect("pass verification");
+}
+
+#[test]
+fn test_aggregate_unlock() {
+    let mut data_loader = DummyDataLoader::new();
+
+    let mut config = TestConfig::new(IDENTITY_FLAGS_BLS12_381_AGGREGATE);
+
+    let tx = gen_tx(&mut data_loader, &mut config);
+    let tx = sign_tx(&mut data_loader, tx, &mut config);
+    let resolved_tx = build_resolved_tx(&data_loader, &tx);
+
+    let mut verifier = TransactionScriptsVerifier::new(&resolved_tx, &data_loader);
+    verifier.set_debug_printer(debug_printer);
+    let verify_result = verifier.verify(MAX_CYCLES);
+    verify_result.expect("pass verification");
+}
+
+#[test]
+fn test_aggregate_unlock_failed() {
+    let mut data_loader = DummyDataLoader::new();
+
+    let mut config = TestConfig::new(IDENTITY_FLAGS_BLS12_381_AGGREGATE);
+    config.scheme = TestScheme::WrongSignature;
+
+    let tx = gen_tx(&mut data_loader, &mut config);
+    let tx = sign_tx(&mut data_loader, tx, &mut config);
+    let resolved_tx = build_resolved_tx(&data_loader, &tx);
+
+    let mut verifier = TransactionScriptsVerifier::new(&resolved_tx, &data_loader);
+    verifier.set_debug_printer(debug_printer);
+    let verify_result = verifier.verify(MAX_CYCLES);
+    assert_error_eq!(
+        verify_result.unwrap_err(),
+        ScriptError::ValidationFailure(ERROR_BLST_VERIFY_FAILED).input_lock_script(0),
+    );
+}
+
+#[test]
+fn test_multisig_unlock() {
+    let mut data_loader = DummyDataLoader::new();
+
+    let mut config = TestConfig::new(IDENTITY_FLAGS_BLS12_381_MULTISIG);
+
+    let tx = gen_tx(&mut data_loader, &mut config);
+    let tx = sign_tx(&mut data_loader, tx, &mut config);
+    let resolved_tx = build_resolved_tx(&data_loader, &tx);
+
+    let mut verifier = TransactionScriptsVerifier::new(&resolved_tx, &data_loader);
+    verifier.set_debug_printer(debug_printer);
+    let verify_result = verifier.verify(MAX_CYCLES);
+    verify_result.expect("pass verification");
+}
+
+#[test]
+fn test_multisig_unlock_failed() {
+    let mut data_loader = DummyDataLoader::new();
+
+    let mut config = TestConfig::new(IDENTITY_FLAGS_BLS12_381_MULTISIG);
+    config.scheme = TestScheme::WrongSignature;
+
+    let tx = gen_tx(&mut data_loader, &mut config);
+    let tx = sign_tx(&mut data_loader, tx, &mut config);
+    let resolved_tx = build_resolved_tx(&data_loader, &tx);
+
+    let mut verifier = TransactionScriptsVerifier::new(&resolved_tx, &data_loader);
+    verifier.set_debug_printer(debug_printer);
+    let verify_result = verifier.verify(MAX_CYCLES);
+    assert_error_eq!(
+        verify_result.unwrap_err(),
+        ScriptError::ValidationFailure(ERROR_BLST_VERIFY_FAILED).input_lock_script(0),
+    );
+}
+
+#[test]
+fn test_multisig_identity_pubkey() {
+    let mut data_loader = DummyDataLoader::new();
+
+    let mut config = TestConfig::new(IDENTITY_FLAGS_BLS12_381_MULTISIG);
+    config.scheme = TestScheme::IdentityPubKey;
+    config.id.blake160 = blake160(&config.multisig_script());
+
+    let tx = gen_tx(&mut data_loader, &mut config);
+    let tx = sign_tx(&mut data_loader, tx, &mut config);
+    let resolved_tx = build_resolved_tx(&data_loader, &tx);
+
+    let mut verifier = TransactionScriptsVerifier::new(&resolved_tx, &data_loader);
+    verifier.set_debug_printer(debug_printer);
+    let verify_result = verifier.verify(MAX_CYCLES);
+    assert_error_eq!(
+        verify_result.unwrap_err(),
+        ScriptError::ValidationFailure(ERROR_BLST_VERIFY_FAILED).input_lock_script(0),
+    );
+}
+
+fn verify_cycles(config: &mut TestConfig) -> u64 {
+    let mut data_loader = DummyDataLoader::new();
+
+    let tx = gen_tx(&mut data_loader, config);
+    let tx = sign_tx(&mut data_loader, tx, config);
+    let resolved_tx = build_resolved_tx(&data_loader, &tx);
+
+    let mut verifier = TransactionScriptsVerifier::new(&resolved_tx, &data_loader);
+    verifier.set_debug_printer(debug_printer);
+    verifier.verify(MAX_CYCLES).expect("pass verification")
+}
+
+#[test]
+fn test_min_sig_unlock() {
+    let mut config = TestConfig::new(IDENTITY_FLAGS_BLS12_381_MIN_SIG);
+    config.use_lines_dep = true;
+    verify_cycles(&mut config);
+}
+
+#[test]
+fn test_min_sig_unlock_without_lines() {
+    let mut config = TestConfig::new(IDENTITY_FLAGS_BLS12_381_MIN_SIG);
+    verify_cycles(&mut config);
+}
+
+#[test]
+fn test_min_sig_unlock_failed() {
+    let mut data_loader = DummyDataLoader::new();
+
+    let mut config = TestConfig::new(IDENTITY_FLAGS_BLS12_381_MIN_SIG);
+    config.scheme = TestScheme::WrongSignature;
+    config.use_lines_dep = true;
+
+    let tx = gen_tx(&mut data_loader, &mut config);
+    let tx = sign_tx(&mut data_loader, tx, &mut config);
+    let resolved_tx = build_resolved_tx(&data_loader, &tx);
+
+    let mut verifier = TransactionScriptsVerifier::new(&resolved_tx, &data_loader);
+    verifier.set_debug_printer(debug_printer);
+    let verify_result = verifier.verify(MAX_CYCLES);
+    assert_error_eq!(
+        verify_result.unwrap_err(),
+        ScriptError::ValidationFailure(ERROR_BLST_VERIFY_FAILED).input_lock_script(0),
+    );
+}
+
+// cargo test test_min_sig_cycles -- --nocapture
+#[test]
+fn test_min_sig_cycles() {
+    let min_pk = verify_cycles(&mut TestConfig::new(IDENTITY_FLAGS_BLS12_381));
+    let min_sig = verify_cycles(&mut TestConfig::new(IDENTITY_FLAGS_BLS12_381_MIN_SIG));
+    let mut config = TestConfig::new(IDENTITY_FLAGS_BLS12_381_MIN_SIG);
+    config.use_lines_dep = true;
+    let min_sig_lines = verify_cycles(&mut config);
+    println!("min-pk (flag 15): {} cycles", min_pk);
+    println!("min-sig (flag 18): {} cycles", min_sig);
+    println!("min-sig with G2 generator lines: {} cycles", min_sig_lines);
+}
+
+fn verify_failure(config: &mut TestConfig, error: i8) {
+    let mut data_loader = DummyDataLoader::new();
+
+    let tx = gen_tx(&mut data_loader, config);
+    let tx = sign_tx(&mut data_loader, tx, config);
+    let resolved_tx = build_resolved_tx(&data_loader, &tx);
+
+    let mut verifier = TransactionScriptsVerifier::new(&resolved_tx, &data_loader);
+    verifier.set_debug_printer(debug_printer);
+    let verify_result = verifier.verify(MAX_CYCLES);
+    assert_error_eq!(
+        verify_result.unwrap_err(),
+        ScriptError::ValidationFailure(error).input_lock_script(0),
+    );
+}
+
+#[test]
+fn test_rc_on_white_list_unlock() {
+    let mut config = TestConfig::new(IDENTITY_FLAGS_BLS12_381);
+    config.add_rc_rule(true, true, 16);
+    verify_cycles(&mut config);
+}
+
+#[test]
+fn test_rc_root_args_unlock() {
+    let mut config = TestConfig::new(IDENTITY_FLAGS_BLS12_381);
+    config.add_rc_rule(true, true, 16);
+    config.rc_root_args = true;
+    verify_cycles(&mut config);
+}
+
+#[test]
+fn test_rc_root_args_not_on_white_list() {
+    let mut config = TestConfig::new(IDENTITY_FLAGS_BLS12_381);
+    config.add_rc_rule(true, false, 16);
+    config.rc_root_args = true;
+    verify_failure(&mut config, ERROR_NOT_ON_WHITE_LIST);
+}
+
+#[test]
+fn test_rc_not_on_white_list() {
+    let mut config = TestConfig::new(IDENTITY_FLAGS_BLS12_381);
+    config.add_rc_rule(true, false, 16);
+    verify_failure(&mut config, ERROR_NOT_ON_WHITE_LIST);
+}
+
+#[test]
+fn test_rc_not_on_black_list_unlock() {
+    let mut config = TestConfig::new(IDENTITY_FLAGS_BLS12_381);
+    config.add_rc_rule(true, true, 16);
+    config.add_rc_rule(false, false, 16);
+    verify_cycles(&mut config);
+}
+
+#[test]
+fn test_rc_on_black_list() {
+    let mut config = TestConfig::new(IDENTITY_FLAGS_BLS12_381);
+    config.add_rc_rule(true, true, 16);
+    config.add_rc_rule(false, true, 16);
+    verify_failure(&mut config, ERROR_ON_BLACK_LIST);
+}
+
+#[test]
+fn test_rc_proof_length_mismatched() {
+    let mut config = TestConfig::new(IDENTITY_FLAGS_BLS12_381);
+    config.add_rc_rule(true, true, 16);
+    config.add_rc_rule(false, false, 16);
+    config.proofs.pop();
+    config.proof_masks.pop();
+    verify_failure(&mut config, ERROR_PROOF_LENGTH_MISMATCHED);
+}
+
+// cargo test test_rc_cycles -- --nocapture
+#[test]
+fn test_rc_cycles() {
+    let base = verify_cycles(&mut TestConfig::new(IDENTITY_FLAGS_BLS12_381));
+    println!("without rc identity: {} cycles", base);
+    for tree_size in &[1, 16, 256, 4096] {
+        let mut config = TestConfig::new(IDENTITY_FLAGS_BLS12_381);
+        config.add_rc_rule(true, true, *tree_size);
+        let one_rule = verify_cycles(&mut config);
+        for _ in 1..8 {
+            config.add_rc_rule(false, false, *tree_size);
+        }
+        let eight_rules = verify_cycles(&mut config);
+        println!(
+            "tree of {} keys: proof of {} bytes, 1 rule +{} cycles, 8 rules +{} cycles",
+            tree_size,
+            config.proofs[0].len(),
+            one_rule - base,
+            eight_rules - base
+        );
+    }
+}
+
 #[test]
 fn test_blst() {
     let bd = BlstData::new();
@@ -0,0 +1,211 @@
+// Differential test and cycle benchmark for the secp256k1 field kernels in
+// secp256k1/secp256k1_fe_5x52.riscv.S and the safegcd inversions in
+// deps/secp256k1_modinv_var.h.
+//
+// The library is built with its C field arithmetic and exponentiation based
+// inversions here. Every kernel output is checked against
+// secp256k1_fe_mul_inner and secp256k1_fe_sqr_inner on random inputs up to
+// magnitude 8, and safegcd inverses against secp256k1_fe_inv and
+// secp256k1_scalar_inverse. Then a fixed amount of multiplications, squarings
+// and inversions is done by the library code, or by the replacements with
+// -DSECP256K1_FIELD_BENCH_ASM and -DSECP256K1_INV_BENCH_VAR, so the cycles
+// reported by ckb-vm-cli can be compared between builds.
+#define CKB_C_STDLIB_PRINTF
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ckb_syscalls.h"
+#include "secp256k1_helper.h"
+
+#define CHECK2(cond, code) \
+  do {                     \
+    if (!(cond)) {         \
+      err = code;          \
+      goto exit;           \
+    }                      \
+  } while (0)
+
+#define CHECK(_code)    \
+  do {                  \
+    int code = (_code); \
+    if (code != 0) {    \
+      err = code;       \
+      goto exit;        \
+    }                   \
+  } while (0)
+
+#define LIMB_MASK 0xFFFFFFFFFFFFFULL
+#define TEST_ROUNDS 4096
+#define BENCH_ROUNDS 65536
+#define INV_TEST_ROUNDS 256
+#define INV_BENCH_ROUNDS 256
+
+void secp256k1_fe_mul_5x52_asm(uint64_t *r, const uint64_t *a,
+                               const uint64_t *b);
+void secp256k1_fe_sqr_5x52_asm(uint64_t *r, const uint64_t *a);
+
+static uint64_t g_seed = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t next_random(void) {
+  g_seed ^= g_seed << 13;
+  g_seed ^= g_seed >> 7;
+  g_seed ^= g_seed << 17;
+  return g_seed;
+}
+
+// limbs of a field element of magnitude m, the largest ones every 8 rounds
+static void random_fe(uint64_t r[5], int round) {
+  uint64_t m = 1 << (next_random() % 4);
+  for (int i = 0; i < 5; i++) {
+    uint64_t bound = 2 * m * (i == 4 ? (LIMB_MASK >> 4) : LIMB_MASK);
+    r[i] = (round % 8 == 0) ? bound : next_random() % (bound + 1);
+  }
+}
+
+static int check_limbs(const uint64_t r[5]) {
+  for (int i = 0; i < 4; i++) {
+    if (r[i] >> 52) {
+      return 0;
+    }
+  }
+  return (r[4] >> 49) == 0;
+}
+
+int test_mul(void) {
+  int err = 0;
+  for (int i = 0; i < TEST_ROUNDS; i++) {
+    uint64_t a[5], b[5], r1[5], r2[5];
+    random_fe(a, i);
+    random_fe(b, i);
+    secp256k1_fe_mul_inner(r1, a, b);
+    secp256k1_fe_mul_5x52_asm(r2, a, b);
+    CHECK2(memcmp(r1, r2, sizeof(r1)) == 0, -1);
+    CHECK2(check_limbs(r2), -2);
+    // r aliasing a
+    secp256k1_fe_mul_5x52_asm(a, a, b);
+    CHECK2(memcmp(r1, a, sizeof(r1)) == 0, -3);
+  }
+exit:
+  return err;
+}
+
+int test_sqr(void) {
+  int err = 0;
+  for (int i = 0; i < TEST_ROUNDS; i++) {
+    uint64_t a[5], r1[5], r2[5];
+    random_fe(a, i);
+    secp256k1_fe_sqr_inner(r1, a);
+    secp256k1_fe_sqr_5x52_asm(r2, a);
+    CHECK2(memcmp(r1, r2, sizeof(r1)) == 0, -4);
+    CHECK2(check_limbs(r2), -5);
+    secp256k1_fe_sqr_5x52_asm(a, a);
+    CHECK2(memcmp(r1, a, sizeof(r1)) == 0, -6);
+  }
+exit:
+  return err;
+}
+
+static void random_b32(uint8_t b32[32], int round) {
+  for (int i = 0; i < 32; i += 8) {
+    uint64_t r = next_random();
+    memcpy(&b32[i], &r, 8);
+  }
+  // small values and values close to the moduli
+  if (round % 4 == 1) {
+    memset(b32, 0, 31);
+  } else if (round % 4 == 2) {
+    memset(b32, 0xff, 16);
+  }
+}
+
+int test_fe_inv(void) {
+  int err = 0;
+  for (int i = 0; i < INV_TEST_ROUNDS; i++) {
+    uint8_t b32[32];
+    secp256k1_fe a, r1, r2;
+    random_b32(b32, i);
+    if (!secp256k1_fe_set_b32(&a, b32)) {
+      continue;
+    }
+    secp256k1_fe_inv(&r1, &a);
+    ckb_secp256k1_fe_inv_var(&r2, &a);
+    CHECK2(secp256k1_fe_equal_var(&r1, &r2), -7);
+  }
+exit:
+  return err;
+}
+
+int test_scalar_inv(void) {
+  int err = 0;
+  for (int i = 0; i < INV_TEST_ROUNDS; i++) {
+    uint8_t b32[32];
+    secp256k1_scalar a, r1, r2;
+    random_b32(b32, i);
+    secp256k1_scalar_set_b32(&a, b32, NULL);
+    secp256k1_scalar_inverse(&r1, &a);
+    ckb_secp256k1_scalar_inverse_var(&r2, &a);
+    CHECK2(secp256k1_scalar_eq(&r1, &r2), -8);
+  }
+exit:
+  return err;
+}
+
+// a chain of dependent multiplications and squarings, as in an inversion
+int bench(void) {
+  uint64_t a[5], b[5];
+  random_fe(a, 1);
+  random_fe(b, 1);
+  for (int i = 0; i < BENCH_ROUNDS; i++) {
+#if defined(SECP256K1_FIELD_BENCH_ASM)
+    secp256k1_fe_sqr_5x52_asm(a, a);
+    secp256k1_fe_mul_5x52_asm(a, a, b);
+#else
+    secp256k1_fe_sqr_inner(a, a);
+    secp256k1_fe_mul_inner(a, a, b);
+#endif
+  }
+  return a[0] == 0 && a[1] == 0 && a[2] == 0 && a[3] == 0 && a[4] == 0;
+}
+
+// one field and one scalar inversion per round, as in a pubkey recovery
+int bench_inv(void) {
+  uint8_t b32[32];
+  secp256k1_fe a;
+  secp256k1_scalar s;
+  random_b32(b32, 0);
+  secp256k1_fe_set_b32(&a, b32);
+  secp256k1_scalar_set_b32(&s, b32, NULL);
+  for (int i = 0; i < INV_BENCH_ROUNDS; i++) {
+    secp256k1_fe t = a;
+    secp256k1_scalar u = s;
+#if defined(SECP256K1_INV_BENCH_VAR)
+    ckb_secp256k1_fe_inv_var(&a, &t);
+    ckb_secp256k1_scalar_inverse_var(&s, &u);
+#else
+    secp256k1_fe_inv(&a, &t);
+    secp256k1_scalar_inverse(&s, &u);
+#endif
+  }
+  secp256k1_fe_normalize_var(&a);
+  return secp256k1_fe_is_zero(&a) || secp256k1_scalar_is_zero(&s);
+}
+
+int main(int argc, const char *argv[]) {
+  int err = 0;
+  CHECK(test_mul());
+  CHECK(test_sqr());
+  CHECK(test_fe_inv());
+  CHECK(test_scalar_inv());
+  CHECK(bench());
+  CHECK(bench_inv());
+  printf("secp256k1 field passed");
+exit:
+  if (err != 0) {
+    printf("secp256k1 field failed: %d", err);
+  }
+  return err;
+}